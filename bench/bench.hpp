@@ -0,0 +1,202 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   bench.hpp                                          :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sdestann <sdestann@student.42perpignan.    +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/11/18 15:12:12 by sdestann          #+#    #+#             */
+/*   Updated: 2024/11/18 16:56:02 by sdestann         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef BENCH_HPP
+# define BENCH_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <barrier>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Nombre d'allocations faites par le thread courant depuis son démarrage,
+// compté par les operator new remplacés dans main.cpp.
+uint64_t allocationCount();
+
+// Empêche le compilateur de supprimer le calcul de value.
+template<typename T>
+inline void keep(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+class Bench {
+    /** @brief Mesure des fonctions qui font un nombre donné d'opérations et
+     * affiche, pour chacune, le temps et le nombre d'allocations par
+     * opération, comparés à une référence si elle est chargée.
+     *
+     * exemple :
+     *
+     * bench.run("pool/acquire_release", [&](size_t iterations) {
+     *     for (size_t i = 0; i < iterations; ++i) {
+     *         keep(pool.acquire());
+     *     }
+     * });
+     *
+     * Le nombre d'itérations est doublé jusqu'à ce qu'une mesure dure
+     * minTime / 8, puis ajusté pour durer minTime. On garde la meilleure de
+     * repetitions mesures : la moins perturbée par le reste de la machine.
+     */
+public:
+    struct Result {
+        double nsPerOp;
+        double allocsPerOp;
+    };
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    double minTime;
+    size_t repetitions;
+    size_t maxThreads;
+    std::string filter;
+    std::map<std::string, Result> baseline;
+    std::vector<std::pair<std::string, Result>> results;
+
+    struct Sample {
+        double seconds;
+        uint64_t allocations;
+    };
+
+    template<typename TMeasure>
+    Result measure(TMeasure&& sample) {
+        size_t iterations = 1;
+        for (;;) {
+            Sample probe = sample(iterations);
+            if (probe.seconds >= minTime / 8 || iterations >= (1ull << 40)) {
+                double perIteration = probe.seconds
+                    / static_cast<double>(iterations);
+                iterations = std::max<size_t>(1, static_cast<size_t>(
+                            minTime / std::max(perIteration, 1e-12)));
+                break;
+            }
+            iterations *= 2;
+        }
+        Result best{1e300, 0};
+        for (size_t i = 0; i < repetitions; ++i) {
+            Sample run = sample(iterations);
+            double nsPerOp = run.seconds * 1e9
+                / static_cast<double>(iterations);
+            if (nsPerOp < best.nsPerOp) {
+                best = Result{nsPerOp, static_cast<double>(run.allocations)
+                    / static_cast<double>(iterations)};
+            }
+        }
+        return best;
+    }
+
+    void report(const std::string& name, const Result& result,
+            const std::string& extra = "");
+
+public:
+    Bench(double p_minTime, size_t p_repetitions, size_t p_maxThreads,
+            std::string p_filter) : minTime(p_minTime),
+        repetitions(p_repetitions), maxThreads(p_maxThreads),
+        filter(std::move(p_filter)) {
+    }
+
+    size_t threadLimit() const {
+        return maxThreads;
+    }
+
+    bool selected(const std::string& name) const {
+        return filter.empty() || name.find(filter) != std::string::npos;
+    }
+
+    // Mesure function(iterations), qui doit faire iterations opérations.
+    template<typename TFunction>
+    void run(const std::string& name, TFunction&& function) {
+        if (!selected(name)) {
+            return;
+        }
+        report(name, measure([&function](size_t iterations) {
+            uint64_t allocations = allocationCount();
+            Clock::time_point start = Clock::now();
+            function(iterations);
+            double seconds = std::chrono::duration<double>(Clock::now()
+                    - start).count();
+            return Sample{seconds, allocationCount() - allocations};
+        }));
+    }
+
+    /**
+     * @brief Mesure la montée en charge : pour 1, 2, 4... maxThreads
+     * threads, lance function(thread, iterations) sur tous en même temps.
+     * Le temps par opération est le temps écoulé divisé par le nombre total
+     * d'opérations : il baisse quand function passe bien à l'échelle.
+     */
+    template<typename TFunction>
+    void runThreads(const std::string& name, TFunction&& function) {
+        double single = 0;
+        for (size_t threads = 1; threads <= maxThreads; threads *= 2) {
+            std::string threadName = name + "/threads:"
+                + std::to_string(threads);
+            if (!selected(threadName)) {
+                continue;
+            }
+            Result result = measure([&](size_t iterations) {
+                std::atomic<uint64_t> allocations{0};
+                std::barrier<> start(static_cast<std::ptrdiff_t>(threads));
+                std::vector<std::thread> workers;
+                Clock::time_point begin;
+                for (size_t thread = 1; thread < threads; ++thread) {
+                    workers.emplace_back([&, thread] {
+                        start.arrive_and_wait();
+                        uint64_t before = allocationCount();
+                        function(thread, iterations);
+                        allocations += allocationCount() - before;
+                    });
+                }
+                start.arrive_and_wait();
+                begin = Clock::now();
+                uint64_t before = allocationCount();
+                function(size_t{0}, iterations);
+                allocations += allocationCount() - before;
+                for (std::thread& worker : workers) {
+                    worker.join();
+                }
+                double seconds = std::chrono::duration<double>(Clock::now()
+                        - begin).count();
+                return Sample{seconds / static_cast<double>(threads),
+                    allocations.load()};
+            });
+            result.allocsPerOp /= static_cast<double>(threads);
+            if (threads == 1) {
+                single = result.nsPerOp;
+            }
+            report(threadName, result, single > 0 ? "x" + std::to_string(
+                        single / result.nsPerOp).substr(0, 4) : "");
+        }
+    }
+
+    // Charge une référence écrite par save() : les résultats suivants lui
+    // sont comparés.
+    void loadBaseline(const std::string& path);
+    void save(const std::string& path) const;
+    // Nombre de mesures plus lentes que la référence de plus de threshold
+    // (0.1 : 10 %).
+    size_t regressions(double threshold) const;
+    void printHeader() const;
+};
+
+// Une fonction par composant, dans son propre fichier.
+void benchPool(Bench& bench);
+void benchDataBuffer(Bench& bench);
+void benchMemento(Bench& bench);
+void benchObserver(Bench& bench);
+void benchStateMachine(Bench& bench);
+
+#endif
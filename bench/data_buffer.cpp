@@ -0,0 +1,138 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   data_buffer.cpp                                    :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sdestann <sdestann@student.42perpignan.    +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/11/18 15:12:12 by sdestann          #+#    #+#             */
+/*   Updated: 2024/11/18 16:56:02 by sdestann         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "bench.hpp"
+#include "libftpp.hpp"
+
+namespace {
+
+struct Entity {
+    int id;
+    float x;
+    float y;
+    float z;
+    short health;
+    std::string name;
+
+    DATABUFFER_FIELDS(Entity, id, x, y, z, health, name)
+};
+
+// Chaque opération écrit ou lit une valeur : les mesures sont faites par
+// paquets de batch valeurs dans un buffer réutilisé.
+constexpr size_t batch = 1024;
+
+template<typename T>
+void benchScalar(Bench& bench, const std::string& name, T value,
+        DataBuffer::Encoding encoding) {
+    DataBuffer buffer;
+    buffer.setEncoding(encoding);
+    bench.run("databuffer/encode_" + name, [&](size_t iterations) {
+        for (size_t done = 0; done < iterations; done += batch) {
+            buffer.clear();
+            for (size_t j = 0; j < std::min(batch, iterations - done); ++j) {
+                buffer << static_cast<T>(value + static_cast<T>(j));
+            }
+        }
+        keep(buffer.size());
+    });
+    buffer.clear();
+    for (size_t j = 0; j < batch; ++j) {
+        buffer << static_cast<T>(value + static_cast<T>(j));
+    }
+    bench.run("databuffer/decode_" + name, [&](size_t iterations) {
+        T result{};
+        for (size_t done = 0; done < iterations; done += batch) {
+            buffer.rewind();
+            for (size_t j = 0; j < std::min(batch, iterations - done); ++j) {
+                buffer >> result;
+                keep(result);
+            }
+        }
+    });
+}
+
+void benchString(Bench& bench, size_t length) {
+    std::string text(length, 'x');
+    DataBuffer buffer;
+    bench.run("databuffer/string_roundtrip_" + std::to_string(length),
+            [&](size_t iterations) {
+        std::string result;
+        for (size_t i = 0; i < iterations; ++i) {
+            buffer.clear();
+            buffer << text;
+            buffer >> result;
+            keep(result.data());
+        }
+    });
+}
+
+void benchBulk(Bench& bench, size_t count) {
+    std::vector<float> values(count, 1.5f);
+    DataBuffer buffer;
+    bench.run("databuffer/bulk_roundtrip_" + std::to_string(count),
+            [&](size_t iterations) {
+        std::vector<float> result;
+        for (size_t i = 0; i < iterations; ++i) {
+            buffer.clear();
+            buffer << values;
+            buffer >> result;
+            keep(result.data());
+        }
+    });
+}
+
+}
+
+void benchDataBuffer(Bench& bench) {
+    benchScalar<int32_t>(bench, "int32", 7, DataBuffer::Encoding::Fixed);
+    benchScalar<uint64_t>(bench, "varint", 300, DataBuffer::Encoding::Compact);
+    benchScalar<double>(bench, "double", 1.5, DataBuffer::Encoding::Fixed);
+
+    benchString(bench, 16);
+    benchString(bench, 1024);
+    benchString(bench, 64 * 1024);
+
+    benchBulk(bench, 64);
+    benchBulk(bench, 64 * 1024);
+
+    Entity entity{42, 1.0f, 2.0f, 3.0f, 100, "player"};
+    DataBuffer buffer;
+    bench.run("databuffer/struct_roundtrip", [&](size_t iterations) {
+        Entity result;
+        for (size_t i = 0; i < iterations; ++i) {
+            buffer.clear();
+            buffer << entity;
+            buffer >> result;
+            keep(result.id);
+        }
+    });
+
+    // Un état de 1 Mio redondant, compressé puis décompressé.
+    DataBuffer state;
+    for (size_t i = 0; i < 1024 * 1024 / sizeof(uint32_t); ++i) {
+        state << static_cast<uint32_t>(i % 64);
+    }
+    DataBuffer packed;
+    bench.run("databuffer/compress_1MiB", [&](size_t iterations) {
+        for (size_t i = 0; i < iterations; ++i) {
+            state.compressTo(packed);
+        }
+        keep(packed.size());
+    });
+    DataBuffer unpacked;
+    bench.run("databuffer/decompress_1MiB", [&](size_t iterations) {
+        for (size_t i = 0; i < iterations; ++i) {
+            packed.decompressTo(unpacked);
+        }
+        keep(unpacked.size());
+    });
+}
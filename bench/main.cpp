@@ -0,0 +1,213 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   main.cpp                                           :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sdestann <sdestann@student.42perpignan.    +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/11/18 15:12:12 by sdestann          #+#    #+#             */
+/*   Updated: 2024/11/18 16:56:02 by sdestann         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "bench.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+
+// Allocations comptées par thread, pour ne pas ajouter de contention aux
+// mesures multi-threads.
+static thread_local uint64_t allocations = 0;
+
+uint64_t allocationCount() {
+    return allocations;
+}
+
+void* operator new(size_t size) {
+    ++allocations;
+    if (void* pointer = std::malloc(size ? size : 1)) {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+    ++allocations;
+    size_t align = static_cast<size_t>(alignment);
+    if (void* pointer = std::aligned_alloc(align, (size + align - 1)
+                / align * align)) {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size, std::align_val_t alignment) {
+    return operator new(size, alignment);
+}
+
+void operator delete(void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer, size_t) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::align_val_t) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer, std::align_val_t) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, size_t, std::align_val_t) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer, size_t, std::align_val_t) noexcept {
+    std::free(pointer);
+}
+
+void Bench::printHeader() const {
+    std::printf("%-48s %12s %12s %10s\n", "benchmark", "ns/op", "allocs/op",
+            baseline.empty() ? "" : "baseline");
+}
+
+void Bench::report(const std::string& name, const Result& result,
+        const std::string& extra) {
+    std::string comparison = extra;
+    auto it = baseline.find(name);
+    if (it != baseline.end() && it->second.nsPerOp > 0) {
+        char delta[32];
+        std::snprintf(delta, sizeof(delta), "%+.1f%%", (result.nsPerOp
+                    / it->second.nsPerOp - 1.0) * 100.0);
+        comparison = delta + (extra.empty() ? "" : "  " + extra);
+    }
+    std::printf("%-48s %12.2f %12.2f %10s\n", name.c_str(), result.nsPerOp,
+            result.allocsPerOp, comparison.c_str());
+    std::fflush(stdout);
+    results.emplace_back(name, result);
+}
+
+// Format : une ligne par mesure, "nom ns/op allocs/op".
+void Bench::loadBaseline(const std::string& path) {
+    std::ifstream file(path);
+    if (!file) {
+        throw std::runtime_error("Cannot open file");
+    }
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream fields(line);
+        std::string name;
+        Result result;
+        if (fields >> name >> result.nsPerOp >> result.allocsPerOp) {
+            baseline[name] = result;
+        }
+    }
+}
+
+void Bench::save(const std::string& path) const {
+    std::ofstream file(path);
+    if (!file) {
+        throw std::runtime_error("Cannot open file");
+    }
+    for (const auto& [name, result] : results) {
+        file << name << " " << result.nsPerOp << " " << result.allocsPerOp
+            << "\n";
+    }
+}
+
+size_t Bench::regressions(double threshold) const {
+    size_t count = 0;
+    for (const auto& [name, result] : results) {
+        auto it = baseline.find(name);
+        if (it != baseline.end()
+                && result.nsPerOp > it->second.nsPerOp * (1.0 + threshold)) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+static void usage(const char* program) {
+    std::cerr << "usage: " << program << " [--filter text] [--time seconds]"
+        " [--repetitions count] [--threads count]\n"
+        "       [--compare baseline] [--save baseline] [--threshold ratio]\n";
+}
+
+int main(int argc, char** argv) {
+    std::string filter;
+    std::string compare;
+    std::string output;
+    double minTime = 0.2;
+    double threshold = 0.1;
+    size_t repetitions = 3;
+    size_t maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    for (int i = 1; i < argc; ++i) {
+        std::string option = argv[i];
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+            return 2;
+        }
+        std::string value = argv[++i];
+        if (option == "--filter") {
+            filter = value;
+        } else if (option == "--time") {
+            minTime = std::stod(value);
+        } else if (option == "--repetitions") {
+            repetitions = std::max<size_t>(1, std::stoul(value));
+        } else if (option == "--threads") {
+            maxThreads = std::max<size_t>(1, std::stoul(value));
+        } else if (option == "--compare") {
+            compare = value;
+        } else if (option == "--save") {
+            output = value;
+        } else if (option == "--threshold") {
+            threshold = std::stod(value);
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    try {
+        Bench bench(minTime, repetitions, maxThreads, filter);
+        if (!compare.empty()) {
+            bench.loadBaseline(compare);
+        }
+        bench.printHeader();
+        benchPool(bench);
+        benchDataBuffer(bench);
+        benchMemento(bench);
+        benchObserver(bench);
+        benchStateMachine(bench);
+        if (!output.empty()) {
+            bench.save(output);
+        }
+        if (!compare.empty()) {
+            size_t slower = bench.regressions(threshold);
+            std::printf("%zu benchmark(s) slower than %s by more than "
+                    "%.0f%%\n", slower, compare.c_str(), threshold * 100.0);
+        }
+    } catch (const std::exception& exception) {
+        std::cerr << "bench: " << exception.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
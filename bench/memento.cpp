@@ -0,0 +1,96 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   memento.cpp                                        :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sdestann <sdestann@student.42perpignan.    +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/11/18 15:12:12 by sdestann          #+#    #+#             */
+/*   Updated: 2024/11/18 16:56:02 by sdestann         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "bench.hpp"
+#include "libftpp.hpp"
+
+namespace {
+
+// État de size octets : des compteurs et un nom, comme un objet de jeu.
+class State : public Memento {
+private:
+    std::vector<uint32_t> counters;
+    std::string name = "state";
+
+    void _saveToSnapshot(Snapshot& snapshot) override {
+        snapshot << name << counters;
+    }
+
+    void _loadFromSnapshot(Snapshot& snapshot) override {
+        snapshot >> name >> counters;
+    }
+
+public:
+    explicit State(size_t size) : counters(size / sizeof(uint32_t)) {
+        for (size_t i = 0; i < counters.size(); ++i) {
+            counters[i] = static_cast<uint32_t>(i % 64);
+        }
+    }
+
+    // Modifie un compteur sur 100, répartis sur tout l'état.
+    void tick() {
+        for (size_t i = 0; i < counters.size(); i += 100) {
+            ++counters[i];
+        }
+    }
+};
+
+std::string sizeName(size_t size) {
+    if (size >= 1024 * 1024) {
+        return std::to_string(size / (1024 * 1024)) + "MiB";
+    }
+    if (size >= 1024) {
+        return std::to_string(size / 1024) + "KiB";
+    }
+    return std::to_string(size) + "B";
+}
+
+void benchSize(Bench& bench, size_t size) {
+    std::string suffix = "_" + sizeName(size);
+    State state(size);
+    bench.run("memento/save" + suffix, [&](size_t iterations) {
+        for (size_t i = 0; i < iterations; ++i) {
+            auto snapshot = state.save();
+            keep(&snapshot);
+        }
+    });
+    auto saved = state.save();
+    bench.run("memento/load" + suffix, [&](size_t iterations) {
+        for (size_t i = 0; i < iterations; ++i) {
+            state.load(saved);
+        }
+    });
+    auto base = state.save();
+    bench.run("memento/save_delta" + suffix, [&](size_t iterations) {
+        for (size_t i = 0; i < iterations; ++i) {
+            state.tick();
+            auto delta = state.saveDelta(base);
+            keep(&delta);
+        }
+    });
+    state.setCompression(true);
+    bench.run("memento/save_compressed" + suffix, [&](size_t iterations) {
+        for (size_t i = 0; i < iterations; ++i) {
+            auto snapshot = state.save();
+            keep(&snapshot);
+        }
+    });
+}
+
+}
+
+void benchMemento(Bench& bench) {
+    benchSize(bench, 64);
+    benchSize(bench, 4 * 1024);
+    benchSize(bench, 256 * 1024);
+    benchSize(bench, 4 * 1024 * 1024);
+}
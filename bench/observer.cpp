@@ -0,0 +1,80 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   observer.cpp                                       :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sdestann <sdestann@student.42perpignan.    +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/11/18 15:12:12 by sdestann          #+#    #+#             */
+/*   Updated: 2024/11/18 16:56:02 by sdestann         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "bench.hpp"
+#include "libftpp.hpp"
+
+namespace {
+
+enum class Event { Moved, Damaged, COUNT };
+
+// Compteur modifié par les abonnés, pour que leur appel ne soit pas
+// supprimé. Un par thread, pour ne pas mesurer le partage de la ligne.
+thread_local uint64_t calls = 0;
+
+void benchFanOut(Bench& bench, size_t subscribers) {
+    std::string suffix = "_fanout" + std::to_string(subscribers);
+    Observer<Event> observer;
+    for (size_t i = 0; i < subscribers; ++i) {
+        observer.subscribe(Event::Moved, [] { ++calls; });
+    }
+    bench.run("observer/notify" + suffix, [&](size_t iterations) {
+        for (size_t i = 0; i < iterations; ++i) {
+            observer.notify(Event::Moved);
+        }
+        keep(calls);
+    });
+
+    ConcurrentObserver<Event> concurrent;
+    std::vector<ConcurrentObserver<Event>::Subscription> subscriptions;
+    for (size_t i = 0; i < subscribers; ++i) {
+        subscriptions.push_back(concurrent.subscribe(Event::Moved,
+                    [] { ++calls; }));
+    }
+    bench.runThreads("concurrent_observer/notify" + suffix,
+            [&](size_t, size_t iterations) {
+        for (size_t i = 0; i < iterations; ++i) {
+            concurrent.notify(Event::Moved);
+        }
+        keep(calls);
+    });
+}
+
+}
+
+void benchObserver(Bench& bench) {
+    benchFanOut(bench, 1);
+    benchFanOut(bench, 8);
+    benchFanOut(bench, 64);
+
+    // Événement sans abonné : le coût de la recherche seule.
+    Observer<Event> observer;
+    observer.subscribe(Event::Moved, [] { ++calls; });
+    bench.run("observer/notify_unsubscribed", [&](size_t iterations) {
+        for (size_t i = 0; i < iterations; ++i) {
+            observer.notify(Event::Damaged);
+        }
+    });
+
+    // Notifications rangées dans la file puis traitées par flush().
+    AsyncObserver<Event, uint64_t> async(4096);
+    std::atomic<uint64_t> received{0};
+    async.subscribe(Event::Moved, [&received](const uint64_t& value) {
+        received.fetch_add(value, std::memory_order_relaxed);
+    });
+    bench.run("async_observer/notify_flush", [&](size_t iterations) {
+        for (size_t i = 0; i < iterations; ++i) {
+            async.notify(Event::Moved, uint64_t{1});
+        }
+        async.flush();
+    });
+}
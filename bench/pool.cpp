@@ -0,0 +1,98 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   pool.cpp                                           :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sdestann <sdestann@student.42perpignan.    +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/11/18 15:12:12 by sdestann          #+#    #+#             */
+/*   Updated: 2024/11/18 16:56:02 by sdestann         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "bench.hpp"
+#include "libftpp.hpp"
+#include <memory>
+
+namespace {
+
+struct Payload {
+    char bytes[64];
+};
+
+// Sans cache, chaque acquire() et chaque libération passent par la pile
+// partagée (un compare_exchange chacun) ; avec enableThreadCache(), par le
+// cache du thread.
+void benchConfiguration(Bench& bench, const std::string& suffix,
+        bool cached) {
+    Pool<Payload> pool;
+    pool.resize(1024);
+    if (cached) {
+        pool.enableThreadCache();
+    }
+    bench.run("pool/acquire_release" + suffix, [&pool](size_t iterations) {
+        for (size_t i = 0; i < iterations; ++i) {
+            Pool<Payload>::Object object = pool.acquire();
+            keep(&*object);
+        }
+    });
+
+    // Plusieurs objets tenus en même temps, rendus dans le désordre.
+    bench.run("pool/acquire_release_batch16" + suffix,
+            [&pool](size_t iterations) {
+        std::vector<Pool<Payload>::Object> objects;
+        objects.reserve(16);
+        for (size_t i = 0; i < iterations; i += 16) {
+            for (size_t j = 0; j < 16; ++j) {
+                objects.push_back(pool.acquire());
+            }
+            keep(objects.data());
+            for (size_t j = 0; j < 16; ++j) {
+                objects[(j * 7) % 16] = Pool<Payload>::Object();
+            }
+            objects.clear();
+        }
+    });
+
+    // Un pool partagé par tous les threads.
+    Pool<Payload> shared;
+    shared.resize(4096);
+    if (cached) {
+        shared.enableThreadCache();
+    }
+    bench.runThreads("pool/acquire_release_shared" + suffix,
+            [&shared](size_t, size_t iterations) {
+        for (size_t i = 0; i < iterations; ++i) {
+            Pool<Payload>::Object object = shared.acquire();
+            keep(&*object);
+        }
+        shared.flushThreadCache();
+    });
+}
+
+}
+
+void benchPool(Bench& bench) {
+    benchConfiguration(bench, "", false);
+    benchConfiguration(bench, "_cached", true);
+
+    // Référence : le même objet alloué par new.
+    bench.run("pool/new_delete", [](size_t iterations) {
+        for (size_t i = 0; i < iterations; ++i) {
+            std::unique_ptr<Payload> object = std::make_unique<Payload>();
+            keep(object.get());
+        }
+    });
+
+    // Un pool par thread : la limite de la montée en charge, sans partage
+    // (sa préparation est comptée dans la mesure).
+    bench.runThreads("pool/acquire_release_private",
+            [](size_t, size_t iterations) {
+        Pool<Payload> pool;
+        pool.resize(1024);
+        for (size_t i = 0; i < iterations; ++i) {
+            Pool<Payload>::Object object = pool.acquire();
+            keep(&*object);
+        }
+    });
+}
@@ -0,0 +1,100 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   state_machine.cpp                                  :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sdestann <sdestann@student.42perpignan.    +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/11/18 15:12:12 by sdestann          #+#    #+#             */
+/*   Updated: 2024/11/18 16:56:02 by sdestann         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "bench.hpp"
+#include "libftpp.hpp"
+#include <cmath>
+
+namespace {
+
+// Sans COUNT : StateMachine générique, à base de tables associatives.
+enum class Sparse { Idle, Walking, Running };
+// Avec COUNT : StateMachine dense, à base de tableaux.
+enum class Dense { Idle, Walking, Running, COUNT };
+
+thread_local uint64_t calls = 0;
+
+template<typename TState>
+void benchMachine(Bench& bench, const std::string& name) {
+    StateMachine<TState> machine;
+    machine.addState(TState::Idle);
+    machine.addState(TState::Walking);
+    machine.addState(TState::Running);
+    machine.addTransition(TState::Idle, TState::Walking, [] { ++calls; });
+    machine.addTransition(TState::Walking, TState::Running, [] { ++calls; });
+    machine.addTransition(TState::Running, TState::Idle, [] { ++calls; });
+    machine.addAction(TState::Idle, [] { ++calls; });
+    machine.addAction(TState::Walking, [] { ++calls; });
+    machine.addAction(TState::Running, [] { ++calls; });
+    // Gardé d'une mesure à l'autre : la machine reste où le cycle s'arrête.
+    const TState cycle[] = {TState::Walking, TState::Running, TState::Idle};
+    size_t step = 0;
+    bench.run("state_machine/transition_" + name, [&](size_t iterations) {
+        for (size_t i = 0; i < iterations; ++i) {
+            machine.transitionTo(cycle[step++ % 3]);
+        }
+        keep(calls);
+    });
+    bench.run("state_machine/update_" + name, [&](size_t iterations) {
+        for (size_t i = 0; i < iterations; ++i) {
+            machine.update();
+        }
+        keep(calls);
+    });
+}
+
+}
+
+void benchStateMachine(Bench& bench) {
+    benchMachine<Sparse>(bench, "sparse");
+    benchMachine<Dense>(bench, "dense");
+
+    // 100000 entités réparties sur trois états ; une opération est un
+    // updateAll() de toutes les entités, dont l'action fait avancer chaque
+    // entité : assez de travail pour que plusieurs threads soient utiles.
+    constexpr size_t entities = 100000;
+    auto graph = std::make_shared<StateMachineBatch<Dense>::Graph>();
+    graph->addState(Dense::Idle);
+    graph->addState(Dense::Walking);
+    graph->addState(Dense::Running);
+    graph->addTransition(Dense::Idle, Dense::Walking, [](uint32_t) {});
+    graph->addTransition(Dense::Idle, Dense::Running, [](uint32_t) {});
+    std::vector<float> positions(entities, 1.0f);
+    const float speeds[] = {0.0f, 1.0f, 2.5f};
+    for (Dense state : {Dense::Idle, Dense::Walking, Dense::Running}) {
+        float speed = speeds[static_cast<size_t>(state)];
+        graph->addAction(state, [&positions, speed](
+                    std::span<const uint32_t> batch) {
+            for (uint32_t entity : batch) {
+                float& position = positions[entity];
+                position = std::fmod(position + speed * std::sqrt(position
+                            + 1.0f), 1000.0f);
+            }
+        });
+    }
+    StateMachineBatch<Dense> batch(graph, entities, Dense::Idle);
+    for (size_t entity = 0; entity < entities; entity += 3) {
+        batch.transitionTo(entity, Dense::Walking);
+        if (entity + 1 < entities) {
+            batch.transitionTo(entity + 1, Dense::Running);
+        }
+    }
+    for (size_t threads = 1; threads <= bench.threadLimit(); threads *= 2) {
+        bench.run("state_machine_batch/update_all_100k/threads:"
+                + std::to_string(threads), [&](size_t iterations) {
+            for (size_t i = 0; i < iterations; ++i) {
+                batch.updateAll(threads);
+            }
+            keep(positions[0]);
+        });
+    }
+}
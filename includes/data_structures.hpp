@@ -14,10 +14,308 @@
 # define DATA_STRUCTURES_HPP
 
 #include <vector>
-#include <queue>
+#include <functional>
 #include <memory>
 #include <cstring>
+#include <string>
+#include <array>
+#include <map>
+#include <optional>
+#include <string_view>
+#include <span>
+#include <tuple>
+#include <cstddef>
+#include <type_traits>
+#include <limits>
+#if defined(__BMI2__)
+# include <immintrin.h>
+#endif
+#if defined(__ARM_NEON)
+# include <arm_neon.h>
+#endif
+#include <cstdint>
+#include <atomic>
+#include <bit>
+#include <new>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <chrono>
+#include <thread>
 #include <stdexcept>
+#include <cerrno>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "instrumentation.hpp"
+
+class ThreadSlot {
+    /** @brief ThreadSlot attribue à chaque thread un petit numéro, unique
+     * parmi les threads vivants, qui sert à indexer des données par thread
+     * dans un tableau (les caches du Pool par exemple) : contrairement à un
+     * thread_local, cela fonctionne aussi pour des membres d'instance.
+     * 
+     * Le numéro est attribué au premier appel de current() dans un thread et
+     * rendu à la fin du thread, pour être réutilisé par un thread suivant.
+     * Au-delà de maxSlots threads vivants, current() retourne none.
+     * 
+     * addExitHook() enregistre une fonction appelée à la fin de chaque
+     * thread qui a un numéro, avant que celui-ci soit rendu : le Pool y
+     * rend le cache du thread.
+     */
+public:
+    static constexpr size_t maxSlots = 256;
+    static constexpr size_t none = maxSlots;
+
+    // Le numéro est gardé dans un thread_local trivial : après le premier
+    // appel, current() n'est qu'une lecture, sans appel de fonction.
+    static size_t current() {
+        size_t slot = cachedSlot;
+        if (slot == unassigned) [[unlikely]] {
+            slot = assign();
+        }
+        return slot;
+    }
+
+    // Appelle function(context, slot) à la fin de chaque thread qui a un
+    // numéro, depuis ce thread. removeExitHook(context) doit être appelé
+    // avant que context soit détruit ; il attend la fin des appels en cours.
+    static void addExitHook(void (*function)(void*, size_t), void* context) {
+        Registry& reg = registry();
+        std::lock_guard<std::mutex> lock(reg.hooksMutex);
+        reg.hooks.push_back(ExitHook{function, context});
+    }
+
+    static void removeExitHook(void* context) {
+        Registry& reg = registry();
+        std::lock_guard<std::mutex> lock(reg.hooksMutex);
+        std::erase_if(reg.hooks, [context](const ExitHook& hook) {
+            return hook.context == context;
+        });
+    }
+
+private:
+    static constexpr size_t unassigned = maxSlots + 1;
+    static inline thread_local size_t cachedSlot = unassigned;
+
+    [[gnu::noinline]] static size_t assign() {
+        thread_local Holder holder;
+        cachedSlot = holder.slot;
+        return holder.slot;
+    }
+
+    struct ExitHook {
+        void (*function)(void*, size_t);
+        void* context;
+    };
+
+    // Les fonctions de fin de thread ont leur propre mutex : elles peuvent
+    // en prendre d'autres, sous lesquels un thread peut obtenir son numéro.
+    struct Registry {
+        std::mutex mutex;
+        std::vector<size_t> released;
+        size_t next = 0;
+        std::mutex hooksMutex;
+        std::vector<ExitHook> hooks;
+    };
+
+    static Registry& registry() {
+        static Registry instance;
+        return instance;
+    }
+
+    struct Holder {
+        size_t slot;
+
+        Holder() : slot(none) {
+            Registry& reg = registry();
+            std::lock_guard<std::mutex> lock(reg.mutex);
+            if (!reg.released.empty()) {
+                slot = reg.released.back();
+                reg.released.pop_back();
+            } else if (reg.next < maxSlots) {
+                slot = reg.next++;
+            }
+        }
+
+        // Le numéro peut être réutilisé dès maintenant : jusqu'à la fin du
+        // thread (destructeurs d'autres thread_local), current() retourne
+        // none.
+        ~Holder() {
+            cachedSlot = none;
+            if (slot != none) {
+                Registry& reg = registry();
+                {
+                    std::lock_guard<std::mutex> lock(reg.hooksMutex);
+                    for (const ExitHook& hook : reg.hooks) {
+                        hook.function(hook.context, slot);
+                    }
+                }
+                std::lock_guard<std::mutex> lock(reg.mutex);
+                reg.released.push_back(slot);
+            }
+        }
+    };
+};
+
+template<typename TSignature, size_t TCapacity = 48>
+class InplaceFunction;
+
+template<typename TResult, typename... TArgs, size_t TCapacity>
+class InplaceFunction<TResult(TArgs...), TCapacity> {
+    /** @brief Équivalent de std::function qui stocke le callable dans un
+     * buffer de TCapacity octets, sans jamais allouer : un callable trop
+     * grand est refusé à la compilation. Un callable trivialement copiable
+     * (lambda qui capture des pointeurs ou des valeurs) est copié et détruit
+     * sans appel indirect ; seul l'appel passe par un pointeur de fonction.
+     * 
+     * exemple :
+     * 
+     * InplaceFunction<void(int)> print = [prefix](int value) { ... };
+     * print(42);
+     * 
+     * @throws std::runtime_error "Empty function" - Si la fonction est
+     * appelée sans callable
+     */
+private:
+    // Copie, déplacement et destruction d'un callable non trivial.
+    struct Operations {
+        void (*copy)(void* destination, const void* source);
+        void (*move)(void* destination, void* source);
+        void (*destroy)(void* callable);
+    };
+
+    template<typename TCallable>
+    static constexpr Operations operationsFor{
+        [](void* destination, const void* source) {
+            new (destination) TCallable(*static_cast<const TCallable*>(source));
+        },
+        [](void* destination, void* source) {
+            new (destination) TCallable(std::move(
+                        *static_cast<TCallable*>(source)));
+        },
+        [](void* callable) {
+            static_cast<TCallable*>(callable)->~TCallable();
+        }
+    };
+
+    alignas(std::max_align_t) mutable unsigned char storage[TCapacity];
+    TResult (*invoker)(void*, TArgs&&...) = nullptr;
+    // nullptr si le callable est trivialement copiable.
+    const Operations* operations = nullptr;
+
+    void copyFrom(const InplaceFunction& other) {
+        invoker = other.invoker;
+        operations = other.operations;
+        if (operations) {
+            operations->copy(storage, other.storage);
+        } else if (invoker) {
+            std::memcpy(storage, other.storage, TCapacity);
+        }
+    }
+
+    void moveFrom(InplaceFunction& other) {
+        invoker = other.invoker;
+        operations = other.operations;
+        if (operations) {
+            operations->move(storage, other.storage);
+        } else if (invoker) {
+            std::memcpy(storage, other.storage, TCapacity);
+        }
+    }
+
+public:
+    static constexpr size_t capacity = TCapacity;
+
+    InplaceFunction() = default;
+    InplaceFunction(std::nullptr_t) {}
+
+    template<typename TCallable>
+        requires (!std::is_same_v<std::decay_t<TCallable>, InplaceFunction>
+                && std::is_invocable_r_v<TResult, std::decay_t<TCallable>&,
+                TArgs...>)
+    InplaceFunction(TCallable&& callable) {
+        using Callable = std::decay_t<TCallable>;
+        static_assert(sizeof(Callable) <= TCapacity,
+                "InplaceFunction: callable is too large for the buffer");
+        static_assert(alignof(Callable) <= alignof(std::max_align_t),
+                "InplaceFunction: callable is over-aligned");
+        static_assert(std::is_copy_constructible_v<Callable>,
+                "InplaceFunction: callable must be copyable");
+        // Un pointeur nul donne une fonction vide. Un nom de fonction, qui
+        // arrive ici par référence, n'est jamais nul.
+        using Argument = std::remove_cvref_t<TCallable>;
+        if constexpr (std::is_pointer_v<Argument>
+                || std::is_member_pointer_v<Argument>) {
+            if (!callable) {
+                return;
+            }
+        }
+        if constexpr (std::is_trivially_copyable_v<Callable>) {
+            // Copié par un memcpy de tout le buffer : les octets après le
+            // callable (ou un lambda vide) ne doivent pas rester indéfinis.
+            std::memset(storage, 0, TCapacity);
+        }
+        new (storage) Callable(std::forward<TCallable>(callable));
+        invoker = [](void* stored, TArgs&&... p_args) -> TResult {
+            return std::invoke(*static_cast<Callable*>(stored),
+                    std::forward<TArgs>(p_args)...);
+        };
+        if constexpr (!std::is_trivially_copyable_v<Callable>) {
+            operations = &operationsFor<Callable>;
+        }
+    }
+
+    InplaceFunction(const InplaceFunction& other) {
+        copyFrom(other);
+    }
+
+    InplaceFunction(InplaceFunction&& other) noexcept {
+        moveFrom(other);
+    }
+
+    InplaceFunction& operator=(const InplaceFunction& other) {
+        if (this != &other) {
+            reset();
+            copyFrom(other);
+        }
+        return *this;
+    }
+
+    InplaceFunction& operator=(InplaceFunction&& other) noexcept {
+        if (this != &other) {
+            reset();
+            moveFrom(other);
+        }
+        return *this;
+    }
+
+    ~InplaceFunction() {
+        reset();
+    }
+
+    void reset() {
+        if (operations) {
+            operations->destroy(storage);
+        }
+        invoker = nullptr;
+        operations = nullptr;
+    }
+
+    explicit operator bool() const {
+        return invoker != nullptr;
+    }
+
+    TResult operator()(TArgs... p_args) const {
+        if (!invoker) {
+            throw std::runtime_error("Empty function");
+        }
+        return invoker(storage, std::forward<TArgs>(p_args)...);
+    }
+};
 
 template<typename TType>
 class Pool {
@@ -26,9 +324,24 @@ class Pool {
      * d'objects:
      * 
      * Performance : Elle évite les allocations/désallocations fréquentes de 
-     * mémoire en réutilisant les objets créés.
-     * Thread-safety : Les objets sont gérés de manière sûre avec plusieurs
-     * threads.
+     * mémoire en réutilisant les emplacements des objets : ceux-ci sont
+     * construits en place dans des blocs contigus pré-alloués par resize(),
+     * puis détruits sans que leur mémoire soit libérée.
+     * Thread-safety : acquire() et la libération d'un Object peuvent être
+     * appelés depuis plusieurs threads en même temps. La liste des objets
+     * disponibles est une pile lock-free (pile de Treiber sur des indices),
+     * sans mutex global. resize() peut aussi être appelé pendant que d'autres
+     * threads utilisent le pool.
+     * Multi-coeurs : enableThreadCache() ajoute un cache d'indices par thread
+     * (magazine) qui évite aux threads de se disputer le sommet de la pile.
+     * Coût : sans cache, acquire() et la libération font chacun un
+     * compare_exchange sur la pile partagée, le prix d'une capacité exacte
+     * visible de tous les threads ; c'est plus lent qu'un new/delete servi
+     * par le cache par thread de malloc. Avec enableThreadCache(), le cas
+     * courant ne touche que le cache du thread, verrouillé par un échange
+     * atomique sans contention : les coeurs ne se disputent plus de ligne
+     * de cache, et les autres threads peuvent vider ce cache quand le pool
+     * est vide.
      * Automatisation : L'Object gère automatiquement le retour au pool.
      * Optimisation : Idéal pour les objets créés/détruits fréquemment (ex:
      * particules dans un jeu, connexions réseau).
@@ -65,39 +378,646 @@ class Pool {
      *     conn2 pointe vers la même connexion que conn1 précédemment
      * }
      * 
+     * Pool vide : par défaut acquire() lève une exception, mais le pool peut
+     * aussi s'agrandir (growWhenEmpty) ou attendre qu'un objet soit libéré
+     * (blockWhenEmpty). try_acquire() ne lève jamais d'exception quand le
+     * pool est vide et retourne un Object vide.
+     * 
+     * Dimensionnement : enableStatistics() active des compteurs (occupation,
+     * pic d'occupation, épuisements, agrandissements...) lus avec
+     * statistics().
+     * 
      * @throws std::runtime_error "Pool is empty" - Quand acquire() est appelé
      * sur un pool vide
      */
     
 private:
-    // Stockage des objets pré-alloués
-    std::vector<std::unique_ptr<TType>> storage;
-    // File des indices disponibles, si un objet est "prété", il est retiré de
-    // la file.
-    std::queue<size_t> available;
+    // Indice sentinelle qui marque la fin de la pile des indices disponibles.
+    static constexpr uint32_t npos = UINT32_MAX;
+    // Nombre maximal de segments : assez pour couvrir les 2^32 indices même
+    // avec un premier segment d'un seul objet.
+    static constexpr size_t maxSegments = 33;
+
+    // Emplacement brut pouvant contenir un TType. Un tableau de Slot a la
+    // même disposition qu'un tableau de TType, mais aucun objet n'y est
+    // construit tant qu'il n'est pas prêté.
+    struct Slot {
+        alignas(TType) unsigned char bytes[sizeof(TType)];
+    };
+
+    // Les objets sont stockés en place dans des segments contigus. Le segment
+    // 0 contient les indices [0, base), le segment k >= 1 les indices
+    // [base * 2^(k-1), base * 2^k). Un segment n'est jamais déplacé une fois
+    // alloué : agrandir le pool n'invalide donc pas les objets déjà prêtés.
+    // next contient l'indice situé sous celui-ci dans sa pile (ou dans son
+    // lot), nextBatch le premier indice du lot situé sous celui-ci dans la
+    // pile des lots. Les liens sont atomiques car un thread peut lire celui
+    // d'un sommet qu'un autre thread vient de retirer (le compare_exchange
+    // échoue alors de toute façon).
+    struct Link {
+        std::atomic<uint32_t> next;
+        std::atomic<uint32_t> nextBatch;
+    };
+
+    struct Segment {
+        std::unique_ptr<Slot[]> slots;
+        std::unique_ptr<Link[]> links;
+    };
+
+    // Cache d'indices libres propre à un thread, utilisé comme une pile.
+    // Quand il est vide, il est rechargé d'un lot depuis les piles partagées ;
+    // quand il est plein, il y renvoie un lot d'un coup. locked est pris par
+    // le thread pour chaque opération, et par un autre thread qui vide le
+    // cache quand le pool semble vide (voir drainMagazines()). Il reste sur
+    // la ligne de cache du thread : le prendre ne coûte qu'un échange sans
+    // contention.
+    static constexpr size_t maxBatchSize = 32;
+    struct alignas(64) Magazine {
+        std::atomic<bool> locked{false};
+        size_t count = 0;
+        uint32_t indices[2 * maxBatchSize];
+
+        bool tryLock() {
+            return !locked.exchange(true, std::memory_order_acquire);
+        }
+
+        void lock() {
+            while (!tryLock()) {
+                std::this_thread::yield();
+            }
+        }
+
+        void unlock() {
+            locked.store(false, std::memory_order_release);
+        }
+    };
+
+    // Compteurs d'un thread, sur leur propre ligne de cache. Seul ce thread
+    // les modifie : un incrément est une simple lecture suivie d'une
+    // écriture, sans instruction atomique verrouillée. Les threads sans
+    // ThreadSlot se partagent un dernier jeu de compteurs, incrémentés avec
+    // fetch_add.
+    struct alignas(64) Counters {
+        std::atomic<uint64_t> acquires{0};
+        std::atomic<uint64_t> releases{0};
+        std::atomic<uint64_t> exhaustions{0};
+        std::atomic<uint64_t> growths{0};
+        std::atomic<uint64_t> casRetries{0};
+    };
+    // Le pic d'occupation est recalculé tous les highWaterMarkPeriod
+    // acquire() d'un même thread.
+    static constexpr uint64_t highWaterMarkPeriod = 1024;
+
+    Segment segments[maxSegments];
+    // base = 1 << baseShift, fixé au premier resize() pour que le premier
+    // segment contienne à lui seul tous les objets demandés.
+    uint32_t baseShift = 0;
+    // Nombre d'objets gérés par le pool (le dernier segment peut être plus
+    // grand).
+    size_t capacity = 0;
+
+    // Sommet de la pile des indices disponibles, si un objet est "prété", il
+    // est retiré de la pile. Les 32 bits de poids faible contiennent l'indice
+    // du sommet, les 32 bits de poids fort un compteur de version incrémenté à
+    // chaque modification : un compare_exchange ne peut donc pas réussir sur
+    // un sommet qui a été retiré puis remis entre-temps (problème ABA).
+    std::atomic<uint64_t> available{pack(npos, 0)};
+    // Pile des lots de batchSize indices renvoyés par les caches des threads,
+    // chaînés par Link::next à l'intérieur d'un lot. Un lot entier est
+    // empilé ou dépilé en un seul compare_exchange.
+    std::atomic<uint64_t> batches{pack(npos, 0)};
+
+    // Caches par thread, indexés par ThreadSlot, créés par leur thread et
+    // lus par les autres pour les vider. nullptr si le cache n'est pas
+    // activé.
+    std::unique_ptr<std::atomic<Magazine*>[]> magazines;
+    size_t batchSize = 0;
+
+    // Comportement quand plus aucun indice n'est disponible. Atomiques :
+    // il peut changer pendant que d'autres threads utilisent le pool. Les
+    // réglages sont écrits avant exhaustion (release), et relus après lui
+    // (acquire) sur le chemin lent.
+    enum class Exhaustion { Throw, Grow, Block };
+    std::atomic<Exhaustion> exhaustion{Exhaustion::Throw};
+    std::atomic<size_t> growthSize{0};
+    std::atomic<std::chrono::nanoseconds> blockTimeout{
+        std::chrono::nanoseconds(0)};
+
+    // Protège l'agrandissement du pool.
+    std::mutex growthMutex;
+    // Attente d'une libération pour Exhaustion::Block. waiters est lu à
+    // chaque libération, le mutex n'est pris que s'il y a des threads en
+    // attente.
+    std::mutex waitMutex;
+    std::condition_variable waitCondition;
+    std::atomic<size_t> waiters{0};
+
+    // Compteurs par thread, indexés par ThreadSlot (le dernier pour les
+    // threads sans ThreadSlot). nullptr si les statistiques ne sont pas
+    // activées.
+    std::unique_ptr<Counters[]> counters;
+    std::atomic<size_t> highWaterMark{0};
+
+    static uint64_t pack(uint32_t index, uint32_t tag) {
+        return (static_cast<uint64_t>(tag) << 32) | index;
+    }
+
+    static uint32_t indexOf(uint64_t head) {
+        return static_cast<uint32_t>(head);
+    }
+
+    static uint32_t tagOf(uint64_t head) {
+        return static_cast<uint32_t>(head >> 32);
+    }
+
+    // Segment contenant l'indice et position de l'indice dans ce segment.
+    size_t segmentOf(uint32_t index) const {
+        size_t width = std::bit_width(index);
+        return width <= baseShift ? 0 : width - baseShift;
+    }
+
+    size_t offsetOf(uint32_t index, size_t segment) const {
+        return segment == 0 ? index : index - (uint32_t(1) << (segment
+                    + baseShift - 1));
+    }
+
+    size_t segmentSize(size_t segment) const {
+        return size_t(1) << (segment == 0 ? baseShift : segment + baseShift
+                - 1);
+    }
+
+    Link& linkAt(uint32_t index) {
+        size_t segment = segmentOf(index);
+        return segments[segment].links[offsetOf(index, segment)];
+    }
+
+    void* slotAt(uint32_t index) {
+        size_t segment = segmentOf(index);
+        return segments[segment].slots[offsetOf(index, segment)].bytes;
+    }
+
+    // Empile top sur stack. bottomLink est le lien qui recevra l'ancien
+    // sommet : celui de top pour un indice seul, celui du dernier indice pour
+    // une chaîne déjà liée.
+    void pushOnto(std::atomic<uint64_t>& stack, uint32_t top,
+            std::atomic<uint32_t>& bottomLink) {
+        uint64_t head = stack.load(std::memory_order_relaxed);
+        uint64_t retries = 0;
+        for (;;) {
+            bottomLink.store(indexOf(head), std::memory_order_relaxed);
+            if (stack.compare_exchange_weak(head, pack(top, tagOf(head) + 1),
+                        std::memory_order_release, std::memory_order_relaxed)) {
+                break;
+            }
+            ++retries;
+        }
+        if (retries) {
+            record(&Counters::casRetries, retries);
+        }
+    }
+
+    // Retire le sommet de stack, chaîné par le lien member. Retourne false si
+    // la pile est vide.
+    bool popFrom(std::atomic<uint64_t>& stack,
+            std::atomic<uint32_t> Link::* member, uint32_t& index) {
+        uint64_t head = stack.load(std::memory_order_acquire);
+        uint64_t retries = 0;
+        bool popped = false;
+        while (indexOf(head) != npos) {
+            uint32_t below = (linkAt(indexOf(head)).*member).load(
+                    std::memory_order_relaxed);
+            if (stack.compare_exchange_weak(head, pack(below, tagOf(head) + 1),
+                        std::memory_order_acquire, std::memory_order_acquire)) {
+                index = indexOf(head);
+                popped = true;
+                break;
+            }
+            ++retries;
+        }
+        if (retries) {
+            record(&Counters::casRetries, retries);
+        }
+        return popped;
+    }
+
+    // Ajoute value au compteur du thread appelant, si les statistiques sont
+    // activées. Retourne la nouvelle valeur de ce compteur. Hors du chemin
+    // rapide : appelé seulement une fois counters testé.
+    [[gnu::noinline]] uint64_t record(std::atomic<uint64_t> Counters::* counter,
+            uint64_t value = 1) {
+        if (!counters) {
+            return 0;
+        }
+        size_t slot = ThreadSlot::current();
+        std::atomic<uint64_t>& local = counters[slot].*counter;
+        if (slot == ThreadSlot::none) {
+            return local.fetch_add(value, std::memory_order_relaxed) + value;
+        }
+        uint64_t updated = local.load(std::memory_order_relaxed) + value;
+        local.store(updated, std::memory_order_relaxed);
+        return updated;
+    }
+
+    // Somme d'un compteur sur tous les threads.
+    uint64_t total(std::atomic<uint64_t> Counters::* counter) const {
+        uint64_t sum = 0;
+        for (size_t slot = 0; slot <= ThreadSlot::maxSlots; ++slot) {
+            sum += (counters[slot].*counter).load(std::memory_order_relaxed);
+        }
+        return sum;
+    }
+
+    // Recalcule le pic d'occupation à partir des compteurs agrégés.
+    size_t sampleHighWaterMark() {
+        uint64_t acquires = total(&Counters::acquires);
+        uint64_t releases = total(&Counters::releases);
+        size_t inUse = acquires > releases ? acquires - releases : 0;
+        size_t peak = highWaterMark.load(std::memory_order_relaxed);
+        while (inUse > peak && !highWaterMark.compare_exchange_weak(peak,
+                    inUse, std::memory_order_relaxed)) {
+        }
+        return inUse;
+    }
+
+    // Compte un acquire() réussi.
+    void recordAcquire() {
+        if (counters && record(&Counters::acquires) % highWaterMarkPeriod
+                == 0) {
+            sampleHighWaterMark();
+        }
+    }
+
+    // Remet un indice au sommet de la pile.
+    void push(uint32_t index) {
+        pushOnto(available, index, linkAt(index).next);
+    }
+
+    // Retire un indice des piles partagées, retourne false si elles sont
+    // vides. Quand il n'y a plus d'indice seul, un lot est découpé : le
+    // premier indice est pris et le reste de la chaîne est empilé d'un coup.
+    bool pop(uint32_t& index) {
+        if (popFrom(available, &Link::next, index)) {
+            return true;
+        }
+        if (!popFrom(batches, &Link::nextBatch, index)) {
+            return false;
+        }
+        uint32_t last = index;
+        for (size_t i = 1; i < batchSize; ++i) {
+            last = linkAt(last).next.load(std::memory_order_relaxed);
+        }
+        if (last != index) {
+            pushOnto(available, linkAt(index).next.load(
+                        std::memory_order_relaxed), linkAt(last).next);
+        }
+        return true;
+    }
+
+    // Cache du thread appelant, nullptr si le cache n'est pas activé ou si le
+    // thread n'a pas de ThreadSlot.
+    Magazine* localMagazine() {
+        if (!magazines) {
+            return nullptr;
+        }
+        size_t slot = ThreadSlot::current();
+        if (slot == ThreadSlot::none) {
+            return nullptr;
+        }
+        Magazine* magazine = magazines[slot].load(std::memory_order_relaxed);
+        if (!magazine) {
+            magazine = new Magazine();
+            magazines[slot].store(magazine, std::memory_order_release);
+        }
+        return magazine;
+    }
+
+    // Recharge un cache vide : un lot complet si possible, sinon jusqu'à
+    // batchSize indices seuls.
+    void refill(Magazine& magazine) {
+        uint32_t index;
+        if (popFrom(batches, &Link::nextBatch, index)) {
+            for (size_t i = 0; i < batchSize; ++i) {
+                magazine.indices[magazine.count++] = index;
+                index = linkAt(index).next.load(std::memory_order_relaxed);
+            }
+            return;
+        }
+        while (magazine.count < batchSize
+                && popFrom(available, &Link::next, index)) {
+            magazine.indices[magazine.count++] = index;
+        }
+    }
+
+    // Renvoie les batchSize indices du haut d'un cache plein, chaînés en un
+    // lot.
+    void flush(Magazine& magazine) {
+        magazine.count -= batchSize;
+        uint32_t* batch = magazine.indices + magazine.count;
+        for (size_t i = 0; i + 1 < batchSize; ++i) {
+            linkAt(batch[i]).next.store(batch[i + 1],
+                    std::memory_order_relaxed);
+        }
+        pushOnto(batches, batch[0], linkAt(batch[0]).nextBatch);
+    }
+
+    // Cache déjà créé du thread appelant, nullptr sinon : le test fait par
+    // les chemins rapides de take() et release().
+    Magazine* existingMagazine() const {
+        if (!magazines) {
+            return nullptr;
+        }
+        size_t slot = ThreadSlot::current();
+        return slot == ThreadSlot::none ? nullptr
+            : magazines[slot].load(std::memory_order_relaxed);
+    }
+
+    // Rend aux piles partagées tous les indices de magazine. Retourne false
+    // s'il était vide.
+    bool drain(Magazine& magazine) {
+        magazine.lock();
+        bool drained = magazine.count > 0;
+        while (magazine.count > 0) {
+            push(magazine.indices[--magazine.count]);
+        }
+        magazine.unlock();
+        if (drained && blocking() && hasWaiters()) {
+            wakeWaiter();
+        }
+        return drained;
+    }
+
+    // Vide les caches de tous les threads quand les piles partagées sont
+    // vides, avant de lever une exception, d'agrandir le pool ou d'attendre.
+    // Retourne true si des indices ont été rendus.
+    [[gnu::noinline]] bool drainMagazines() {
+        if (!magazines) {
+            return false;
+        }
+        bool drained = false;
+        for (size_t slot = 0; slot < ThreadSlot::maxSlots; ++slot) {
+            Magazine* magazine = magazines[slot].load(
+                    std::memory_order_acquire);
+            if (magazine && drain(*magazine)) {
+                drained = true;
+            }
+        }
+        return drained;
+    }
+
+    // Appelé par ThreadSlot à la fin d'un thread : ses indices en cache
+    // retournent aux piles partagées.
+    static void drainExitingThread(void* pool, size_t slot) {
+        Pool& self = *static_cast<Pool*>(pool);
+        Magazine* magazine = self.magazines[slot].load(
+                std::memory_order_relaxed);
+        if (magazine) {
+            self.drain(*magazine);
+        }
+    }
+
+    // Obtient un indice libre, par le cache du thread s'il existe. Le
+    // chemin rapide (un indice dans le cache) reste assez court pour être
+    // inliné dans acquire() : un échange sur la ligne du cache, sans appel.
+    bool take(uint32_t& index) {
+        Magazine* magazine = existingMagazine();
+        if (magazine && magazine->tryLock()) {
+            bool taken = magazine->count > 0;
+            if (taken) {
+                index = magazine->indices[--magazine->count];
+            }
+            magazine->unlock();
+            if (taken) {
+                return true;
+            }
+        }
+        return takeShared(index);
+    }
+
+    // En mode Block, le cache n'est pas rechargé : un indice pris dans les
+    // piles partagées ne doit pas échapper à un thread qui attend.
+    [[gnu::noinline]] bool takeShared(uint32_t& index) {
+        Magazine* magazine = blocking() ? nullptr : localMagazine();
+        if (!magazine || !magazine->tryLock()) {
+            return pop(index);
+        }
+        if (magazine->count == 0) {
+            refill(*magazine);
+        }
+        bool taken = magazine->count > 0;
+        if (taken) {
+            index = magazine->indices[--magazine->count];
+        }
+        magazine->unlock();
+        return taken;
+    }
+
+    // Indique si des threads attendent une libération. Lecture par un
+    // fetch_add(0) plutôt qu'un load : les deux côtés modifient waiters, donc
+    // soit l'incrément de l'attente vient avant et il est vu ici, soit il
+    // vient après et l'attente voit l'empilement qui précède cet appel.
+    bool hasWaiters() {
+        return waiters.fetch_add(0, std::memory_order_acq_rel) != 0;
+    }
+
+    bool blocking() const {
+        return exhaustion.load(std::memory_order_relaxed) == Exhaustion::Block;
+    }
+
+    void wakeWaiter() {
+        {
+            std::lock_guard<std::mutex> lock(waitMutex);
+        }
+        waitCondition.notify_one();
+    }
+
+    // Rend un indice, au cache du thread qui libère l'objet s'il existe. En
+    // mode Block, l'indice va toujours dans la pile partagée : un thread qui
+    // s'apprête à attendre doit pouvoir le prendre.
+    void release(uint32_t index) {
+        Magazine* magazine = existingMagazine();
+        if (magazine && !blocking() && magazine->tryLock()) {
+            bool kept = magazine->count < 2 * batchSize;
+            if (kept) {
+                magazine->indices[magazine->count++] = index;
+            }
+            magazine->unlock();
+            if (kept) {
+                return;
+            }
+        }
+        releaseShared(index);
+    }
+
+    [[gnu::noinline]] void releaseShared(uint32_t index) {
+        Magazine* magazine = blocking() ? nullptr : localMagazine();
+        if (magazine && magazine->tryLock()) {
+            if (magazine->count == 2 * batchSize) {
+                flush(*magazine);
+            }
+            magazine->indices[magazine->count++] = index;
+            magazine->unlock();
+            return;
+        }
+        push(index);
+        if (blocking() && hasWaiters()) {
+            wakeWaiter();
+        }
+    }
+
+    // Ajoute des indices au pool. Doit être appelé avec growthMutex.
+    void grow(size_t numberOfObjectStored) {
+        if (numberOfObjectStored >= npos) {
+            throw std::runtime_error("Pool is too large");
+        }
+        if (numberOfObjectStored <= capacity) {
+            return;
+        }
+        if (capacity == 0 && !segments[0].slots) {
+            baseShift = std::bit_width(std::bit_ceil(numberOfObjectStored))
+                - 1;
+        }
+        uint32_t first = static_cast<uint32_t>(capacity);
+        uint32_t last = static_cast<uint32_t>(numberOfObjectStored - 1);
+        for (size_t segment = 0; segment <= segmentOf(last); ++segment) {
+            if (!segments[segment].slots) {
+                size_t size = segmentSize(segment);
+                segments[segment].slots.reset(new Slot[size]);
+                segments[segment].links.reset(new Link[size]);
+            }
+        }
+        // Les nouveaux indices sont chaînés dans l'ordre de la mémoire puis
+        // empilés d'un coup, pour que les objets soient prêtés dans cet
+        // ordre.
+        for (uint32_t index = first; index < last; ++index) {
+            linkAt(index).next.store(index + 1, std::memory_order_relaxed);
+        }
+        capacity = numberOfObjectStored;
+        pushOnto(available, first, linkAt(last).next);
+    }
+
+    // Agrandit le pool de growthSize objets, sauf si un autre thread vient de
+    // le faire. Retourne false si le pool a atteint sa taille maximale.
+    bool growOnce() {
+        size_t step = growthSize.load(std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(growthMutex);
+        if (indexOf(available.load(std::memory_order_acquire)) != npos
+                || indexOf(batches.load(std::memory_order_acquire)) != npos) {
+            return true;
+        }
+        if (capacity + step >= npos) {
+            return false;
+        }
+        grow(capacity + step);
+        record(&Counters::growths);
+        return true;
+    }
+
+    bool takeGrowing(uint32_t& index) {
+        while (!take(index)) {
+            if (!growOnce()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Attend qu'un objet soit libéré, au plus blockTimeout.
+    bool takeWaiting(uint32_t& index) {
+        auto deadline = std::chrono::steady_clock::now()
+            + blockTimeout.load(std::memory_order_relaxed);
+        std::unique_lock<std::mutex> lock(waitMutex);
+        waiters.fetch_add(1, std::memory_order_acq_rel);
+        bool taken;
+        while (!(taken = take(index))) {
+            if (waitCondition.wait_until(lock, deadline)
+                    == std::cv_status::timeout) {
+                taken = take(index);
+                break;
+            }
+        }
+        waiters.fetch_sub(1, std::memory_order_relaxed);
+        return taken;
+    }
+
+    // Chemin lent d'acquire(), quand le cache et les piles sont vides : les
+    // caches des autres threads sont d'abord vidés. Un pool vide est à son
+    // pic d'occupation, à un objet en cache près.
+    [[gnu::noinline]] bool takeExhausted(uint32_t& index) {
+        if (drainMagazines() && take(index)) {
+            return true;
+        }
+        if (counters) {
+            record(&Counters::exhaustions);
+            sampleHighWaterMark();
+        }
+        switch (exhaustion.load(std::memory_order_acquire)) {
+            case Exhaustion::Grow:
+                return takeGrowing(index);
+            case Exhaustion::Block:
+                return takeWaiting(index);
+            default:
+                return false;
+        }
+    }
+
+    template<typename... TArgs>
+    TType* construct(uint32_t index, TArgs&&... p_args) {
+        // Construction de l'objet dans son emplacement avec les nouveaux
+        // arguments. Si le constructeur échoue, l'indice est rendu au pool.
+        try {
+            return ::new (slotAt(index)) TType(std::forward<TArgs>(p_args)...);
+        } catch (...) {
+            release(index);
+            throw;
+        }
+    }
 
 public:
     // Classe interne qui gère un objet du pool
     class Object {
     private:
         Pool<TType>* pool;
-        size_t index;
+        uint32_t index;
+        TType* object;
         
+        void giveBack() {
+            if (pool) {
+                // Détruit l'objet sans libérer son emplacement, puis le
+                // retourne au pool pour qu'il soit à nouveau available dans la
+                // pile
+                object->~TType();
+                if (pool->counters) {
+                    pool->record(&Counters::releases);
+                }
+                pool->release(index);
+                pool = nullptr;
+            }
+        }
+
     public:
-        // Constructeur avec le pool et l'index de l'objet
-        Object(Pool<TType>* p, size_t i) : pool(p), index(i) {}
+        // Object vide, retourné par try_acquire() quand le pool est vide
+        Object() : pool(nullptr), index(0), object(nullptr) {}
+        // Constructeur avec le pool, l'index de l'objet et l'objet construit
+        // dans son emplacement
+        Object(Pool<TType>* p, uint32_t i, TType* o) : pool(p), index(i),
+            object(o) {}
         // Destructeur
         ~Object() {
-            if (pool) {
-                // Retourne l'objet au pool pour qu'il soit à nouveau available 
-                // dans la file
-                pool->available.push(index);
-            }
+            giveBack();
         }
         
         // Opérateur -> pour accéder à l'objet
         TType* operator->() {
-            return pool->storage[index].get();
+            return object;
+        }
+
+        TType& operator*() {
+            return *object;
+        }
+
+        // Indique si l'Object contient un objet du pool
+        explicit operator bool() const {
+            return pool != nullptr;
         }
         
         // Empêcher la copie car chaque Object doit être unique (un même objet 
@@ -107,42 +1027,257 @@ public:
         
         // Permettre le déplacement pour pouvoir retourner un Object depuis une 
         // fonction
-        Object(Object&& other) noexcept : pool(other.pool), index(other.index) {
+        Object(Object&& other) noexcept : pool(other.pool), index(other.index),
+            object(other.object) {
             other.pool = nullptr;
         }
+
+        // L'objet possédé auparavant est rendu au pool
+        Object& operator=(Object&& other) noexcept {
+            if (this != &other) {
+                giveBack();
+                pool = other.pool;
+                index = other.index;
+                object = other.object;
+                other.pool = nullptr;
+            }
+            return *this;
+        }
     };
 
+    Pool() = default;
+    Pool(const Pool&) = delete;
+    Pool& operator=(const Pool&) = delete;
+
+    ~Pool() {
+        if (magazines) {
+            ThreadSlot::removeExitHook(this);
+            for (size_t slot = 0; slot < ThreadSlot::maxSlots; ++slot) {
+                delete magazines[slot].load(std::memory_order_relaxed);
+            }
+        }
+    }
+
     // La fonction resize permet de pré-allouer un certain nombre d'objets.
+    // Seule la mémoire est réservée : les objets sont construits par
+    // acquire() et détruits à la libération de leur Object. Les indices
+    // tiennent sur 32 bits pour pouvoir être versionnés dans un seul mot
+    // atomique.
     void resize(const size_t& numberOfObjectStored) {
-        storage.reserve(numberOfObjectStored);
-        while (storage.size() < numberOfObjectStored) {
-            storage.push_back(std::make_unique<TType>());
-            available.push(storage.size() - 1);
-        }
+        std::lock_guard<std::mutex> lock(growthMutex);
+        grow(numberOfObjectStored);
+    }
+
+    // Quand le pool est vide, acquire() lève std::runtime_error("Pool is
+    // empty"). C'est le comportement par défaut.
+    void throwWhenEmpty() {
+        exhaustion.store(Exhaustion::Throw, std::memory_order_release);
+    }
+
+    // Quand le pool est vide, acquire() l'agrandit de objectsPerGrowth
+    // objets. Les objets déjà prêtés ne sont pas déplacés.
+    void growWhenEmpty(size_t objectsPerGrowth) {
+        if (objectsPerGrowth == 0) {
+            throw std::runtime_error("Invalid growth size");
+        }
+        growthSize.store(objectsPerGrowth, std::memory_order_relaxed);
+        exhaustion.store(Exhaustion::Grow, std::memory_order_release);
+    }
+
+    // Quand le pool est vide, acquire() attend qu'un objet soit libéré, au
+    // plus timeout, avant de lever std::runtime_error("Pool is empty").
+    void blockWhenEmpty(std::chrono::nanoseconds timeout) {
+        blockTimeout.store(timeout, std::memory_order_relaxed);
+        exhaustion.store(Exhaustion::Block, std::memory_order_release);
+    }
+
+    /**
+     * @brief Active un cache d'indices libres par thread, pour les pools
+     * partagés par de nombreux coeurs. Chaque thread garde jusqu'à
+     * 2 * batchSize indices pour lui et n'accède aux piles partagées qu'une
+     * fois tous les batchSize acquire() ou libérations.
+     * 
+     * Quand les piles partagées sont vides, acquire() vide les caches de
+     * tous les threads avant de lever une exception, d'agrandir le pool ou
+     * d'attendre : un objet libre n'est jamais perdu dans le cache d'un
+     * autre thread, mais ce chemin parcourt tous les caches. Le cache d'un
+     * thread qui se termine est rendu aux piles partagées, et un thread qui
+     * cesse d'utiliser le pool peut rendre le sien avec flushThreadCache().
+     * En mode Block (blockWhenEmpty()), les libérations ne passent pas par
+     * le cache, pour réveiller les threads qui attendent.
+     * 
+     * Doit être appelé avant de partager le pool entre plusieurs threads.
+     * @throws std::runtime_error "Invalid batch size" - Si batchSize vaut 0
+     * ou dépasse 32
+     * @throws std::runtime_error "Thread cache already enabled" - Si le cache
+     * est déjà activé
+     */
+    void enableThreadCache(size_t p_batchSize = 16) {
+        if (p_batchSize == 0 || p_batchSize > maxBatchSize) {
+            throw std::runtime_error("Invalid batch size");
+        }
+        if (magazines) {
+            throw std::runtime_error("Thread cache already enabled");
+        }
+        magazines.reset(new std::atomic<Magazine*>[ThreadSlot::maxSlots]());
+        batchSize = p_batchSize;
+        ThreadSlot::addExitHook(drainExitingThread, this);
+    }
+
+    // Rend aux piles partagées les indices du cache du thread appelant.
+    void flushThreadCache() {
+        if (Magazine* magazine = existingMagazine()) {
+            drain(*magazine);
+        }
     }
 
     /**
      * @brief Cette fonction permet d'obtenir un objet du pool en le
-     * construisant avec les arguments fournis.
+     * construisant en place avec les arguments fournis, sans allocation.
+     * Si le pool est vide, applique le comportement choisi par
+     * throwWhenEmpty(), growWhenEmpty() ou blockWhenEmpty().
      * @throws std::runtime_error "Pool is empty" - Si plus d'objets disponibles
      */
 
     template<typename... TArgs>
     Object acquire(TArgs&&... p_args) {
-        if (available.empty()) {
-            throw std::runtime_error("Pool is empty");
+        LIBFTPP_TRACE_SCOPE_VALUE("Pool::acquire", "pool", this);
+        uint32_t index;
+        if (!take(index)) [[unlikely]] {
+            if (!takeExhausted(index)) {
+                throw std::runtime_error("Pool is empty");
+            }
         }
-        
-        size_t index = available.front();
-        available.pop();
-        
-        // Reconstruction de l'objet avec les nouveaux arguments
-        storage[index] = std::make_unique<TType>(std::forward<TArgs>(p_args)...);
-        
-        return Object(this, index);
+        Object result(this, index, construct(index,
+                    std::forward<TArgs>(p_args)...));
+        recordAcquire();
+        return result;
+    }
+
+    // Comme acquire(), mais retourne un Object vide au lieu de lever une
+    // exception quand le pool est vide. Avec growWhenEmpty() le pool est
+    // agrandi ; try_acquire() n'attend jamais.
+    template<typename... TArgs>
+    Object try_acquire(TArgs&&... p_args) {
+        LIBFTPP_TRACE_SCOPE_VALUE("Pool::acquire", "pool", this);
+        uint32_t index;
+        if (!take(index) && !(drainMagazines() && take(index))) {
+            if (counters) {
+                record(&Counters::exhaustions);
+                sampleHighWaterMark();
+            }
+            if (exhaustion.load(std::memory_order_acquire) != Exhaustion::Grow
+                    || !takeGrowing(index)) {
+                return Object();
+            }
+        }
+        Object result(this, index, construct(index,
+                    std::forward<TArgs>(p_args)...));
+        recordAcquire();
+        return result;
+    }
+
+    // Statistiques agrégées sur tous les threads, retournées par
+    // statistics(). inUse et highWaterMark sont calculés à partir des
+    // compteurs : highWaterMark est recalculé à chaque épuisement, à chaque
+    // lecture et périodiquement par acquire(), c'est donc une borne basse
+    // du vrai pic.
+    struct Statistics {
+        size_t capacity;
+        size_t inUse;
+        size_t highWaterMark;
+        uint64_t acquires;
+        uint64_t releases;
+        uint64_t exhaustions;
+        uint64_t growths;
+        uint64_t casRetries;
+    };
+
+    // Active les compteurs. Chaque thread incrémente ses propres compteurs,
+    // sans contention ; ils ne sont additionnés qu'à la lecture. Doit être
+    // appelé avant de partager le pool entre plusieurs threads.
+    void enableStatistics() {
+        if (!counters) {
+            counters.reset(new Counters[ThreadSlot::maxSlots + 1]);
+        }
+    }
+
+    // @throws std::runtime_error "Statistics not enabled" - Si
+    // enableStatistics() n'a pas été appelé
+    Statistics statistics() {
+        if (!counters) {
+            throw std::runtime_error("Statistics not enabled");
+        }
+        Statistics result;
+        {
+            std::lock_guard<std::mutex> lock(growthMutex);
+            result.capacity = capacity;
+        }
+        result.acquires = total(&Counters::acquires);
+        result.releases = total(&Counters::releases);
+        result.exhaustions = total(&Counters::exhaustions);
+        result.growths = total(&Counters::growths);
+        result.casRetries = total(&Counters::casRetries);
+        result.inUse = sampleHighWaterMark();
+        result.highWaterMark = highWaterMark.load(std::memory_order_relaxed);
+        return result;
     }
 };
 
+// DATABUFFER_FIELDS(Type, champ1, champ2...) se place dans la définition
+// d'une struct ou d'une class pour décrire les champs que DataBuffer doit
+// sérialiser, dans cet ordre :
+//
+//     struct Player {
+//         int id;
+//         float x, y;
+//         std::string name;
+//         DATABUFFER_FIELDS(Player, id, x, y, name)
+//     };
+//
+// Chaque champ est écrit par son propre opérateur. La liste est connue à la
+// compilation : les champs trivialement copiables qui se suivent en mémoire
+// sont copiés en un seul memcpy, et une struct sans padding en un seul
+// memcpy pour toute la struct.
+#define DATABUFFER_FIELDS(Type, ...) \
+    static constexpr auto dataBufferFields() { \
+        return std::make_tuple( \
+            DATABUFFER_FOR_EACH(DATABUFFER_MEMBER, Type, __VA_ARGS__)); \
+    } \
+    template<typename TSelf = Type> \
+    static constexpr auto dataBufferOffsets() { \
+        return std::to_array<size_t>( \
+            {DATABUFFER_FOR_EACH(DATABUFFER_OFFSET, TSelf, __VA_ARGS__)}); \
+    }
+
+#define DATABUFFER_MEMBER(Type, field) &Type::field
+#define DATABUFFER_OFFSET(Type, field) offsetof(Type, field)
+
+// Applique macro(Type, champ) à chaque champ (jusqu'à 64), résultats séparés
+// par des virgules.
+#define DATABUFFER_FOR_EACH(macro, Type, ...) \
+    __VA_OPT__(DATABUFFER_EXPAND(DATABUFFER_FOR_EACH_STEP(macro, Type, \
+        __VA_ARGS__)))
+#define DATABUFFER_FOR_EACH_STEP(macro, Type, field, ...) \
+    macro(Type, field) __VA_OPT__(, DATABUFFER_FOR_EACH_AGAIN \
+        DATABUFFER_PARENS (macro, Type, __VA_ARGS__))
+#define DATABUFFER_FOR_EACH_AGAIN() DATABUFFER_FOR_EACH_STEP
+#define DATABUFFER_PARENS ()
+#define DATABUFFER_EXPAND(...) \
+    DATABUFFER_EXPAND3(DATABUFFER_EXPAND3(DATABUFFER_EXPAND3( \
+        DATABUFFER_EXPAND3(__VA_ARGS__))))
+#define DATABUFFER_EXPAND3(...) \
+    DATABUFFER_EXPAND2(DATABUFFER_EXPAND2(DATABUFFER_EXPAND2( \
+        DATABUFFER_EXPAND2(__VA_ARGS__))))
+#define DATABUFFER_EXPAND2(...) \
+    DATABUFFER_EXPAND1(DATABUFFER_EXPAND1(DATABUFFER_EXPAND1( \
+        DATABUFFER_EXPAND1(__VA_ARGS__))))
+#define DATABUFFER_EXPAND1(...) __VA_ARGS__
+
+// Types décrits par DATABUFFER_FIELDS.
+template<typename T>
+concept DataBufferDescribed = requires { T::dataBufferFields(); };
+
 class DataBuffer {
     /** @brief Cette class permet de créer un format de sérialisation pour 
      * transférer des objets complexes. On peut s'en servir pour la
@@ -162,53 +1297,2165 @@ class DataBuffer {
      * L'avantage est l'efficacité en termes de taille de données et de
      * performance par rapport à des formats texte comme JSON.
      * 
+     * Lecture : les opérateurs >> avancent une position de lecture, sans
+     * déplacer les octets restants. rewind() permet de relire le buffer
+     * depuis le début, compact() libère la place des octets déjà lus et
+     * clear() vide le buffer. view() donne un DataBuffer en lecture seule sur
+     * les octets non lus, sans les copier, et wrap() fait de même sur de la
+     * mémoire externe. Extraire un std::string_view ou un
+     * std::span<const std::byte> ne copie pas non plus les octets.
+     * 
+     * Mémoire : les 128 premiers octets sont stockés dans l'objet lui-même,
+     * sans allocation. Au-delà, la capacité double à chaque agrandissement
+     * et reserve() permet d'allouer une seule fois à l'avance.
+     * 
+     * Format compact : avec setEncoding(Encoding::Compact), les entiers (et
+     * les longueurs des strings) sont écrits en varint LEB128, après un
+     * encodage zigzag pour les entiers signés. Une petite valeur n'occupe
+     * qu'un octet. Les deux programmes doivent utiliser le même encodage.
+     * 
+     * Conteneurs : std::vector, std::array, std::span, std::map et
+     * std::optional ont leurs propres opérateurs. Un vector ou un span est
+     * écrit comme son nombre d'éléments suivi des éléments (un span se relit
+     * dans un vector), un array sans son nombre d'éléments, une map comme un
+     * nombre de paires suivi des clés et valeurs, un optional comme un bool
+     * suivi de la valeur éventuelle. Les éléments trivialement copiables sont
+     * copiés en un seul memcpy ; les autres passent par leur propre
+     * opérateur.
+     * 
+     * Chunks : useChunks() répartit les octets dans des chunks de taille
+     * fixe obtenus d'un Pool, pour les très gros buffers qui ne doivent
+     * jamais être recopiés en grandissant.
+     * 
+     * Sockets : sendTo() et receiveFrom() échangent les octets avec un fd
+     * par writev() et readv(), sans copie intermédiaire, et iovecs() les
+     * expose pour d'autres appels système.
+     * 
+     * Ordre des octets : avec setByteOrder(ByteOrder::Little), les nombres
+     * sont écrits en little-endian, pour échanger des données entre
+     * architectures.
+     * 
+     * Compression : compress() et decompress() compressent les octets
+     * dans un format rapide de type LZ4.
+     * 
+     * Fichiers : saveToFile() écrit le buffer avec un en-tête de version et
+     * de contrôle, mapFile() le relit par mmap() sans tout charger.
+     * 
+     * Structures : une struct décrite par DATABUFFER_FIELDS est écrite champ
+     * par champ, sans son padding. Les autres types sont copiés octet par
+     * octet et doivent être trivialement copiables (vérifié à la
+     * compilation).
+     * 
      * @throws std::runtime_error "Buffer underflow" - Si buffer trop petit
+     * @throws std::runtime_error "Buffer is read-only" - Si on écrit dans une
+     * vue
+     * @throws std::runtime_error "Invalid varint" - Si un varint est trop
+     * long pour le type lu
+     * @throws std::runtime_error "Buffer is chunked" - Si on demande data()
+     * d'un buffer en chunks
      */
+public:
+    // Fixed écrit les entiers sur sizeof(T) octets, Compact en varint.
+    enum class Encoding { Fixed, Compact };
+
+    // Host écrit les nombres dans l'ordre des octets de la machine, Little
+    // toujours en little-endian, lisible sur toutes les architectures.
+    enum class ByteOrder { Host, Little };
+
+    // Skip ne lit rien d'avance dans mapFile() ; Verify relit tout le
+    // fichier pour contrôler sa somme.
+    enum class Checksum { Skip, Verify };
+
+    // Bloc de mémoire d'un buffer en chunks. Le constructeur vide évite de
+    // mettre à zéro les octets à chaque acquire().
+    struct Chunk {
+        static constexpr size_t size = 64 * 1024;
+        char bytes[size];
+
+        Chunk() {}
+    };
+
+    using ChunkPool = Pool<Chunk>;
+
+    // Taille décompressée maximale acceptée par défaut par decompress() :
+    // des octets corrompus ne peuvent pas faire réserver plus de mémoire.
+    static constexpr uint64_t maxDecompressedSize = uint64_t(1) << 30;
+
 private:
-    std::vector<char> buffer;
+    // Les petits buffers (messages de contrôle, petits snapshots) tiennent
+    // dans inlineBytes, sans allocation.
+    static constexpr size_t inlineCapacity = 128;
 
-public:
-    // Opérateur pour sérialiser (transformer en binaire) des données dans le 
-    // buffer.
+    // Octets possédés par le buffer : inlineBytes tant qu'ils y tiennent,
+    // puis heapBytes. bytes vaut nullptr (et capacity 0) pour une vue.
+    char inlineBytes[inlineCapacity];
+    std::unique_ptr<char[]> heapBytes;
+    char* bytes = inlineBytes;
+    size_t capacity = inlineCapacity;
+    // Fenêtre de lecture : les octets lisibles sont [readData, readData +
+    // readSize), ceux avant readPos sont déjà lus. readData vaut bytes, ou
+    // pointe dans les octets d'un autre DataBuffer pour une vue.
+    const char* readData = inlineBytes;
+    size_t readSize = 0;
+    size_t readPos = 0;
+    Encoding encoding = Encoding::Fixed;
+    ByteOrder byteOrder = ByteOrder::Host;
+
+    // Sur une machine little-endian, ByteOrder::Little ne change rien et le
+    // code de conversion n'est même pas compilé.
+    static constexpr bool bigEndianHost
+        = std::endian::native == std::endian::big;
+
+    // Stockage en chunks (useChunks()). owner est vide pour une vue.
+    struct ChunkRef {
+        ChunkPool::Object owner;
+        const char* data;
+        size_t size;
+    };
+    // readSize et readPos comptent alors les octets de tous les chunks, et
+    // la lecture en est à l'octet readOffset du chunk readChunk. chunkPool
+    // est nul pour une vue.
+    bool chunked = false;
+    ChunkPool* chunkPool = nullptr;
+    std::vector<ChunkRef> chunks;
+    size_t readChunk = 0;
+    size_t readOffset = 0;
+    std::vector<char> scratch;
+    // Fichier mappé par mapFile(), partagé avec les copies et les vues, et
+    // démappé avec le dernier d'entre eux.
+    std::shared_ptr<const void> mapping;
+    // Les octets sont le résultat de compress().
+    bool compressed = false;
+
+    // En-tête des fichiers écrits par saveToFile(), suivi des octets. Les
+    // champs sont en little-endian ; byteOrder indique l'ordre des octets
+    // qui suivent (0 pour little-endian, 1 pour big-endian).
+    struct FileHeader {
+        char magic[8];
+        uint32_t version;
+        uint8_t encoding;
+        uint8_t byteOrder;
+        uint8_t compressed;
+        uint8_t reserved;
+        uint64_t size;
+        uint64_t checksum;
+    };
+    static constexpr char fileMagic[8] = {'F', 'T', 'P', 'P', 'D', 'B', 'U',
+        'F'};
+    static constexpr uint32_t fileVersion = 1;
+
+    // Un varint de 64 bits occupe au plus 10 octets.
+    static constexpr size_t maxVarintSize = 10;
+
+    // Nombre de blocs passés à chaque appel de writev() ou readv().
+    static constexpr size_t maxIovecs = 64;
+
+    // Types encodés en varint avec Encoding::Compact : entiers et enums de
+    // plus d'un octet.
     template<typename T>
-    DataBuffer& operator<<(const T& data) {
-        size_t currentSize = buffer.size();
-        buffer.resize(currentSize + sizeof(T));
-        std::memcpy(buffer.data() + currentSize, &data, sizeof(T));
-        return *this;
+    static constexpr bool isVarint() {
+        if constexpr (std::is_enum_v<T>) {
+            return sizeof(T) > 1;
+        } else {
+            return std::is_integral_v<T> && !std::is_same_v<T, bool>
+                && sizeof(T) > 1;
+        }
     }
 
-    // Opérateur pour désérialiser des données depuis le buffer.
     template<typename T>
-    DataBuffer& operator>>(T& data) {
-        if (buffer.size() < sizeof(T)) {
+    static uint64_t toVarint(const T& data) {
+        if constexpr (std::is_enum_v<T>) {
+            return toVarint(static_cast<std::underlying_type_t<T>>(data));
+        } else if constexpr (std::is_signed_v<T>) {
+            // zigzag : 0, -1, 1, -2... deviennent 0, 1, 2, 3...
+            int64_t value = data;
+            return (static_cast<uint64_t>(value) << 1)
+                ^ static_cast<uint64_t>(value >> 63);
+        } else {
+            return data;
+        }
+    }
+
+    template<typename T>
+    static T fromVarint(uint64_t value) {
+        if constexpr (std::is_enum_v<T>) {
+            return static_cast<T>(fromVarint<std::underlying_type_t<T>>(value));
+        } else if constexpr (std::is_signed_v<T>) {
+            int64_t decoded = static_cast<int64_t>(value >> 1)
+                ^ -static_cast<int64_t>(value & 1);
+            if (decoded < std::numeric_limits<T>::min()
+                    || decoded > std::numeric_limits<T>::max()) {
+                throw std::runtime_error("Invalid varint");
+            }
+            return static_cast<T>(decoded);
+        } else {
+            if (value > std::numeric_limits<T>::max()) {
+                throw std::runtime_error("Invalid varint");
+            }
+            return static_cast<T>(value);
+        }
+    }
+
+    // Types trivialement copiables qui ont pourtant leur propre format : les
+    // copier octet par octet écrirait autre chose (ou des adresses).
+    template<typename T>
+    struct HasOwnFormat : std::false_type {};
+    template<typename T>
+    struct HasOwnFormat<std::optional<T>> : std::true_type {};
+    template<typename T, typename TTraits>
+    struct HasOwnFormat<std::basic_string_view<T, TTraits>>
+        : std::true_type {};
+    template<typename T, size_t Extent>
+    struct HasOwnFormat<std::span<T, Extent>> : std::true_type {};
+
+    template<typename T>
+    struct ArrayElement {
+        using type = void;
+    };
+    template<typename T, size_t N>
+    struct ArrayElement<std::array<T, N>> {
+        using type = T;
+    };
+
+    // Format des écritures : encodage compact ou non, et conversion ou non
+    // des nombres en little-endian. Passé en paramètre de template pour que
+    // chaque combinaison ait son propre code.
+    struct Format {
+        bool compact;
+        bool swap;
+    };
+
+    template<size_t TWidth>
+    using Word = std::conditional_t<TWidth == 2, uint16_t,
+          std::conditional_t<TWidth == 4, uint32_t, uint64_t>>;
+
+    // Nombres dont les octets sont inversés pour ByteOrder::Little sur une
+    // machine big-endian.
+    template<typename T>
+    static constexpr bool isSwappable() {
+        return (std::is_arithmetic_v<T> || std::is_enum_v<T>)
+            && (sizeof(T) == 2 || sizeof(T) == 4 || sizeof(T) == 8);
+    }
+
+    template<typename T>
+    static T swapValue(T value) {
+        return std::bit_cast<T>(std::byteswap(
+                    std::bit_cast<Word<sizeof(T)>>(value)));
+    }
+
+    // Inverse les octets de count nombres de TWidth octets, 16 octets à la
+    // fois avec NEON. Seule une machine big-endian convertit : il n'y a donc
+    // pas de version SSSE3 ou AVX2, les processeurs x86 étant tous
+    // little-endian.
+    template<size_t TWidth>
+    static void swapInPlace(char* data, size_t count) {
+        size_t i = 0;
+#if defined(__ARM_NEON)
+        for (; i + 16 / TWidth <= count; i += 16 / TWidth) {
+            uint8_t* lane = reinterpret_cast<uint8_t*>(data + i * TWidth);
+            uint8x16_t block = vld1q_u8(lane);
+            if constexpr (TWidth == 2) {
+                block = vrev16q_u8(block);
+            } else if constexpr (TWidth == 4) {
+                block = vrev32q_u8(block);
+            } else {
+                block = vrev64q_u8(block);
+            }
+            vst1q_u8(lane, block);
+        }
+#endif
+        for (; i < count; ++i) {
+            Word<TWidth> word;
+            std::memcpy(&word, data + i * TWidth, TWidth);
+            word = std::byteswap(word);
+            std::memcpy(data + i * TWidth, &word, TWidth);
+        }
+    }
+
+    bool swapping() const {
+        if constexpr (bigEndianHost) {
+            return byteOrder == ByteOrder::Little;
+        } else {
+            return false;
+        }
+    }
+
+    // Appelle function.template operator()<Format>() avec le format courant,
+    // pour choisir à l'exécution parmi les versions compilées. Les versions
+    // avec conversion n'existent que sur une machine big-endian.
+    template<typename TFunction>
+    auto withFormat(TFunction&& function) const {
+        bool compact = encoding == Encoding::Compact;
+        if constexpr (bigEndianHost) {
+            if (byteOrder == ByteOrder::Little) {
+                return compact
+                    ? function.template operator()<Format{true, true}>()
+                    : function.template operator()<Format{false, true}>();
+            }
+        }
+        return compact ? function.template operator()<Format{true, false}>()
+            : function.template operator()<Format{false, false}>();
+    }
+
+    // Indique si écrire un T revient à copier ses sizeof(T) octets, dans le
+    // format TFormat.
+    template<typename T, Format TFormat>
+    static constexpr bool isRaw() {
+        if constexpr (std::is_array_v<T>) {
+            return isRaw<std::remove_all_extents_t<T>, TFormat>();
+        } else if constexpr (!std::is_void_v<typename ArrayElement<T>::type>) {
+            return isRaw<typename ArrayElement<T>::type, TFormat>();
+        } else if constexpr (DataBufferDescribed<T>) {
+            return fieldPlan<T, TFormat>.isRaw;
+        } else if constexpr (HasOwnFormat<T>::value || std::is_pointer_v<T>
+                || (TFormat.compact && isVarint<T>())
+                || (TFormat.swap && isSwappable<T>())) {
+            return false;
+        } else {
+            return std::is_trivially_copyable_v<T>;
+        }
+    }
+
+    // Plan de sérialisation d'un type décrit par DATABUFFER_FIELDS, calculé
+    // à la compilation. Le champ i commence une suite de champs copiée en un
+    // seul memcpy de runSize[i] octets depuis offsets[i] si runSize[i] > 0,
+    // il fait partie de la suite d'un champ précédent si inRun[i], sinon il
+    // passe par son propre opérateur.
+    template<typename T, Format TFormat>
+    struct FieldPlan {
+        static constexpr auto fields = T::dataBufferFields();
+        static constexpr size_t count = std::tuple_size_v<decltype(fields)>;
+
+        std::array<size_t, count> offsets{};
+        std::array<size_t, count> runSize{};
+        std::array<bool, count> inRun{};
+        // Tout le type est copié en un seul memcpy.
+        bool isRaw = false;
+    };
+
+    template<typename TMember, typename TClass>
+    static constexpr size_t memberSize(TMember TClass::*) {
+        return sizeof(TMember);
+    }
+
+    template<Format TFormat, typename TMember, typename TClass>
+    static constexpr bool memberIsRaw(TMember TClass::*) {
+        return isRaw<TMember, TFormat>();
+    }
+
+    // Les offsets ne sont connus (par offsetof) que pour un type
+    // standard-layout ; les autres champs passent un par un.
+    template<typename T, Format TFormat>
+    static constexpr FieldPlan<T, TFormat> makeFieldPlan() {
+        using Plan = FieldPlan<T, TFormat>;
+        Plan plan;
+        if constexpr (std::is_standard_layout_v<T>) {
+            constexpr std::array<size_t, Plan::count> offsets
+                = T::template dataBufferOffsets<T>();
+            constexpr auto sizes = std::apply([](auto... members) {
+                return std::array<size_t, sizeof...(members)>{
+                    memberSize(members)...};
+            }, Plan::fields);
+            constexpr auto raw = std::apply([](auto... members) {
+                return std::array<bool, sizeof...(members)>{
+                    memberIsRaw<TFormat>(members)...};
+            }, Plan::fields);
+            size_t run = Plan::count;
+            for (size_t i = 0; i < Plan::count; ++i) {
+                plan.offsets[i] = offsets[i];
+                if (!raw[i]) {
+                    run = Plan::count;
+                } else if (run < Plan::count
+                        && offsets[i] == offsets[run] + plan.runSize[run]) {
+                    plan.runSize[run] += sizes[i];
+                    plan.inRun[i] = true;
+                } else {
+                    run = i;
+                    plan.runSize[i] = sizes[i];
+                }
+            }
+            plan.isRaw = std::is_trivially_copyable_v<T> && Plan::count > 0
+                && offsets[0] == 0 && plan.runSize[0] == sizeof(T);
+        }
+        return plan;
+    }
+
+    template<typename T, Format TFormat>
+    static constexpr FieldPlan<T, TFormat> fieldPlan
+        = makeFieldPlan<T, TFormat>();
+
+    template<typename T, Format TFormat, size_t... I>
+    void appendFields(const T& data, std::index_sequence<I...>) {
+        (appendField<T, TFormat, I>(data), ...);
+    }
+
+    template<typename T, Format TFormat, size_t I>
+    void appendField(const T& data) {
+        constexpr const FieldPlan<T, TFormat>& plan = fieldPlan<T, TFormat>;
+        if constexpr (plan.runSize[I] > 0) {
+            appendBytes(reinterpret_cast<const char*>(&data) + plan.offsets[I],
+                    plan.runSize[I]);
+        } else if constexpr (!plan.inRun[I]) {
+            *this << data.*std::get<I>(FieldPlan<T, TFormat>::fields);
+        }
+    }
+
+    template<typename T, Format TFormat, size_t... I>
+    void consumeFields(T& data, std::index_sequence<I...>) {
+        (consumeField<T, TFormat, I>(data), ...);
+    }
+
+    template<typename T, Format TFormat, size_t I>
+    void consumeField(T& data) {
+        constexpr const FieldPlan<T, TFormat>& plan = fieldPlan<T, TFormat>;
+        if constexpr (plan.runSize[I] > 0) {
+            consumeBytes(reinterpret_cast<char*>(&data) + plan.offsets[I],
+                    plan.runSize[I]);
+        } else if constexpr (!plan.inRun[I]) {
+            *this >> data.*std::get<I>(FieldPlan<T, TFormat>::fields);
+        }
+    }
+
+    // Indique si count éléments de type T peuvent être copiés en un seul
+    // memcpy : le résultat doit être identique à celui de l'écriture des
+    // éléments un par un.
+    template<typename T>
+    bool isBulk() const {
+        if constexpr (std::is_same_v<T, bool>) {
+            return false;
+        } else {
+            return withFormat([]<Format TFormat>() {
+                return isRaw<T, TFormat>();
+            });
+        }
+    }
+
+    // Indique si count nombres de type T peuvent être copiés en bloc puis
+    // convertis d'un coup en little-endian.
+    template<typename T>
+    bool isSwappedBulk() const {
+        if constexpr (isSwappable<T>()) {
+            return swapping() && !(encoding == Encoding::Compact
+                    && isVarint<T>());
+        } else {
+            return false;
+        }
+    }
+
+    // Les nombres sont convertis par blocs dans un tampon local, quel que
+    // soit le stockage du buffer.
+    template<typename T>
+    void appendSwapped(const T* data, size_t count) {
+        constexpr size_t blockSize = 4096 / sizeof(T);
+        alignas(16) char block[blockSize * sizeof(T)];
+        for (size_t first = 0; first < count; first += blockSize) {
+            size_t length = std::min(blockSize, count - first);
+            std::memcpy(block, data + first, length * sizeof(T));
+            swapInPlace<sizeof(T)>(block, length);
+            appendBytes(block, length * sizeof(T));
+        }
+    }
+
+    template<typename T>
+    void appendRange(const T* data, size_t count) {
+        if constexpr (std::is_trivially_copyable_v<T>) {
+            if (isBulk<T>()) {
+                if (count > 0) {
+                    appendBytes(data, count * sizeof(T));
+                }
+                return;
+            }
+        }
+        if constexpr (bigEndianHost && isSwappable<T>()) {
+            if (isSwappedBulk<T>()) {
+                appendSwapped(data, count);
+                return;
+            }
+        }
+        for (size_t i = 0; i < count; ++i) {
+            *this << data[i];
+        }
+    }
+
+    template<typename T>
+    void consumeRange(T* data, size_t count) {
+        if constexpr (std::is_trivially_copyable_v<T>) {
+            if (isBulk<T>()) {
+                if (count > remaining() / sizeof(T)) {
+                    throw std::runtime_error("Buffer underflow");
+                }
+                if (count > 0) {
+                    consumeBytes(data, count * sizeof(T));
+                }
+                return;
+            }
+        }
+        if constexpr (bigEndianHost && isSwappable<T>()) {
+            if (isSwappedBulk<T>()) {
+                if (count > remaining() / sizeof(T)) {
+                    throw std::runtime_error("Buffer underflow");
+                }
+                consumeBytes(data, count * sizeof(T));
+                swapInPlace<sizeof(T)>(reinterpret_cast<char*>(data), count);
+                return;
+            }
+        }
+        for (size_t i = 0; i < count; ++i) {
+            *this >> data[i];
+        }
+    }
+
+    // Lit un nombre d'éléments, en refusant d'emblée un nombre plus grand que
+    // les octets restants (chaque élément occupe au moins un octet) pour ne
+    // pas réserver une mémoire démesurée sur des données corrompues.
+    size_t consumeCount() {
+        size_t count;
+        *this >> count;
+        if (count > remaining()) {
             throw std::runtime_error("Buffer underflow");
         }
-        std::memcpy(&data, buffer.data(), sizeof(T));
-        buffer.erase(buffer.begin(), buffer.begin() + sizeof(T));
-        return *this;
+        return count;
     }
 
-    // Surcharge d'opérateurs << et >> pour les strings (car leurs tailles sont 
-    // variables).
-    DataBuffer& operator<<(const std::string& str) {
-        size_t len = str.length();
-        *this << len;
-        size_t currentSize = buffer.size();
-        buffer.resize(currentSize + len);
-        std::memcpy(buffer.data() + currentSize, str.data(), len);
-        return *this;
+    // Écrit value en varint à destination, retourne le nombre d'octets.
+    static size_t encodeVarint(uint64_t value, unsigned char* destination) {
+        unsigned char* cursor = destination;
+        while (value >= 0x80) {
+            *cursor++ = static_cast<unsigned char>(value | 0x80);
+            value >>= 7;
+        }
+        *cursor++ = static_cast<unsigned char>(value);
+        return static_cast<size_t>(cursor - destination);
     }
-    
-    DataBuffer& operator>>(std::string& str) {
-        size_t len;
-        *this >> len;
-        if (buffer.size() < len) {
+
+    void appendVarint(uint64_t value) {
+        if (chunked) {
+            unsigned char encoded[maxVarintSize];
+            appendBytes(encoded, encodeVarint(value, encoded));
+            return;
+        }
+        if (readSize + maxVarintSize > capacity) {
+            reallocate(readSize + maxVarintSize);
+        }
+        readSize += encodeVarint(value,
+                reinterpret_cast<unsigned char*>(bytes + readSize));
+    }
+
+    // Regroupe les 7 bits utiles de chacun des 8 octets d'un varint.
+    static uint64_t packVarintGroups(uint64_t word) {
+#if defined(__BMI2__)
+        return _pext_u64(word, 0x7f7f7f7f7f7f7f7fULL);
+#else
+        word = ((word & 0x7f007f007f007f00ULL) >> 1)
+            | (word & 0x007f007f007f007fULL);
+        word = ((word & 0x3fff00003fff0000ULL) >> 2)
+            | (word & 0x00003fff00003fffULL);
+        return ((word & 0x0fffffff00000000ULL) >> 4)
+            | (word & 0x000000000fffffffULL);
+#endif
+    }
+
+    // Décode un varint parmi les available octets de source et retourne sa
+    // longueur, ou 0 s'il est tronqué. Quand 8 octets sont lisibles, un
+    // varint de 8 octets au plus est décodé sans boucle : le premier octet
+    // sans bit de continuation donne la longueur, puis les groupes de 7 bits
+    // sont regroupés d'un coup.
+    static size_t decodeVarint(const char* data, size_t available,
+            uint64_t& value) {
+        const unsigned char* source = reinterpret_cast<const unsigned char*>(
+                data);
+        if (available >= 8) {
+            uint64_t word;
+            std::memcpy(&word, source, 8);
+            if constexpr (std::endian::native == std::endian::big) {
+                word = std::byteswap(word);
+            }
+            uint64_t stops = ~word & 0x8080808080808080ULL;
+            if (stops != 0) {
+                size_t length = (std::countr_zero(stops) >> 3) + 1;
+                if (length < 8) {
+                    word &= (uint64_t(1) << (length * 8)) - 1;
+                }
+                value = packVarintGroups(word);
+                return length;
+            }
+        }
+        value = 0;
+        size_t length = 0;
+        for (unsigned shift = 0; shift < 64; shift += 7) {
+            if (length >= available) {
+                return 0;
+            }
+            unsigned char byte = source[length++];
+            if (shift == 63 && byte > 1) {
+                break;
+            }
+            value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+                return length;
+            }
+        }
+        throw std::runtime_error("Invalid varint");
+    }
+
+    uint64_t consumeVarint() {
+        if (chunked) {
+            return consumeChunkedVarint();
+        }
+        uint64_t value;
+        size_t length = decodeVarint(readData + readPos, readSize - readPos,
+                value);
+        if (length == 0) {
             throw std::runtime_error("Buffer underflow");
         }
-        str.assign(buffer.data(), len);
-        buffer.erase(buffer.begin(), buffer.begin() + len);
-        return *this;
+        readPos += length;
+        return value;
+    }
+
+    // Un varint n'est jamais coupé par l'écriture ; il ne l'est que si la
+    // lecture ne suit pas les écritures. Ses octets sont alors recopiés.
+    uint64_t consumeChunkedVarint() {
+        skipReadChunks();
+        uint64_t value;
+        if (readChunk < chunks.size()) {
+            const ChunkRef& chunk = chunks[readChunk];
+            size_t length = decodeVarint(chunk.data + readOffset,
+                    chunk.size - readOffset, value);
+            if (length > 0) {
+                readOffset += length;
+                readPos += length;
+                return value;
+            }
+        }
+        char encoded[maxVarintSize];
+        size_t available = std::min(maxVarintSize, remaining());
+        size_t savedChunk = readChunk;
+        size_t savedOffset = readOffset;
+        size_t savedPos = readPos;
+        readChunks(encoded, available);
+        readChunk = savedChunk;
+        readOffset = savedOffset;
+        readPos = savedPos;
+        size_t length = decodeVarint(encoded, available, value);
+        if (length == 0) {
+            throw std::runtime_error("Buffer underflow");
+        }
+        readChunks(nullptr, length);
+        return value;
+    }
+
+    // Écrit size octets à la fin du buffer.
+    void appendBytes(const void* data, size_t size) {
+        if (chunked) {
+            appendToChunks(static_cast<const char*>(data), size);
+            return;
+        }
+        if (readSize + size > capacity) {
+            reallocate(readSize + size);
+        }
+        if (size > 0) {
+            std::memcpy(bytes + readSize, data, size);
+        }
+        readSize += size;
+    }
+
+    void addChunk() {
+        ChunkPool::Object chunk = chunkPool->acquire();
+        const char* data = chunk->bytes;
+        chunks.push_back(ChunkRef{std::move(chunk), data, 0});
+    }
+
+    // Une écriture qui tient dans un chunk n'est jamais coupée : si elle ne
+    // tient pas dans la fin du dernier chunk, elle commence un nouveau
+    // chunk. Seules les écritures plus grandes qu'un chunk sont réparties
+    // sur plusieurs chunks.
+    void appendToChunks(const char* data, size_t size) {
+        if (!chunkPool) {
+            throw std::runtime_error("Buffer is read-only");
+        }
+        if (size == 0) {
+            return;
+        }
+        if (chunks.empty() || (size <= Chunk::size
+                    && chunks.back().size + size > Chunk::size)) {
+            addChunk();
+        }
+        while (size > 0) {
+            if (chunks.back().size == Chunk::size) {
+                addChunk();
+            }
+            ChunkRef& tail = chunks.back();
+            size_t length = std::min(size, Chunk::size - tail.size);
+            std::memcpy(tail.owner->bytes + tail.size, data, length);
+            tail.size += length;
+            readSize += length;
+            data += length;
+            size -= length;
+        }
+    }
+
+    // Agrandit la mémoire pour contenir au moins needed octets, en doublant
+    // au moins la capacité pour que les écritures successives restent en
+    // temps amorti constant.
+    void reallocate(size_t needed) {
+        if (!bytes) {
+            throw std::runtime_error("Buffer is read-only");
+        }
+        if (needed < readSize) {
+            throw std::runtime_error("Buffer is too large");
+        }
+        size_t newCapacity = std::max(needed, capacity * 2);
+        std::unique_ptr<char[]> newBytes(new char[newCapacity]);
+        std::memcpy(newBytes.get(), bytes, readSize);
+        heapBytes = std::move(newBytes);
+        bytes = heapBytes.get();
+        readData = bytes;
+        capacity = newCapacity;
+    }
+
+    // Consomme size octets et retourne leur adresse. Des octets à cheval
+    // sur deux chunks sont recopiés dans scratch, valable jusqu'à la
+    // prochaine lecture.
+    const char* consume(size_t size) {
+        if (readSize - readPos < size) {
+            throw std::runtime_error("Buffer underflow");
+        }
+        if (chunked) {
+            skipReadChunks();
+            if (size == 0) {
+                // Position courante, comme pour un buffer contigu.
+                return chunks.empty() ? inlineBytes : chunks[readChunk].data
+                    + readOffset;
+            }
+            const ChunkRef& chunk = chunks[readChunk];
+            if (chunk.size - readOffset >= size) {
+                const char* data = chunk.data + readOffset;
+                readOffset += size;
+                readPos += size;
+                return data;
+            }
+            scratch.resize(size);
+            readChunks(scratch.data(), size);
+            return scratch.data();
+        }
+        const char* data = readData + readPos;
+        readPos += size;
+        return data;
+    }
+
+    // Consomme size octets en les copiant à destination.
+    void consumeBytes(void* destination, size_t size) {
+        if (readSize - readPos < size) {
+            throw std::runtime_error("Buffer underflow");
+        }
+        if (chunked) {
+            readChunks(static_cast<char*>(destination), size);
+            return;
+        }
+        if (size > 0) {
+            std::memcpy(destination, readData + readPos, size);
+        }
+        readPos += size;
+    }
+
+    // Consomme size octets sans les copier (la taille a été vérifiée).
+    void skipBytes(size_t size) {
+        if (chunked) {
+            readChunks(nullptr, size);
+        } else {
+            readPos += size;
+        }
+    }
+
+    // Remplit au plus max iovec avec les octets non lus, retourne leur
+    // nombre.
+    size_t fillIovecs(iovec* vectors, size_t max) const {
+        if (!chunked) {
+            if (remaining() == 0 || max == 0) {
+                return 0;
+            }
+            vectors[0].iov_base = const_cast<char*>(readData + readPos);
+            vectors[0].iov_len = remaining();
+            return 1;
+        }
+        size_t count = 0;
+        for (size_t i = readChunk; i < chunks.size() && count < max; ++i) {
+            size_t offset = i == readChunk ? readOffset : 0;
+            if (chunks[i].size > offset) {
+                vectors[count].iov_base = const_cast<char*>(chunks[i].data
+                        + offset);
+                vectors[count].iov_len = chunks[i].size - offset;
+                ++count;
+            }
+        }
+        return count;
+    }
+
+    // readv() en recommençant s'il est interrompu par un signal. Retourne le
+    // nombre d'octets lus, 0 si fd est non bloquant et n'a rien à lire.
+    static size_t readVectors(int fd, const iovec* vectors, size_t count) {
+        while (true) {
+            ssize_t received = ::readv(fd, vectors, static_cast<int>(count));
+            if (received > 0) {
+                return static_cast<size_t>(received);
+            }
+            if (received == 0) {
+                throw std::runtime_error("Connection closed");
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return 0;
+            }
+            if (errno != EINTR) {
+                throw std::runtime_error("Receive failed");
+            }
+        }
+    }
+
+    // Lit directement dans la place libre du dernier chunk puis dans de
+    // nouveaux chunks ; ceux qui ne reçoivent rien sont rendus au pool.
+    size_t receiveIntoChunks(int fd, size_t maxSize) {
+        if (!chunkPool) {
+            throw std::runtime_error("Buffer is read-only");
+        }
+        iovec vectors[maxIovecs];
+        size_t count = 0;
+        size_t room = 0;
+        size_t firstNew = chunks.size();
+        size_t first = firstNew;
+        if (!chunks.empty() && chunks.back().size < Chunk::size) {
+            ChunkRef& tail = chunks.back();
+            vectors[count].iov_base = tail.owner->bytes + tail.size;
+            vectors[count].iov_len = Chunk::size - tail.size;
+            room += vectors[count++].iov_len;
+            first = firstNew - 1;
+        }
+        while (room < maxSize && count < maxIovecs) {
+            addChunk();
+            vectors[count].iov_base = chunks.back().owner->bytes;
+            vectors[count].iov_len = Chunk::size;
+            room += vectors[count++].iov_len;
+        }
+        if (room > maxSize) {
+            vectors[count - 1].iov_len -= room - maxSize;
+        }
+        size_t received = 0;
+        try {
+            received = readVectors(fd, vectors, count);
+        } catch (...) {
+            chunks.resize(firstNew);
+            throw;
+        }
+        size_t left = received;
+        for (size_t i = 0; i < count && left > 0; ++i) {
+            size_t length = std::min(left, vectors[i].iov_len);
+            chunks[first + i].size += length;
+            left -= length;
+        }
+        while (chunks.size() > firstNew && chunks.back().size == 0) {
+            chunks.pop_back();
+        }
+        readSize += received;
+        return received;
+    }
+
+    // Compression : les octets sont découpés en blocs indépendants de
+    // compressionBlockSize octets, assez petits pour qu'un bloc compressé ne
+    // soit jamais coupé entre deux chunks. Chaque bloc est une suite de
+    // séquences LZ77 : un token (4 bits pour le nombre de littéraux, 4 bits
+    // pour la longueur de la copie moins minMatch, 15 signifiant que des
+    // octets de 255 suivent), les littéraux, puis la distance de la copie
+    // sur 2 octets. La dernière séquence n'a que des littéraux.
+    static constexpr size_t compressionBlockSize = 32 * 1024;
+    static constexpr uint32_t rawBlock = 0x80000000u;
+    static constexpr size_t minMatch = 4;
+    static constexpr unsigned hashBits = 12;
+    // Les copies sont faites 8 octets à la fois et peuvent déborder d'autant
+    // après la fin d'un bloc décompressé.
+    static constexpr size_t matchOverrun = 8;
+
+    static uint32_t read32(const char* data) {
+        uint32_t value;
+        std::memcpy(&value, data, 4);
+        return value;
+    }
+
+    // Nombre d'octets communs à a et b, au plus limit.
+    static size_t commonLength(const char* a, const char* b, size_t limit) {
+        size_t length = 0;
+        while (length + 8 <= limit) {
+            uint64_t wordA;
+            uint64_t wordB;
+            std::memcpy(&wordA, a + length, 8);
+            std::memcpy(&wordB, b + length, 8);
+            if (wordA != wordB) {
+                uint64_t difference = wordA ^ wordB;
+                return length + ((bigEndianHost ? std::countl_zero(difference)
+                            : std::countr_zero(difference)) >> 3);
+            }
+            length += 8;
+        }
+        while (length < limit && a[length] == b[length]) {
+            ++length;
+        }
+        return length;
+    }
+
+    static unsigned char* writeLength(unsigned char* output, size_t length) {
+        for (; length >= 255; length -= 255) {
+            *output++ = 255;
+        }
+        *output++ = static_cast<unsigned char>(length);
+        return output;
+    }
+
+    // Écrit une séquence, ou retourne nullptr si elle dépasse limit.
+    static unsigned char* writeSequence(unsigned char* output,
+            const unsigned char* limit, const char* literals,
+            size_t literalCount, size_t offset, size_t matchLength) {
+        size_t worst = 1 + literalCount / 255 + 1 + literalCount + 2
+            + matchLength / 255 + 1;
+        if (worst > static_cast<size_t>(limit - output)) {
+            return nullptr;
+        }
+        unsigned char* token = output++;
+        *token = static_cast<unsigned char>(std::min<size_t>(literalCount, 15)
+                << 4);
+        if (literalCount >= 15) {
+            output = writeLength(output, literalCount - 15);
+        }
+        std::memcpy(output, literals, literalCount);
+        output += literalCount;
+        if (matchLength == 0) {
+            return output;
+        }
+        *output++ = static_cast<unsigned char>(offset);
+        *output++ = static_cast<unsigned char>(offset >> 8);
+        size_t extra = matchLength - minMatch;
+        *token |= static_cast<unsigned char>(std::min<size_t>(extra, 15));
+        if (extra >= 15) {
+            output = writeLength(output, extra - 15);
+        }
+        return output;
+    }
+
+    // Compresse size octets (au plus compressionBlockSize) dans output, de
+    // size octets. Retourne la taille compressée, ou size si la compression
+    // ne fait rien gagner : le bloc est alors gardé tel quel.
+    static size_t compressBlock(const char* source, size_t size,
+            char* output, uint16_t* table) {
+        std::memset(table, 0, sizeof(uint16_t) << hashBits);
+        unsigned char* cursor = reinterpret_cast<unsigned char*>(output);
+        const unsigned char* limit = cursor + size;
+        size_t anchor = 0;
+        size_t position = 0;
+        size_t misses = 0;
+        while (position + minMatch <= size) {
+            uint32_t sequence = read32(source + position);
+            uint32_t hash = (sequence * 2654435761u) >> (32 - hashBits);
+            size_t candidate = table[hash];
+            table[hash] = static_cast<uint16_t>(position);
+            if (candidate >= position || read32(source + candidate)
+                    != sequence) {
+                // Sur des octets incompressibles, le pas augmente pour ne
+                // pas perdre de temps.
+                position += 1 + (misses++ >> 6);
+                continue;
+            }
+            size_t length = minMatch + commonLength(source + candidate
+                    + minMatch, source + position + minMatch,
+                    size - position - minMatch);
+            cursor = writeSequence(cursor, limit, source + anchor,
+                    position - anchor, position - candidate, length);
+            if (!cursor) {
+                return size;
+            }
+            position += length;
+            anchor = position;
+            misses = 0;
+        }
+        cursor = writeSequence(cursor, limit, source + anchor, size - anchor,
+                0, 0);
+        if (!cursor) {
+            return size;
+        }
+        return static_cast<size_t>(cursor - reinterpret_cast<unsigned char*>(
+                    output));
+    }
+
+    static size_t readLength(const unsigned char*& input,
+            const unsigned char* end) {
+        size_t length = 0;
+        unsigned char byte;
+        do {
+            if (input == end || length > compressionBlockSize) {
+                throw std::runtime_error("Invalid compressed data");
+            }
+            byte = *input++;
+            length += byte;
+        } while (byte == 255);
+        return length;
+    }
+
+    // Décompresse un bloc de size octets dans output, qui doit avoir
+    // matchOverrun octets de plus.
+    static void decompressBlock(const char* source, size_t sourceSize,
+            char* output, size_t size) {
+        const unsigned char* input = reinterpret_cast<const unsigned char*>(
+                source);
+        const unsigned char* inputEnd = input + sourceSize;
+        char* cursor = output;
+        char* outputEnd = output + size;
+        while (true) {
+            if (input == inputEnd) {
+                throw std::runtime_error("Invalid compressed data");
+            }
+            unsigned token = *input++;
+            size_t literalCount = token >> 4;
+            if (literalCount == 15) {
+                literalCount += readLength(input, inputEnd);
+            }
+            if (literalCount > static_cast<size_t>(inputEnd - input)
+                    || literalCount > static_cast<size_t>(outputEnd - cursor)) {
+                throw std::runtime_error("Invalid compressed data");
+            }
+            std::memcpy(cursor, input, literalCount);
+            cursor += literalCount;
+            input += literalCount;
+            if (input == inputEnd) {
+                break;
+            }
+            if (inputEnd - input < 2) {
+                throw std::runtime_error("Invalid compressed data");
+            }
+            size_t offset = input[0] | static_cast<size_t>(input[1]) << 8;
+            input += 2;
+            size_t length = token & 15;
+            if (length == 15) {
+                length += readLength(input, inputEnd);
+            }
+            length += minMatch;
+            if (offset == 0 || offset > static_cast<size_t>(cursor - output)
+                    || length > static_cast<size_t>(outputEnd - cursor)) {
+                throw std::runtime_error("Invalid compressed data");
+            }
+            const char* match = cursor - offset;
+            if (offset >= 8) {
+                for (size_t i = 0; i < length; i += 8) {
+                    std::memcpy(cursor + i, match + i, 8);
+                }
+            } else {
+                for (size_t i = 0; i < length; ++i) {
+                    cursor[i] = match[i];
+                }
+            }
+            cursor += length;
+        }
+        if (cursor != outputEnd) {
+            throw std::runtime_error("Invalid compressed data");
+        }
+    }
+
+    // Somme de contrôle des fichiers, calculée 8 octets à la fois sur des
+    // blocs successifs (les chunks d'un buffer). Les mots sont lus en
+    // little-endian pour donner le même résultat partout.
+    class Checksummer {
+    private:
+        uint64_t hash;
+        uint64_t tail = 0;
+        size_t tailSize = 0;
+
+        void mix(uint64_t word) {
+            hash = std::rotl(hash ^ word, 29) * 0xbf58476d1ce4e5b9ULL;
+        }
+
+    public:
+        explicit Checksummer(size_t size)
+            : hash(0x9e3779b97f4a7c15ULL ^ size) {
+        }
+
+        void update(const char* data, size_t size) {
+            size_t i = 0;
+            // Complète le mot commencé par le bloc précédent.
+            for (; tailSize > 0 && i < size; ++i) {
+                tail |= static_cast<uint64_t>(static_cast<unsigned char>(
+                            data[i])) << (8 * tailSize);
+                if (++tailSize == 8) {
+                    mix(tail);
+                    tail = 0;
+                    tailSize = 0;
+                }
+            }
+            for (; i + 8 <= size; i += 8) {
+                uint64_t word;
+                std::memcpy(&word, data + i, 8);
+                if constexpr (bigEndianHost) {
+                    word = std::byteswap(word);
+                }
+                mix(word);
+            }
+            for (; i < size; ++i, ++tailSize) {
+                tail |= static_cast<uint64_t>(static_cast<unsigned char>(
+                            data[i])) << (8 * tailSize);
+            }
+        }
+
+        uint64_t finish() const {
+            uint64_t result = std::rotl(hash ^ tail, 29)
+                * 0x94d049bb133111ebULL;
+            return result ^ (result >> 31);
+        }
+    };
+
+    static uint64_t checksum(const char* data, size_t size) {
+        Checksummer checksummer(size);
+        checksummer.update(data, size);
+        return checksummer.finish();
+    }
+
+    // Écrit tous les blocs sur fd, en reprenant après une écriture
+    // partielle. Retourne false si writev() échoue.
+    static bool writeVectors(int fd, std::vector<iovec>& vectors) {
+        size_t first = 0;
+        while (first < vectors.size()) {
+            size_t count = std::min(vectors.size() - first, maxIovecs);
+            ssize_t written = ::writev(fd, vectors.data() + first,
+                    static_cast<int>(count));
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            size_t left = static_cast<size_t>(written);
+            while (first < vectors.size() && left >= vectors[first].iov_len) {
+                left -= vectors[first++].iov_len;
+            }
+            if (left > 0) {
+                vectors[first].iov_base = static_cast<char*>(
+                        vectors[first].iov_base) + left;
+                vectors[first].iov_len -= left;
+            }
+        }
+        return true;
+    }
+
+    // Synchronise le dossier de path pour que le renommage survive à une
+    // coupure. Sans effet si le dossier ne peut pas être ouvert.
+    static void syncDirectory(const std::string& path) {
+        size_t slash = path.rfind('/');
+        std::string directory = slash == std::string::npos ? "."
+            : slash == 0 ? "/" : path.substr(0, slash);
+        int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+        if (fd >= 0) {
+            ::fsync(fd);
+            ::close(fd);
+        }
+    }
+
+    // Convertit un champ de l'en-tête de fichier depuis ou vers
+    // little-endian.
+    template<typename T>
+    static T littleEndian(T value) {
+        if constexpr (bigEndianHost) {
+            return swapValue(value);
+        } else {
+            return value;
+        }
+    }
+
+    // Passe les chunks entièrement lus, sauf le dernier.
+    void skipReadChunks() {
+        while (readChunk + 1 < chunks.size()
+                && readOffset == chunks[readChunk].size) {
+            ++readChunk;
+            readOffset = 0;
+        }
+    }
+
+    // Consomme size octets des chunks (la taille a été vérifiée), en les
+    // copiant à destination si elle n'est pas nulle.
+    void readChunks(char* destination, size_t size) {
+        while (size > 0) {
+            skipReadChunks();
+            const ChunkRef& chunk = chunks[readChunk];
+            size_t length = std::min(size, chunk.size - readOffset);
+            if (destination) {
+                std::memcpy(destination, chunk.data + readOffset, length);
+                destination += length;
+            }
+            readOffset += length;
+            readPos += length;
+            size -= length;
+        }
+    }
+
+    // Écrit size octets précédés de leur nombre.
+    void appendSized(const void* data, size_t size) {
+        LIBFTPP_TRACE_SCOPE("DataBuffer::encode");
+        *this << size;
+        appendBytes(data, size);
+    }
+
+    // Consomme un nombre d'octets suivi de ces octets, retourne leur adresse.
+    const char* consumeSized(size_t& size) {
+        LIBFTPP_TRACE_SCOPE("DataBuffer::decode");
+        *this >> size;
+        return consume(size);
+    }
+
+    // Remet le buffer dans l'état d'un buffer vide possédant ses octets.
+    void resetToInline() {
+        heapBytes.reset();
+        bytes = inlineBytes;
+        capacity = inlineCapacity;
+        readData = inlineBytes;
+        readSize = 0;
+        readPos = 0;
+        chunks.clear();
+        chunkPool = nullptr;
+        chunked = false;
+        readChunk = 0;
+        readOffset = 0;
+        mapping.reset();
+        compressed = false;
+    }
+
+    // Copie les chunks de other : un buffer possédant ses chunks en obtient
+    // de nouveaux du même pool, une vue garde les mêmes octets.
+    void copyChunks(const DataBuffer& other) {
+        chunked = true;
+        chunkPool = other.chunkPool;
+        readChunk = other.readChunk;
+        readOffset = other.readOffset;
+        chunks.reserve(other.chunks.size());
+        for (const ChunkRef& chunk : other.chunks) {
+            if (!chunkPool) {
+                chunks.push_back(ChunkRef{ChunkPool::Object(), chunk.data,
+                        chunk.size});
+                continue;
+            }
+            ChunkPool::Object copy = chunkPool->acquire();
+            std::memcpy(copy->bytes, chunk.data, chunk.size);
+            const char* data = copy->bytes;
+            chunks.push_back(ChunkRef{std::move(copy), data, chunk.size});
+        }
+    }
+
+public:
+    DataBuffer() = default;
+
+    // La copie d'une vue est une vue sur les mêmes octets.
+    DataBuffer(const DataBuffer& other) : readSize(other.readSize),
+        readPos(other.readPos), encoding(other.encoding),
+        byteOrder(other.byteOrder), mapping(other.mapping),
+        compressed(other.compressed) {
+        if (!other.bytes) {
+            bytes = nullptr;
+            capacity = 0;
+            readData = other.readData;
+        }
+        if (other.chunked) {
+            copyChunks(other);
+        }
+        if (!other.bytes || other.chunked) {
+            return;
+        }
+        if (readSize > inlineCapacity) {
+            heapBytes.reset(new char[readSize]);
+            bytes = heapBytes.get();
+            capacity = readSize;
+            readData = bytes;
+        }
+        if (readSize > 0) {
+            std::memcpy(bytes, other.bytes, readSize);
+        }
+    }
+
+    DataBuffer(DataBuffer&& other) noexcept {
+        *this = std::move(other);
+    }
+
+    DataBuffer& operator=(const DataBuffer& other) {
+        if (this != &other) {
+            DataBuffer copy(other);
+            *this = std::move(copy);
+        }
+        return *this;
+    }
+
+    // Les octets sur le tas sont repris sans copie, les octets en place sont
+    // copiés (au plus inlineCapacity).
+    DataBuffer& operator=(DataBuffer&& other) noexcept {
+        if (this == &other) {
+            return *this;
+        }
+        readSize = other.readSize;
+        readPos = other.readPos;
+        encoding = other.encoding;
+        byteOrder = other.byteOrder;
+        chunks = std::move(other.chunks);
+        chunkPool = other.chunkPool;
+        chunked = other.chunked;
+        readChunk = other.readChunk;
+        readOffset = other.readOffset;
+        mapping = std::move(other.mapping);
+        compressed = other.compressed;
+        if (!other.bytes) {
+            heapBytes.reset();
+            bytes = nullptr;
+            capacity = 0;
+            readData = other.readData;
+        } else if (chunked) {
+            heapBytes.reset();
+            bytes = inlineBytes;
+            capacity = inlineCapacity;
+            readData = bytes;
+        } else if (other.heapBytes) {
+            heapBytes = std::move(other.heapBytes);
+            bytes = heapBytes.get();
+            capacity = other.capacity;
+            readData = bytes;
+        } else {
+            heapBytes.reset();
+            bytes = inlineBytes;
+            capacity = inlineCapacity;
+            readData = bytes;
+            if (readSize > 0) {
+                std::memcpy(bytes, other.inlineBytes, readSize);
+            }
+        }
+        other.resetToInline();
+        return *this;
+    }
+
+    // Opérateur pour sérialiser (transformer en binaire) des données dans le 
+    // buffer. Les octets de T sont copiés tels quels : T doit être
+    // trivialement copiable et ne pas être un pointeur (l'adresse n'aurait
+    // pas de sens pour le programme qui relit).
+    template<typename T>
+    DataBuffer& operator<<(const T& data) {
+        static_assert(isRaw<T, Format{false, false}>(), "DataBuffer: type "
+                "must be trivially copyable and not a pointer, or described by "
+                "DATABUFFER_FIELDS");
+        if constexpr (isVarint<T>()) {
+            if (encoding == Encoding::Compact) {
+                appendVarint(toVarint(data));
+                return *this;
+            }
+        }
+        if constexpr (isSwappable<T>()) {
+            if (swapping()) {
+                T swapped = swapValue(data);
+                appendBytes(&swapped, sizeof(T));
+                return *this;
+            }
+        }
+        appendBytes(&data, sizeof(T));
+        return *this;
+    }
+
+    // Opérateur pour désérialiser des données depuis le buffer.
+    template<typename T>
+    DataBuffer& operator>>(T& data) {
+        static_assert(isRaw<T, Format{false, false}>(), "DataBuffer: type "
+                "must be trivially copyable and not a pointer, or described by "
+                "DATABUFFER_FIELDS");
+        if constexpr (isVarint<T>()) {
+            if (encoding == Encoding::Compact) {
+                data = fromVarint<T>(consumeVarint());
+                return *this;
+            }
+        }
+        consumeBytes(&data, sizeof(T));
+        if constexpr (isSwappable<T>()) {
+            if (swapping()) {
+                data = swapValue(data);
+            }
+        }
+        return *this;
+    }
+
+    // Types décrits par DATABUFFER_FIELDS : les champs sont écrits dans
+    // l'ordre de la description, sans le padding.
+    template<DataBufferDescribed T>
+    DataBuffer& operator<<(const T& data) {
+        LIBFTPP_TRACE_SCOPE("DataBuffer::encode");
+        withFormat([this, &data]<Format TFormat>() {
+            appendFields<T, TFormat>(data,
+                    std::make_index_sequence<FieldPlan<T, TFormat>::count>());
+        });
+        return *this;
+    }
+
+    template<DataBufferDescribed T>
+    DataBuffer& operator>>(T& data) {
+        LIBFTPP_TRACE_SCOPE("DataBuffer::decode");
+        withFormat([this, &data]<Format TFormat>() {
+            consumeFields<T, TFormat>(data,
+                    std::make_index_sequence<FieldPlan<T, TFormat>::count>());
+        });
+        return *this;
+    }
+
+    // Surcharge d'opérateurs << et >> pour les strings (car leurs tailles sont 
+    // variables).
+    DataBuffer& operator<<(const std::string& str) {
+        appendSized(str.data(), str.length());
+        return *this;
+    }
+    
+    DataBuffer& operator>>(std::string& str) {
+        size_t len;
+        const char* data = consumeSized(len);
+        str.assign(data, len);
+        return *this;
+    }
+
+    // Même format que std::string. Extraire un string_view ou un span ne
+    // copie rien : ils pointent dans les octets du buffer (ou dans la mémoire
+    // empruntée par wrap()) et restent valables tant que ceux-ci ne sont pas
+    // modifiés.
+    DataBuffer& operator<<(std::string_view str) {
+        appendSized(str.data(), str.size());
+        return *this;
+    }
+
+    DataBuffer& operator>>(std::string_view& str) {
+        size_t len;
+        const char* data = consumeSized(len);
+        str = std::string_view(data, len);
+        return *this;
+    }
+
+    DataBuffer& operator<<(std::span<const std::byte> bytesToWrite) {
+        appendSized(bytesToWrite.data(), bytesToWrite.size());
+        return *this;
+    }
+
+    DataBuffer& operator>>(std::span<const std::byte>& bytesRead) {
+        size_t len;
+        const char* data = consumeSized(len);
+        bytesRead = std::span<const std::byte>(
+                reinterpret_cast<const std::byte*>(data), len);
+        return *this;
+    }
+
+    template<typename T, typename TAlloc>
+    DataBuffer& operator<<(const std::vector<T, TAlloc>& vector) {
+        LIBFTPP_TRACE_SCOPE("DataBuffer::encode");
+        *this << vector.size();
+        if constexpr (std::is_same_v<T, bool>) {
+            for (bool value : vector) {
+                *this << value;
+            }
+        } else {
+            appendRange(vector.data(), vector.size());
+        }
+        return *this;
+    }
+
+    template<typename T, typename TAlloc>
+    DataBuffer& operator>>(std::vector<T, TAlloc>& vector) {
+        LIBFTPP_TRACE_SCOPE("DataBuffer::decode");
+        size_t count = consumeCount();
+        if constexpr (std::is_same_v<T, bool>) {
+            vector.resize(count);
+            for (size_t i = 0; i < count; ++i) {
+                bool value;
+                *this >> value;
+                vector[i] = value;
+            }
+        } else if (isBulk<T>() || isSwappedBulk<T>()) {
+            if (count > remaining() / sizeof(T)) {
+                throw std::runtime_error("Buffer underflow");
+            }
+            vector.resize(count);
+            consumeRange(vector.data(), count);
+        } else {
+            vector.clear();
+            vector.reserve(count);
+            for (size_t i = 0; i < count; ++i) {
+                T value;
+                *this >> value;
+                vector.push_back(std::move(value));
+            }
+        }
+        return *this;
+    }
+
+    template<typename T, size_t N>
+    DataBuffer& operator<<(const std::array<T, N>& array) {
+        appendRange(array.data(), N);
+        return *this;
+    }
+
+    template<typename T, size_t N>
+    DataBuffer& operator>>(std::array<T, N>& array) {
+        consumeRange(array.data(), N);
+        return *this;
+    }
+
+    // Les tableaux C suivent le format de leurs éléments (varints,
+    // little-endian), comme std::array.
+    template<typename T, size_t N>
+    DataBuffer& operator<<(const T (&array)[N]) {
+        appendRange(array, N);
+        return *this;
+    }
+
+    template<typename T, size_t N>
+    DataBuffer& operator>>(T (&array)[N]) {
+        consumeRange(array, N);
+        return *this;
+    }
+
+    // Même format qu'un vector : un span écrit se relit dans un vector.
+    template<typename T, size_t Extent>
+    DataBuffer& operator<<(std::span<T, Extent> span) {
+        *this << span.size();
+        appendRange(span.data(), span.size());
+        return *this;
+    }
+
+    template<typename TKey, typename TValue, typename TCompare,
+        typename TAlloc>
+    DataBuffer& operator<<(const std::map<TKey, TValue, TCompare, TAlloc>& map) {
+        LIBFTPP_TRACE_SCOPE("DataBuffer::encode");
+        *this << map.size();
+        for (const auto& [key, value] : map) {
+            *this << key << value;
+        }
+        return *this;
+    }
+
+    // Les paires sont écrites dans l'ordre de la map : chacune est insérée à
+    // la fin, en temps constant.
+    template<typename TKey, typename TValue, typename TCompare,
+        typename TAlloc>
+    DataBuffer& operator>>(std::map<TKey, TValue, TCompare, TAlloc>& map) {
+        LIBFTPP_TRACE_SCOPE("DataBuffer::decode");
+        size_t count = consumeCount();
+        map.clear();
+        for (size_t i = 0; i < count; ++i) {
+            TKey key;
+            TValue value;
+            *this >> key >> value;
+            map.emplace_hint(map.end(), std::move(key), std::move(value));
+        }
+        return *this;
+    }
+
+    template<typename T>
+    DataBuffer& operator<<(const std::optional<T>& optional) {
+        *this << optional.has_value();
+        if (optional) {
+            *this << *optional;
+        }
+        return *this;
+    }
+
+    template<typename T>
+    DataBuffer& operator>>(std::optional<T>& optional) {
+        bool hasValue;
+        *this >> hasValue;
+        if (!hasValue) {
+            optional.reset();
+            return *this;
+        }
+        T value;
+        *this >> value;
+        optional = std::move(value);
+        return *this;
+    }
+
+    // Choisit l'encodage des entiers pour les écritures et lectures
+    // suivantes. Une vue garde l'encodage du buffer d'origine.
+    void setEncoding(Encoding newEncoding) {
+        encoding = newEncoding;
+    }
+
+    Encoding getEncoding() const {
+        return encoding;
+    }
+
+    // Choisit l'ordre des octets des nombres écrits et lus ensuite. Avec
+    // ByteOrder::Little, les entiers, flottants et enums (seuls, dans un
+    // conteneur ou dans une struct décrite par DATABUFFER_FIELDS) sont
+    // convertis sur une machine big-endian ; les autres types copiés octet
+    // par octet ne le sont pas. Sur une machine little-endian, c'est
+    // gratuit. Une vue garde l'ordre du buffer d'origine.
+    void setByteOrder(ByteOrder newByteOrder) {
+        byteOrder = newByteOrder;
+    }
+
+    ByteOrder getByteOrder() const {
+        return byteOrder;
+    }
+
+    // Nombre total d'octets du buffer, lus ou non.
+    size_t size() const {
+        return readSize;
+    }
+
+    // Nombre d'octets qui restent à lire.
+    size_t remaining() const {
+        return readSize - readPos;
+    }
+
+    // Adresse du premier octet du buffer.
+    // @throws std::runtime_error "Buffer is chunked" - Si les octets sont
+    // répartis en chunks (voir forEachChunk())
+    const char* data() const {
+        if (chunked) {
+            throw std::runtime_error("Buffer is chunked");
+        }
+        return readData;
+    }
+
+    // Réserve la mémoire pour contenir au moins newCapacity octets, pour
+    // n'allouer qu'une fois quand la taille finale est connue à l'avance.
+    // Sans effet sur un buffer en chunks.
+    void reserve(size_t newCapacity) {
+        if (!chunked && newCapacity > capacity) {
+            reallocate(newCapacity);
+        }
+    }
+
+    // Nombre d'octets que le buffer peut contenir sans allouer.
+    size_t reserved() const {
+        return chunked ? chunks.size() * Chunk::size : capacity;
+    }
+
+    // Pool de chunks utilisé par défaut par useChunks(), agrandi à la
+    // demande. Il n'est jamais détruit, pour que des DataBuffer statiques
+    // puissent encore lui rendre leurs chunks à la fin du programme.
+    static ChunkPool& defaultChunkPool() {
+        static ChunkPool* pool = [] {
+            ChunkPool* result = new ChunkPool();
+            result->growWhenEmpty(16);
+            return result;
+        }();
+        return *pool;
+    }
+
+    /**
+     * @brief Stocke les octets dans une suite de chunks de Chunk::size
+     * octets obtenus de pool, au lieu d'un seul bloc : les écritures ne
+     * déplacent jamais les octets déjà écrits et la mémoire n'est jamais
+     * doublée, ce qui convient aux très gros buffers (sauvegarde complète
+     * d'un état). compact() et clear() rendent au pool les chunks lus.
+     * 
+     * Les octets ne sont plus contigus : data() n'est plus disponible et
+     * forEachChunk() permet de parcourir les chunks. Un string_view ou un
+     * span extrait qui serait à cheval sur deux chunks pointe dans une copie
+     * valable jusqu'à la lecture suivante. Le pool doit exister tant que le
+     * buffer (et ses copies) existe.
+     * @throws std::runtime_error "Buffer is read-only" - Si c'est une vue
+     * @throws std::runtime_error "Buffer is not empty" - Si des octets ont
+     * déjà été écrits
+     */
+    void useChunks(ChunkPool& pool = defaultChunkPool()) {
+        if (!bytes) {
+            throw std::runtime_error("Buffer is read-only");
+        }
+        if (readSize > 0) {
+            throw std::runtime_error("Buffer is not empty");
+        }
+        resetToInline();
+        chunked = true;
+        chunkPool = &pool;
+    }
+
+    bool isChunked() const {
+        return chunked;
+    }
+
+    // Appelle function avec un std::span<const std::byte> pour chaque bloc
+    // contigu d'octets non lus, dans l'ordre : un seul pour un buffer
+    // contigu, un par chunk sinon.
+    template<typename TFunction>
+    void forEachChunk(TFunction function) const {
+        if (!chunked) {
+            if (remaining() > 0) {
+                function(std::span<const std::byte>(
+                        reinterpret_cast<const std::byte*>(readData + readPos),
+                        remaining()));
+            }
+            return;
+        }
+        for (size_t i = readChunk; i < chunks.size(); ++i) {
+            size_t offset = i == readChunk ? readOffset : 0;
+            if (chunks[i].size > offset) {
+                function(std::span<const std::byte>(
+                        reinterpret_cast<const std::byte*>(chunks[i].data
+                            + offset), chunks[i].size - offset));
+            }
+        }
+    }
+
+    // Écrit size octets bruts, sans leur nombre ni conversion.
+    void write(const void* data, size_t size) {
+        appendBytes(data, size);
+    }
+
+    // Lit size octets bruts écrits par write().
+    void read(void* destination, size_t size) {
+        consumeBytes(destination, size);
+    }
+
+    // Saute size octets non lus, sans les copier.
+    // @throws std::runtime_error "Buffer underflow" - S'il en reste moins
+    void skip(size_t size) {
+        if (remaining() < size) {
+            throw std::runtime_error("Buffer underflow");
+        }
+        skipBytes(size);
+    }
+
+    // Retourne les octets non lus sous forme de blocs pour writev() ou
+    // sendmsg(), sans copie : un seul bloc pour un buffer contigu, un par
+    // chunk sinon. Les blocs ne sont valables que tant que le buffer n'est
+    // pas modifié.
+    std::vector<iovec> iovecs() const {
+        std::vector<iovec> result;
+        forEachChunk([&result](std::span<const std::byte> chunk) {
+            result.push_back(iovec{const_cast<std::byte*>(chunk.data()),
+                    chunk.size()});
+        });
+        return result;
+    }
+
+    /**
+     * @brief Envoie les octets non lus sur fd avec writev(), directement
+     * depuis le buffer, et les consomme au fur et à mesure. Sur un fd non
+     * bloquant, s'arrête quand le noyau n'accepte plus rien : remaining()
+     * indique alors ce qu'il reste à envoyer au prochain appel. Sur un
+     * socket fermé par l'autre côté, le signal SIGPIPE doit être ignoré, ou
+     * flags contenir MSG_NOSIGNAL : avec des flags, fd doit être un socket
+     * et l'envoi passe par sendmsg().
+     * @return Le nombre d'octets envoyés
+     * @throws std::runtime_error "Send failed" - Si l'envoi échoue
+     */
+    size_t sendTo(int fd, int flags = 0) {
+        size_t sent = 0;
+        iovec vectors[maxIovecs];
+        while (remaining() > 0) {
+            size_t count = fillIovecs(vectors, maxIovecs);
+            ssize_t written;
+            if (flags == 0) {
+                written = ::writev(fd, vectors, static_cast<int>(count));
+            } else {
+                msghdr message{};
+                message.msg_iov = vectors;
+                message.msg_iovlen = static_cast<decltype(
+                        message.msg_iovlen)>(count);
+                written = ::sendmsg(fd, &message, flags);
+            }
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    break;
+                }
+                throw std::runtime_error("Send failed");
+            }
+            skipBytes(static_cast<size_t>(written));
+            sent += static_cast<size_t>(written);
+        }
+        return sent;
+    }
+
+    /**
+     * @brief Reçoit au plus maxSize octets de fd avec readv(), écrits
+     * directement à la fin du buffer (dans ses chunks s'il en utilise). Un
+     * seul appel à readv() est fait : sur un fd non bloquant, retourne 0 si
+     * rien n'est disponible.
+     * @return Le nombre d'octets reçus
+     * @throws std::runtime_error "Connection closed" - Si fd est à la fin
+     * @throws std::runtime_error "Receive failed" - Si readv() échoue
+     * @throws std::runtime_error "Buffer is read-only" - Si c'est une vue
+     */
+    size_t receiveFrom(int fd, size_t maxSize = Chunk::size) {
+        if (maxSize == 0) {
+            return 0;
+        }
+        if (chunked) {
+            return receiveIntoChunks(fd, maxSize);
+        }
+        reserve(readSize + maxSize);
+        iovec vector{bytes + readSize, maxSize};
+        size_t received = readVectors(fd, &vector, 1);
+        readSize += received;
+        return received;
+    }
+
+    // Revient au début du buffer pour le relire.
+    void rewind() {
+        readPos = 0;
+        readChunk = 0;
+        readOffset = 0;
+    }
+
+    // Supprime les octets déjà lus. Pour une vue, seule la fenêtre avance.
+    // Les chunks entièrement lus sont rendus à leur pool.
+    void compact() {
+        if (chunked) {
+            skipReadChunks();
+            size_t released = 0;
+            for (size_t i = 0; i < readChunk; ++i) {
+                released += chunks[i].size;
+            }
+            chunks.erase(chunks.begin(), chunks.begin() + readChunk);
+            readChunk = 0;
+            readSize -= released;
+            readPos -= released;
+            return;
+        }
+        if (bytes && readPos > 0) {
+            std::memmove(bytes, bytes + readPos, readSize - readPos);
+        } else {
+            readData += readPos;
+        }
+        readSize -= readPos;
+        readPos = 0;
+    }
+
+    // Vide le buffer (une vue devient un buffer vide, accessible en
+    // écriture). La mémoire reste réservée pour les prochaines écritures.
+    void clear() {
+        if (!bytes) {
+            resetToInline();
+        }
+        chunks.clear();
+        readChunk = 0;
+        readOffset = 0;
+        readSize = 0;
+        readPos = 0;
+        compressed = false;
+    }
+
+    /**
+     * @brief Compresse les octets non lus dans output, vidé avant (sa
+     * mémoire et son stockage en chunks sont réutilisés). Un format de type
+     * LZ4 : rapide à compresser, très rapide à décompresser, efficace sur
+     * des données redondantes. Le résultat est marqué comme compressé
+     * (isCompressed()), garde cette marque dans un fichier et se relit avec
+     * decompress(). L'encodage et l'ordre des octets sont conservés.
+     * @throws std::runtime_error "Buffer is already compressed" - Si les
+     * octets sont déjà compressés
+     */
+    void compressTo(DataBuffer& output) const {
+        LIBFTPP_TRACE_SCOPE_VALUE("DataBuffer::compress", "bytes", remaining());
+        if (compressed) {
+            throw std::runtime_error("Buffer is already compressed");
+        }
+        output.clear();
+        output.setEncoding(Encoding::Fixed);
+        output.setByteOrder(ByteOrder::Little);
+        DataBuffer input = view();
+        output << static_cast<uint64_t>(input.remaining())
+            << static_cast<uint8_t>(encoding) << static_cast<uint8_t>(byteOrder);
+        char block[compressionBlockSize];
+        uint16_t table[1 << hashBits];
+        while (input.remaining() > 0) {
+            size_t size = std::min(compressionBlockSize, input.remaining());
+            const char* source = input.consume(size);
+            size_t compressedSize = compressBlock(source, size, block, table);
+            if (compressedSize == size) {
+                output << static_cast<uint32_t>(size | rawBlock);
+                output.write(source, size);
+            } else {
+                output << static_cast<uint32_t>(compressedSize);
+                output.write(block, compressedSize);
+            }
+        }
+        output.compressed = true;
+    }
+
+    // Comme compressTo(), dans un nouveau buffer qui utilise des chunks du
+    // même pool si celui-ci en utilise.
+    DataBuffer compress() const {
+        DataBuffer result;
+        if (chunkPool) {
+            result.useChunks(*chunkPool);
+        }
+        compressTo(result);
+        return result;
+    }
+
+    /**
+     * @brief Décompresse les octets non lus, produits par compress(), dans
+     * output (vidé avant). Les blocs sont lus directement dans les octets
+     * compressés (chunks, fichier mappé) et décompressés directement dans
+     * output s'il est contigu.
+     * @throws std::runtime_error "Buffer is not compressed" - Si les octets
+     * ne viennent pas de compress()
+     * 
+     * La taille annoncée dans les octets compressés est vérifiée avant de
+     * réserver la mémoire : elle doit être plausible pour le nombre
+     * d'octets compressés, et ne pas dépasser maxSize.
+     * @throws std::runtime_error "Invalid compressed data" - Si les octets
+     * sont corrompus
+     * @throws std::runtime_error "Decompressed data is too large" - Si les
+     * octets décompressés dépasseraient maxSize
+     */
+    void decompressTo(DataBuffer& output,
+            uint64_t maxSize = maxDecompressedSize) const {
+        LIBFTPP_TRACE_SCOPE_VALUE("DataBuffer::decompress", "bytes",
+                remaining());
+        if (!compressed) {
+            throw std::runtime_error("Buffer is not compressed");
+        }
+        DataBuffer input = view();
+        input.setEncoding(Encoding::Fixed);
+        input.setByteOrder(ByteOrder::Little);
+        uint64_t total;
+        uint8_t originalEncoding;
+        uint8_t originalByteOrder;
+        if (input.remaining() < sizeof(total) + 2) {
+            throw std::runtime_error("Invalid compressed data");
+        }
+        input >> total >> originalEncoding >> originalByteOrder;
+        // Chaque bloc a un en-tête de 4 octets, et un bloc compressé ne peut
+        // pas produire plus de 256 fois sa taille.
+        uint64_t blocks = total / compressionBlockSize
+            + (total % compressionBlockSize != 0);
+        if (originalEncoding > static_cast<uint8_t>(Encoding::Compact)
+                || originalByteOrder > static_cast<uint8_t>(ByteOrder::Little)
+                || blocks > input.remaining() / sizeof(uint32_t)
+                || total / 256 > input.remaining()) {
+            throw std::runtime_error("Invalid compressed data");
+        }
+        if (total > maxSize) {
+            throw std::runtime_error("Decompressed data is too large");
+        }
+        output.clear();
+        output.encoding = static_cast<Encoding>(originalEncoding);
+        output.byteOrder = static_cast<ByteOrder>(originalByteOrder);
+        output.reserve(total + matchOverrun);
+        std::vector<char> block;
+        for (uint64_t produced = 0; produced < total; ) {
+            size_t size = static_cast<size_t>(std::min<uint64_t>(
+                        compressionBlockSize, total - produced));
+            uint32_t header;
+            if (input.remaining() < sizeof(header)) {
+                throw std::runtime_error("Invalid compressed data");
+            }
+            input >> header;
+            size_t sourceSize = header & ~rawBlock;
+            if (sourceSize > input.remaining()) {
+                throw std::runtime_error("Invalid compressed data");
+            }
+            const char* source = input.consume(sourceSize);
+            if (header & rawBlock) {
+                if (sourceSize != size) {
+                    throw std::runtime_error("Invalid compressed data");
+                }
+                output.write(source, size);
+            } else if (!output.chunked) {
+                output.reserve(output.readSize + size + matchOverrun);
+                decompressBlock(source, sourceSize, output.bytes
+                        + output.readSize, size);
+                output.readSize += size;
+            } else {
+                block.resize(compressionBlockSize + matchOverrun);
+                decompressBlock(source, sourceSize, block.data(), size);
+                output.write(block.data(), size);
+            }
+            produced += size;
+        }
+        if (input.remaining() != 0) {
+            throw std::runtime_error("Invalid compressed data");
+        }
+    }
+
+    // Comme decompressTo(), dans un nouveau buffer.
+    DataBuffer decompress(uint64_t maxSize = maxDecompressedSize) const {
+        DataBuffer result;
+        decompressTo(result, maxSize);
+        return result;
+    }
+
+    bool isCompressed() const {
+        return compressed;
+    }
+
+    // Retourne un DataBuffer en lecture seule sur les octets non lus de
+    // celui-ci, sans copie. La vue n'est valable que tant que ce buffer
+    // existe et n'est pas modifié.
+    DataBuffer view() const {
+        if (chunked) {
+            DataBuffer result;
+            result.bytes = nullptr;
+            result.capacity = 0;
+            result.chunked = true;
+            forEachChunk([&result](std::span<const std::byte> chunk) {
+                result.chunks.push_back(ChunkRef{ChunkPool::Object(),
+                        reinterpret_cast<const char*>(chunk.data()),
+                        chunk.size()});
+                result.readSize += chunk.size();
+            });
+            result.encoding = encoding;
+            result.byteOrder = byteOrder;
+            result.compressed = compressed;
+            return result;
+        }
+        DataBuffer result = wrap(readData + readPos, readSize - readPos);
+        result.encoding = encoding;
+        result.byteOrder = byteOrder;
+        result.mapping = mapping;
+        result.compressed = compressed;
+        return result;
+    }
+
+    // Retourne un DataBuffer en lecture seule sur size octets de mémoire
+    // externe (buffer de réception, fichier mappé...), sans copie. La mémoire
+    // doit rester valable tant que le DataBuffer est utilisé.
+    static DataBuffer wrap(const char* data, size_t size) {
+        DataBuffer result;
+        result.bytes = nullptr;
+        result.capacity = 0;
+        result.readData = data;
+        result.readSize = size;
+        return result;
+    }
+
+    static DataBuffer wrap(std::span<const std::byte> data) {
+        return wrap(reinterpret_cast<const char*>(data.data()), data.size());
+    }
+
+    // Comme wrap(), sur des octets produits par compress() et recopiés
+    // ailleurs : le résultat se relit avec decompress().
+    static DataBuffer wrapCompressed(const char* data, size_t size) {
+        DataBuffer result = wrap(data, size);
+        result.compressed = true;
+        return result;
+    }
+
+    /**
+     * @brief Écrit les octets non lus dans le fichier path, précédés d'un
+     * en-tête (version, encodage, taille et somme de contrôle). Les octets
+     * (ou les chunks) sont écrits avec writev() dans path + ".tmp", synchronisé
+     * sur le disque puis renommé en path : un fichier existant reste intact
+     * si l'écriture échoue (disque plein, coupure...).
+     * @throws std::runtime_error "Cannot open file" - Si le fichier
+     * temporaire ne peut pas être créé
+     * @throws std::runtime_error "Cannot write file" - Si l'écriture, la
+     * synchronisation ou le renommage échoue
+     */
+    void saveToFile(const std::string& path) const {
+        std::vector<iovec> vectors = iovecs();
+        Checksummer checksummer(remaining());
+        for (const iovec& vector : vectors) {
+            checksummer.update(static_cast<const char*>(vector.iov_base),
+                    vector.iov_len);
+        }
+        FileHeader header;
+        std::memcpy(header.magic, fileMagic, sizeof(fileMagic));
+        header.version = littleEndian(fileVersion);
+        header.encoding = static_cast<uint8_t>(encoding);
+        header.byteOrder = bigEndianHost && byteOrder == ByteOrder::Host;
+        header.compressed = compressed;
+        header.reserved = 0;
+        header.size = littleEndian(static_cast<uint64_t>(remaining()));
+        header.checksum = littleEndian(checksummer.finish());
+        vectors.insert(vectors.begin(), iovec{&header, sizeof(header)});
+
+        std::string temporary = path + ".tmp";
+        int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC,
+                0644);
+        if (fd < 0) {
+            throw std::runtime_error("Cannot open file");
+        }
+        bool written = writeVectors(fd, vectors) && ::fsync(fd) == 0;
+        written = ::close(fd) == 0 && written;
+        if (!written || ::rename(temporary.c_str(), path.c_str()) != 0) {
+            ::unlink(temporary.c_str());
+            throw std::runtime_error("Cannot write file");
+        }
+        syncDirectory(path);
+    }
+
+    /**
+     * @brief Mappe en lecture seule un fichier écrit par saveToFile() et
+     * retourne une vue sur ses octets, avec l'encodage d'origine. Rien n'est
+     * lu d'avance : seules les pages effectivement décodées sont chargées
+     * par le noyau. Le fichier reste mappé tant que le buffer, ses copies ou
+     * ses vues existent.
+     * 
+     * L'en-tête est toujours contrôlé, mais pas la somme des octets : un
+     * fichier altéré après son écriture est accepté. Checksum::Verify la
+     * vérifie, au prix d'une lecture de tout le fichier à l'ouverture.
+     * @throws std::runtime_error "Cannot open file" - Si path ne peut pas
+     * être ouvert
+     * @throws std::runtime_error "Cannot map file" - Si mmap() échoue
+     * @throws std::runtime_error "Invalid file" - Si l'en-tête ne correspond
+     * pas au fichier
+     * @throws std::runtime_error "Unsupported file version" - Si le fichier
+     * vient d'une autre version du format
+     * @throws std::runtime_error "Checksum mismatch" - Si les octets ont été
+     * altérés
+     * @throws std::runtime_error "Unsupported byte order" - Si le fichier a
+     * été écrit en ByteOrder::Host sur une machine big-endian et est lu sur
+     * une machine little-endian
+     */
+    static DataBuffer mapFile(const std::string& path,
+            Checksum check = Checksum::Skip) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Cannot open file");
+        }
+        struct stat info;
+        if (::fstat(fd, &info) != 0) {
+            ::close(fd);
+            throw std::runtime_error("Cannot open file");
+        }
+        size_t length = static_cast<size_t>(info.st_size);
+        if (length < sizeof(FileHeader)) {
+            ::close(fd);
+            throw std::runtime_error("Invalid file");
+        }
+        void* address = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (address == MAP_FAILED) {
+            throw std::runtime_error("Cannot map file");
+        }
+        std::shared_ptr<const void> mapped(address,
+                [length](const void* mappedAddress) {
+            ::munmap(const_cast<void*>(mappedAddress), length);
+        });
+        FileHeader header;
+        std::memcpy(&header, address, sizeof(header));
+        if (std::memcmp(header.magic, fileMagic, sizeof(fileMagic)) != 0) {
+            throw std::runtime_error("Invalid file");
+        }
+        if (littleEndian(header.version) != fileVersion) {
+            throw std::runtime_error("Unsupported file version");
+        }
+        header.size = littleEndian(header.size);
+        header.checksum = littleEndian(header.checksum);
+        if (header.size != length - sizeof(FileHeader)
+                || header.encoding > static_cast<uint8_t>(Encoding::Compact)
+                || header.byteOrder > 1 || header.compressed > 1) {
+            throw std::runtime_error("Invalid file");
+        }
+        if (header.byteOrder == 1 && !bigEndianHost) {
+            throw std::runtime_error("Unsupported byte order");
+        }
+        const char* payload = static_cast<const char*>(address)
+            + sizeof(FileHeader);
+        if (check == Checksum::Verify && checksum(payload, header.size)
+                != header.checksum) {
+            throw std::runtime_error("Checksum mismatch");
+        }
+        DataBuffer result = wrap(payload, header.size);
+        result.encoding = static_cast<Encoding>(header.encoding);
+        result.byteOrder = header.byteOrder == 0 ? ByteOrder::Little
+            : ByteOrder::Host;
+        result.compressed = header.compressed == 1;
+        result.mapping = std::move(mapped);
+        return result;
     }
 };
 
@@ -18,6 +18,15 @@
 #include <vector>
 #include <functional>
 #include <stdexcept>
+#include <future>
+#include <array>
+#include <unordered_map>
+#include <concepts>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <utility>
 
 class Memento {
     /** @brief La class Memento permet de sauvegarder et de restaurer l'état d'un objet.
@@ -37,13 +46,51 @@ class Memento {
      *             snap >> health >> name;  // Restaure l'état
      *         }
      * };
+     * 
+     * Deltas : saveDelta(base) n'enregistre que les octets qui diffèrent de
+     * base, puis remplace base par l'état actuel. Appelé à chaque tick avec
+     * le même base, il produit une chaîne de deltas que load(premier,
+     * deltas) applique dans l'ordre. La comparaison se fait octet par octet :
+     * elle est efficace tant que les champs gardent leur position (un
+     * champ de taille variable qui grandit décale tous les suivants).
+     * 
+     * Sauvegarde asynchrone : saveAsync() ne fait sur le thread appelant que
+     * la capture de l'état par _captureSnapshot(), et l'écrit dans le
+     * snapshot (puis le compresse) sur un thread du WorkerPool partagé. La
+     * capture doit être redéfinie pour utiliser saveAsync() : elle copie
+     * seulement les données, ou partage des données immuables, pour que la
+     * pause soit celle de la copie et non de l'encodage :
+     * 
+     *         std::function<void(Snapshot&)> _captureSnapshot() override {
+     *             return [health = health, name = name](Snapshot& snap) {
+     *                 snap << health << name;
+     *             };
+     *         }
+     * 
+     * Historique : Memento::History garde les N derniers snapshots d'un
+     * objet dans une seule zone mémoire allouée à sa construction.
+     * 
+     * Compression : après setCompression(true), les snapshots (deltas et
+     * historique compris) sont compressés par DataBuffer::compress(), et
+     * décompressés au chargement. Utile quand l'état est redondant ou qu'on
+     * en garde beaucoup ; la base de saveDelta() reste non compressée.
      */
 protected:
     class Snapshot {
         friend class Memento;
     private:
         DataBuffer buffer;
+        bool delta = false;
     public:
+        // Indique si le snapshot vient de saveDelta().
+        bool isDelta() const {
+            return delta;
+        }
+
+        bool isCompressed() const {
+            return buffer.isCompressed();
+        }
+
         template<typename T>
         Snapshot& operator<<(const T& data) {
             buffer << data;
@@ -55,28 +102,606 @@ protected:
             buffer >> data;
             return *this;
         }
+
+        // Écrit le snapshot dans un fichier (voir DataBuffer::saveToFile()).
+        // @throws std::runtime_error "Snapshot is a delta" - Si le snapshot
+        // vient de saveDelta()
+        void saveToFile(const std::string& path) const {
+            if (delta) {
+                throw std::runtime_error("Snapshot is a delta");
+            }
+            buffer.saveToFile(path);
+        }
+
+        // Relit un snapshot écrit par saveToFile() en mappant le fichier,
+        // sans le lire d'avance ; Checksum::Verify contrôle sa somme (voir
+        // DataBuffer::mapFile()).
+        static Snapshot loadFromFile(const std::string& path,
+                DataBuffer::Checksum check = DataBuffer::Checksum::Skip) {
+            Snapshot snapshot;
+            snapshot.buffer = DataBuffer::mapFile(path, check);
+            return snapshot;
+        }
     };
 
 private:
+    // Taille du dernier snapshot, réservée d'avance au suivant : un objet
+    // sauvegardé régulièrement n'alloue qu'une fois par snapshot.
+    size_t snapshotSizeHint = 0;
+    // Même chose pour saveAsync(), partagée avec ses jobs qui peuvent finir
+    // après la destruction de l'objet. Créée au premier saveAsync().
+    std::shared_ptr<std::atomic<size_t>> asyncSizeHint;
+    bool compression = false;
+
+    // Deux plages modifiées séparées par moins de deltaMergeGap octets
+    // identiques sont enregistrées ensemble : une plage coûte quelques
+    // octets d'en-tête.
+    static constexpr size_t deltaMergeGap = 16;
+
     virtual void _saveToSnapshot(Snapshot& snapshot) = 0;
     virtual void _loadFromSnapshot(Snapshot& snapshot) = 0;
 
-public:
-    Snapshot save() {
+protected:
+    // Appelé par saveAsync() sur le thread appelant. Retourne une fonction
+    // qui écrira l'état capturé dans un snapshot, sur un autre thread : elle
+    // doit posséder tout ce qu'elle écrit et ne plus accéder à l'objet. Non
+    // définie par défaut : sérialiser l'état ici ne réduirait pas la pause.
+    virtual std::function<void(Snapshot&)> _captureSnapshot() {
+        return nullptr;
+    }
+
+private:
+
+    // Premier octet à partir de from où base et target diffèrent, ou end.
+    // Les octets sont comparés 8 à la fois.
+    static size_t findDifference(const char* base, const char* target,
+            size_t from, size_t end) {
+        for (; from + 8 <= end; from += 8) {
+            uint64_t baseWord;
+            uint64_t targetWord;
+            std::memcpy(&baseWord, base + from, 8);
+            std::memcpy(&targetWord, target + from, 8);
+            if (baseWord != targetWord) {
+                break;
+            }
+        }
+        while (from < end && base[from] == target[from]) {
+            ++from;
+        }
+        return from;
+    }
+
+    // Fin de la plage modifiée qui commence à from.
+    static size_t findDifferenceEnd(const char* base, const char* target,
+            size_t from, size_t end) {
+        size_t last = from + 1;
+        for (size_t i = last; i < end && i - last < deltaMergeGap; ++i) {
+            if (base[i] != target[i]) {
+                last = i + 1;
+            }
+        }
+        return last;
+    }
+
+    // Un delta contient la taille de base et celle de target, puis chaque
+    // plage modifiée sous la forme du nombre d'octets inchangés qui la
+    // précèdent suivi de ses octets. Les octets ajoutés à la fin forment la
+    // dernière plage.
+    static void encodeDelta(const DataBuffer& base, const DataBuffer& target,
+            DataBuffer& delta) {
+        const char* from = base.data();
+        const char* to = target.data();
+        size_t common = std::min(base.size(), target.size());
+        delta.setEncoding(DataBuffer::Encoding::Compact);
+        delta << base.size() << target.size();
+        size_t position = 0;
+        size_t start = findDifference(from, to, 0, common);
+        while (start < common) {
+            size_t end = findDifferenceEnd(from, to, start, common);
+            delta << start - position << std::span<const std::byte>(
+                    reinterpret_cast<const std::byte*>(to + start),
+                    end - start);
+            position = end;
+            start = findDifference(from, to, end, common);
+        }
+        if (target.size() > common) {
+            delta << common - position << std::span<const std::byte>(
+                    reinterpret_cast<const std::byte*>(to + common),
+                    target.size() - common);
+        }
+    }
+
+    // Reconstruit dans target l'état décrit par delta à partir de base.
+    static void applyDelta(const DataBuffer& base, DataBuffer delta,
+            DataBuffer& target) {
+        if (delta.isCompressed()) {
+            delta = delta.decompress();
+        }
+        size_t baseSize;
+        size_t targetSize;
+        delta >> baseSize >> targetSize;
+        if (baseSize != base.size()) {
+            throw std::runtime_error("Delta does not match base");
+        }
+        // Les octets de target viennent de base ou du delta : une taille
+        // plus grande est corrompue, et ne doit pas être réservée.
+        if (targetSize > baseSize + delta.remaining()) {
+            throw std::runtime_error("Invalid delta");
+        }
+        const char* from = base.data();
+        target.clear();
+        target.reserve(targetSize);
+        size_t position = 0;
+        while (delta.remaining() > 0) {
+            size_t unchanged;
+            std::span<const std::byte> changed;
+            delta >> unchanged >> changed;
+            size_t available = position < baseSize ? baseSize - position : 0;
+            if (unchanged > available || unchanged > targetSize - position
+                    || changed.size() > targetSize - position - unchanged) {
+                throw std::runtime_error("Invalid delta");
+            }
+            target.write(from + position, unchanged);
+            target.write(changed.data(), changed.size());
+            position += unchanged + changed.size();
+        }
+        size_t available = position < baseSize ? baseSize - position : 0;
+        if (targetSize - position > available) {
+            throw std::runtime_error("Invalid delta");
+        }
+        target.write(from + position, targetSize - position);
+    }
+
+    Snapshot saveUncompressed() {
         Snapshot snapshot;
+        snapshot.buffer.reserve(snapshotSizeHint);
         _saveToSnapshot(snapshot);
+        snapshotSizeHint = snapshot.buffer.size();
         return snapshot;
     }
 
+    // Octets non compressés de snapshot, sans copie s'ils ne le sont pas.
+    static DataBuffer uncompressed(const Snapshot& snapshot) {
+        if (snapshot.buffer.isCompressed()) {
+            return snapshot.buffer.decompress();
+        }
+        return snapshot.buffer.view();
+    }
+
+public:
+    // Active ou non la compression des snapshots suivants.
+    void setCompression(bool enabled) {
+        compression = enabled;
+    }
+
+    bool getCompression() const {
+        return compression;
+    }
+
+    Snapshot save() {
+        Snapshot snapshot = saveUncompressed();
+        if (compression) {
+            snapshot.buffer = snapshot.buffer.compress();
+        }
+        return snapshot;
+    }
+
+    /**
+     * @brief Capture l'état de l'objet par _captureSnapshot() puis l'écrit
+     * dans un snapshot par un job de WorkerPool::shared(). L'objet peut être
+     * modifié, et même détruit, dès le retour de saveAsync() ; le future
+     * peut être abandonné sans attendre.
+     * @throws std::runtime_error "Snapshot capture is not defined" - Si
+     * _captureSnapshot() n'est pas redéfinie
+     */
+    std::future<Snapshot> saveAsync() {
+        struct Pending {
+            std::promise<Snapshot> promise;
+            std::function<void(Snapshot&)> write;
+            std::shared_ptr<std::atomic<size_t>> sizeHint;
+            bool compressed;
+        };
+        std::function<void(Snapshot&)> write = _captureSnapshot();
+        if (!write) {
+            throw std::runtime_error("Snapshot capture is not defined");
+        }
+        if (!asyncSizeHint) {
+            asyncSizeHint = std::make_shared<std::atomic<size_t>>(
+                    snapshotSizeHint);
+        }
+        auto pending = std::make_shared<Pending>(Pending{{}, std::move(write),
+                asyncSizeHint, compression});
+        std::future<Snapshot> result = pending->promise.get_future();
+        WorkerPool::shared().addJob([pending]() {
+            try {
+                Snapshot snapshot;
+                snapshot.buffer.reserve(pending->sizeHint->load(
+                            std::memory_order_relaxed));
+                pending->write(snapshot);
+                pending->sizeHint->store(snapshot.buffer.size(),
+                        std::memory_order_relaxed);
+                if (pending->compressed && !snapshot.buffer.isCompressed()) {
+                    snapshot.buffer = snapshot.buffer.compress();
+                }
+                pending->promise.set_value(std::move(snapshot));
+            } catch (...) {
+                pending->promise.set_exception(std::current_exception());
+            }
+        });
+        return result;
+    }
+
+    /**
+     * @brief Retourne un snapshot qui ne contient que les différences entre
+     * base et l'état actuel, puis remplace base par l'état actuel (sans
+     * copie, et non compressé) pour le prochain appel.
+     * @throws std::runtime_error "Base is a delta" - Si base vient lui-même
+     * de saveDelta()
+     */
+    Snapshot saveDelta(Snapshot& base) {
+        if (base.delta) {
+            throw std::runtime_error("Base is a delta");
+        }
+        Snapshot current = saveUncompressed();
+        Snapshot result;
+        result.delta = true;
+        encodeDelta(uncompressed(base), current.buffer, result.buffer);
+        if (compression) {
+            result.buffer = result.buffer.compress();
+        }
+        base = std::move(current);
+        return result;
+    }
+
+    // Le snapshot chargé lit les octets de state sans les copier.
+    // @throws std::runtime_error "Snapshot is a delta" - Si state vient de
+    // saveDelta() : il faut alors l'appliquer à sa base
     void load(const Snapshot& state) {
-        Snapshot snapshot = state;
+        if (state.delta) {
+            throw std::runtime_error("Snapshot is a delta");
+        }
+        Snapshot snapshot;
+        snapshot.buffer = uncompressed(state);
         _loadFromSnapshot(snapshot);
     }
 
+    /**
+     * @brief Applique dans l'ordre une chaîne de deltas à base, puis charge
+     * l'état obtenu. Chaque delta doit avoir été calculé sur l'état produit
+     * par les précédents, comme le fait saveDelta().
+     * @throws std::runtime_error "Base is a delta" - Si base vient de
+     * saveDelta()
+     * @throws std::runtime_error "Snapshot is not a delta" - Si un élément
+     * de deltas n'en est pas un
+     * @throws std::runtime_error "Delta does not match base" - Si un delta a
+     * été calculé sur un état d'une autre taille
+     * @throws std::runtime_error "Invalid delta" - Si un delta est corrompu
+     */
+    void load(const Snapshot& base, std::span<const Snapshot> deltas) {
+        if (base.delta) {
+            throw std::runtime_error("Base is a delta");
+        }
+        DataBuffer current = uncompressed(base);
+        DataBuffer next;
+        for (const Snapshot& delta : deltas) {
+            if (!delta.delta) {
+                throw std::runtime_error("Snapshot is not a delta");
+            }
+            applyDelta(current, delta.buffer.view(), next);
+            std::swap(current, next);
+        }
+        Snapshot snapshot;
+        snapshot.buffer = std::move(current);
+        _loadFromSnapshot(snapshot);
+    }
+
+    /**
+     * @brief Historique borné de snapshots : au plus maxSnapshots snapshots,
+     * dont les octets sont stockés dans une zone circulaire de arenaSize
+     * octets allouée une fois pour toutes. push() enregistre l'état d'un
+     * objet en écrasant les plus anciens snapshots si la place manque, et
+     * load() restaure le snapshot n (0 pour le plus ancien) sans copie.
+     * Après les premiers push(), plus rien n'est alloué. Si la compression
+     * de l'objet est activée, les snapshots sont compressés dans la zone et
+     * décompressés par load() dans un buffer réutilisé.
+     * 
+     * exemple :
+     * 
+     * Memento::History history(600, 16 * 1024 * 1024); // 10 s à 60 Hz
+     * history.push(player);                           // à chaque tick
+     * history.load(player, history.size() - 2);      // retour en arrière
+     * 
+     * @throws std::runtime_error "Invalid history size" - Si maxSnapshots ou
+     * arenaSize vaut 0
+     */
+    class History {
+    private:
+        // Les positions sont comptées sans retour à zéro : l'octet p est à
+        // arena[p % arenaSize]. Un snapshot ne doit pas être coupé par la
+        // fin de la zone : il commence alors au tour suivant.
+        struct Entry {
+            uint64_t start;
+            size_t size;
+            bool compressed;
+        };
+
+        std::unique_ptr<char[]> arena;
+        size_t arenaSize;
+        std::vector<Entry> entries;
+        size_t first = 0;
+        size_t count = 0;
+        uint64_t end = 0;
+        // Buffers réutilisés par push() et load(), pour ne pas allouer à
+        // chaque appel.
+        Snapshot scratch;
+        DataBuffer packed;
+        mutable DataBuffer unpacked;
+
+        const Entry& entry(size_t index) const {
+            return entries[(first + index) % entries.size()];
+        }
+
+        void evictOldest() {
+            first = (first + 1) % entries.size();
+            --count;
+        }
+
+    public:
+        History(size_t maxSnapshots, size_t p_arenaSize)
+            : arena(new char[p_arenaSize]), arenaSize(p_arenaSize),
+            entries(maxSnapshots) {
+            if (maxSnapshots == 0 || p_arenaSize == 0) {
+                throw std::runtime_error("Invalid history size");
+            }
+        }
+
+        History(const History&) = delete;
+        History& operator=(const History&) = delete;
+
+        /**
+         * @brief Enregistre l'état actuel de object comme snapshot le plus
+         * récent.
+         * @throws std::runtime_error "Snapshot is too large" - Si le
+         * snapshot dépasse arenaSize ; l'historique est alors inchangé
+         */
+        void push(Memento& object) {
+            scratch.buffer.clear();
+            object._saveToSnapshot(scratch);
+            const DataBuffer* saved = &scratch.buffer;
+            if (object.compression) {
+                scratch.buffer.compressTo(packed);
+                saved = &packed;
+            }
+            size_t size = saved->size();
+            if (size > arenaSize) {
+                throw std::runtime_error("Snapshot is too large");
+            }
+            uint64_t start = end;
+            if (start % arenaSize + size > arenaSize) {
+                start += arenaSize - start % arenaSize;
+            }
+            if (count == entries.size()) {
+                evictOldest();
+            }
+            while (count > 0 && start + size - entry(0).start > arenaSize) {
+                evictOldest();
+            }
+            if (size > 0) {
+                std::memcpy(arena.get() + start % arenaSize, saved->data(),
+                        size);
+            }
+            entries[(first + count) % entries.size()] = Entry{start, size,
+                object.compression};
+            ++count;
+            end = start + size;
+        }
+
+        /**
+         * @brief Restaure dans object le snapshot index, en lisant
+         * directement ses octets dans la zone (ou en les décompressant).
+         * @throws std::runtime_error "Invalid snapshot index" - Si index >=
+         * size()
+         */
+        void load(Memento& object, size_t index) const {
+            if (index >= count) {
+                throw std::runtime_error("Invalid snapshot index");
+            }
+            const Entry& loaded = entry(index);
+            const char* data = arena.get() + loaded.start % arenaSize;
+            Snapshot snapshot;
+            if (loaded.compressed) {
+                DataBuffer::wrapCompressed(data, loaded.size)
+                    .decompressTo(unpacked);
+                snapshot.buffer = unpacked.view();
+            } else {
+                snapshot.buffer = DataBuffer::wrap(data, loaded.size);
+            }
+            object._loadFromSnapshot(snapshot);
+        }
+
+        // Nombre de snapshots gardés.
+        size_t size() const {
+            return count;
+        }
+
+        size_t capacity() const {
+            return entries.size();
+        }
+
+        // Oublie les snapshots plus récents que les newSize premiers, par
+        // exemple pour repartir d'un état restauré par load().
+        void truncate(size_t newSize) {
+            if (newSize >= count) {
+                return;
+            }
+            count = newSize;
+            end = count > 0 ? entry(count - 1).start + entry(count - 1).size
+                : entry(0).start;
+        }
+
+        void clear() {
+            count = 0;
+        }
+    };
+
     virtual ~Memento() = default;
 };
 
-template<typename TEvent>
+// Nombre de valeurs d'un enum dont les valeurs vont de 0 à value - 1. Connu
+// pour les enums qui finissent par un énumérateur COUNT ; sinon, le
+// spécialiser :
+// 
+//     template<> struct EnumSize<GameEvent> { static constexpr size_t value = 2; };
+template<typename TEnum>
+struct EnumSize {};
+
+template<typename TEnum>
+    requires (std::is_enum_v<TEnum> && requires { TEnum::COUNT; })
+struct EnumSize<TEnum> {
+    static constexpr size_t value = static_cast<size_t>(TEnum::COUNT);
+};
+
+template<typename TEnum>
+concept BoundedEnum = std::is_enum_v<TEnum> && requires {
+    { EnumSize<TEnum>::value } -> std::convertible_to<size_t>;
+};
+
+template<typename TKey>
+concept Hashable = requires(const TKey& key) {
+    { std::hash<TKey>{}(key) } -> std::convertible_to<size_t>;
+};
+
+/**
+ * @brief Table de TValue indexée par événement, choisie à la compilation :
+ * un tableau indexé par la valeur pour un BoundedEnum, un tableau pour les
+ * petits entiers (de 0 à denseSize - 1) complété par une table de hachage,
+ * une table de hachage pour les autres clés hachables, une std::map sinon.
+ * find() ne fait qu'une recherche (un accès indexé pour un enum ou un petit
+ * entier).
+ * @throws std::runtime_error "Invalid event" - Si operator[] reçoit une
+ * valeur d'enum hors de [0, EnumSize::value)
+ */
+template<typename TEvent, typename TValue>
+class EventTable {
+private:
+    std::map<TEvent, TValue> values;
+
+public:
+    TValue& operator[](const TEvent& event) {
+        return values[event];
+    }
+
+    TValue* find(const TEvent& event) {
+        auto it = values.find(event);
+        return it != values.end() ? &it->second : nullptr;
+    }
+
+    const TValue* find(const TEvent& event) const {
+        auto it = values.find(event);
+        return it != values.end() ? &it->second : nullptr;
+    }
+};
+
+template<typename TEvent, typename TValue>
+    requires (Hashable<TEvent> && !BoundedEnum<TEvent>
+            && !std::is_integral_v<TEvent>)
+class EventTable<TEvent, TValue> {
+private:
+    std::unordered_map<TEvent, TValue> values;
+
+public:
+    TValue& operator[](const TEvent& event) {
+        return values[event];
+    }
+
+    TValue* find(const TEvent& event) {
+        auto it = values.find(event);
+        return it != values.end() ? &it->second : nullptr;
+    }
+
+    const TValue* find(const TEvent& event) const {
+        auto it = values.find(event);
+        return it != values.end() ? &it->second : nullptr;
+    }
+};
+
+// Les types de messages et autres identifiants entiers sont presque
+// toujours de petites valeurs : elles sont rangées dans un tableau qui
+// grandit avec la plus grande valeur utilisée, les autres dans une table de
+// hachage.
+template<typename TEvent, typename TValue>
+    requires std::is_integral_v<TEvent>
+class EventTable<TEvent, TValue> {
+private:
+    static constexpr size_t denseSize = 256;
+    std::vector<TValue> dense;
+    std::unordered_map<TEvent, TValue> sparse;
+
+    static bool isDense(const TEvent& event) {
+        if constexpr (std::is_signed_v<TEvent>) {
+            if (event < 0) {
+                return false;
+            }
+        }
+        return static_cast<std::make_unsigned_t<TEvent>>(event) < denseSize;
+    }
+
+public:
+    TValue& operator[](const TEvent& event) {
+        if (!isDense(event)) {
+            return sparse[event];
+        }
+        size_t index = static_cast<size_t>(event);
+        if (index >= dense.size()) {
+            dense.resize(index + 1);
+        }
+        return dense[index];
+    }
+
+    TValue* find(const TEvent& event) {
+        return const_cast<TValue*>(std::as_const(*this).find(event));
+    }
+
+    const TValue* find(const TEvent& event) const {
+        if (isDense(event)) {
+            size_t index = static_cast<size_t>(event);
+            return index < dense.size() ? &dense[index] : nullptr;
+        }
+        auto it = sparse.find(event);
+        return it != sparse.end() ? &it->second : nullptr;
+    }
+};
+
+template<typename TEvent, typename TValue>
+    requires BoundedEnum<TEvent>
+class EventTable<TEvent, TValue> {
+private:
+    static constexpr size_t eventCount = EnumSize<TEvent>::value;
+    std::array<TValue, eventCount> values{};
+
+    static size_t index(const TEvent& event) {
+        return static_cast<size_t>(static_cast<std::underlying_type_t<TEvent>>(
+                    event));
+    }
+
+public:
+    TValue& operator[](const TEvent& event) {
+        if (index(event) >= eventCount) {
+            throw std::runtime_error("Invalid event");
+        }
+        return values[index(event)];
+    }
+
+    TValue* find(const TEvent& event) {
+        return index(event) < eventCount ? &values[index(event)] : nullptr;
+    }
+
+    const TValue* find(const TEvent& event) const {
+        return index(event) < eventCount ? &values[index(event)] : nullptr;
+    }
+};
+
+template<typename TEvent, typename TCallback = InplaceFunction<void()>>
 class Observer {
     /** La class Observer fonctionne comme un système de notifications :
      * Des objets (subscribers) s'inscrivent pour "observer" certains événements
@@ -90,25 +715,608 @@ class Observer {
      * gameObserver.subscribe(GameEvent::PLAYER_DIED, []{ std::cout << 
      * "Game Over!"; });
      * gameObserver.notify(GameEvent::PLAYER_DIED); // Affiche "Game Over!"
+     * 
+     * Les abonnés sont rangés dans une EventTable : si GameEvent finit par
+     * COUNT (ou si EnumSize<GameEvent> est spécialisé), notify() n'est qu'un
+     * accès à un tableau suivi des appels.
+     * 
+     * Les callbacks sont des InplaceFunction, sans allocation. Si tous les
+     * abonnés ont le même type, le passer en TCallback (pointeur de
+     * fonction, foncteur) permet au compilateur d'inliner les appels :
+     * 
+     * struct OnDeath { Player* player; void operator()() const { ... } };
+     * Observer<GameEvent, OnDeath> deaths;
+     * 
+     * @throws std::runtime_error "Invalid event" - Si subscribe() reçoit une
+     * valeur d'enum hors de [0, EnumSize::value)
      */
     
 private:
-    std::map<TEvent, std::vector<std::function<void()>>> subscribers;
+    EventTable<TEvent, std::vector<TCallback>> subscribers;
 
 public:
-    void subscribe(const TEvent& event, const std::function<void()>& lambda) {
-        subscribers[event].push_back(lambda);
+    void subscribe(const TEvent& event, TCallback lambda) {
+        subscribers[event].push_back(std::move(lambda));
     }
 
     void notify(const TEvent& event) {
-        if (subscribers.find(event) != subscribers.end()) {
-            for (const auto& lambda : subscribers[event]) {
+        LIBFTPP_TRACE_SCOPE_VALUE("Observer::notify", "event", event);
+        if (const auto* lambdas = subscribers.find(event)) {
+            for (const auto& lambda : *lambdas) {
                 lambda();
             }
         }
     }
 };
 
+template<typename TEvent>
+class ConcurrentObserver {
+    /** @brief Variante de Observer utilisable depuis plusieurs threads :
+     * subscribe() et la destruction d'une Subscription peuvent avoir lieu
+     * pendant des notify() sur d'autres threads.
+     * 
+     * notify() ne prend aucun verrou : il lit une table des abonnés
+     * immuable, que subscribe() et unsubscribe() remplacent par une copie
+     * modifiée (copy-on-write, sous un mutex réservé aux écritures). Une
+     * ancienne table est libérée quand plus aucun notify() ne peut la lire :
+     * chaque thread publie dans son emplacement (ThreadSlot) l'époque à
+     * laquelle il a commencé à lire, et les écritures ne libèrent que les
+     * tables retirées avant la plus ancienne époque publiée.
+     * 
+     * exemple :
+     * 
+     * ConcurrentObserver<GameEvent> observer;
+     * auto subscription = observer.subscribe(GameEvent::LEVEL_UP, []{ ... });
+     * observer.notify(GameEvent::LEVEL_UP);  // depuis n'importe quel thread
+     * subscription.reset();                  // désabonne
+     * 
+     * Un callback peut encore être en cours sur un autre thread au retour de
+     * unsubscribe() ; il peut lui-même appeler subscribe(), notify() ou
+     * désabonner. L'observer doit survivre à ses Subscription.
+     * 
+     * @throws std::runtime_error "Invalid event" - Si subscribe() reçoit une
+     * valeur d'enum hors de [0, EnumSize::value)
+     */
+private:
+    struct Subscriber {
+        uint64_t id;
+        InplaceFunction<void()> callback;
+    };
+    using Table = EventTable<TEvent, std::vector<Subscriber>>;
+
+    // Une époque par emplacement de thread : 0 si le thread ne lit pas de
+    // table, sinon l'époque lue au début de sa lecture.
+    struct alignas(64) ReaderEpoch {
+        std::atomic<uint64_t> epoch{0};
+    };
+
+    struct Retired {
+        uint64_t epoch;
+        const Table* table;
+    };
+
+    std::atomic<const Table*> table;
+    std::atomic<uint64_t> epoch{1};
+    std::unique_ptr<ReaderEpoch[]> readers;
+    // Lecteurs sans emplacement (au-delà de ThreadSlot::maxSlots threads) :
+    // tant qu'il y en a, rien n'est libéré.
+    std::atomic<size_t> unslottedReaders{0};
+    std::mutex writeMutex;
+    std::vector<Retired> retired;
+    uint64_t nextId = 1;
+
+    // Publie newTable à la place de la table actuelle, qui est retirée.
+    // writeMutex doit être pris.
+    void publish(const Table* newTable) {
+        const Table* old = table.exchange(newTable);
+        retired.push_back(Retired{epoch.fetch_add(1), old});
+        reclaim();
+    }
+
+    void reclaim() {
+        if (unslottedReaders.load() != 0) {
+            return;
+        }
+        uint64_t oldest = UINT64_MAX;
+        for (size_t i = 0; i < ThreadSlot::maxSlots; ++i) {
+            uint64_t reading = readers[i].epoch.load();
+            if (reading != 0) {
+                oldest = std::min(oldest, reading);
+            }
+        }
+        // Une table retirée à l'époque e n'est plus visible des lecteurs
+        // entrés à l'époque e + 1 ou après.
+        std::erase_if(retired, [oldest](const Retired& entry) {
+            if (entry.epoch >= oldest) {
+                return false;
+            }
+            delete entry.table;
+            return true;
+        });
+    }
+
+    // Fin d'une lecture commencée par notify().
+    void leave(size_t slot, bool outermost) {
+        if (slot == ThreadSlot::none) {
+            unslottedReaders.fetch_sub(1);
+        } else if (outermost) {
+            readers[slot].epoch.store(0, std::memory_order_release);
+        }
+    }
+
+    void unsubscribe(const TEvent& event, uint64_t id) {
+        std::lock_guard<std::mutex> lock(writeMutex);
+        auto* newTable = new Table(*table.load());
+        if (auto* subscribers = newTable->find(event)) {
+            std::erase_if(*subscribers, [id](const Subscriber& subscriber) {
+                return subscriber.id == id;
+            });
+        }
+        publish(newTable);
+    }
+
+public:
+    /**
+     * @brief Abonnement retourné par subscribe() : le callback est
+     * désabonné à la destruction, ou par reset().
+     */
+    class Subscription {
+        friend class ConcurrentObserver;
+    private:
+        ConcurrentObserver* observer = nullptr;
+        TEvent event{};
+        uint64_t id = 0;
+
+        Subscription(ConcurrentObserver* p_observer, const TEvent& p_event,
+                uint64_t p_id)
+            : observer(p_observer), event(p_event), id(p_id) {}
+
+    public:
+        Subscription() = default;
+
+        Subscription(Subscription&& other) noexcept
+            : observer(other.observer), event(other.event), id(other.id) {
+            other.observer = nullptr;
+        }
+
+        Subscription& operator=(Subscription&& other) noexcept {
+            if (this != &other) {
+                reset();
+                observer = other.observer;
+                event = other.event;
+                id = other.id;
+                other.observer = nullptr;
+            }
+            return *this;
+        }
+
+        Subscription(const Subscription&) = delete;
+        Subscription& operator=(const Subscription&) = delete;
+
+        ~Subscription() {
+            reset();
+        }
+
+        void reset() {
+            if (observer) {
+                observer->unsubscribe(event, id);
+                observer = nullptr;
+            }
+        }
+
+        bool isActive() const {
+            return observer != nullptr;
+        }
+    };
+
+    ConcurrentObserver() : table(new Table()),
+        readers(new ReaderEpoch[ThreadSlot::maxSlots]) {}
+
+    ConcurrentObserver(const ConcurrentObserver&) = delete;
+    ConcurrentObserver& operator=(const ConcurrentObserver&) = delete;
+
+    ~ConcurrentObserver() {
+        delete table.load();
+        for (const Retired& entry : retired) {
+            delete entry.table;
+        }
+    }
+
+    [[nodiscard]] Subscription subscribe(const TEvent& event,
+            const InplaceFunction<void()>& lambda) {
+        std::lock_guard<std::mutex> lock(writeMutex);
+        auto newTable = std::make_unique<Table>(*table.load());
+        uint64_t id = nextId++;
+        (*newTable)[event].push_back(Subscriber{id, lambda});
+        publish(newTable.release());
+        return Subscription(this, event, id);
+    }
+
+    void notify(const TEvent& event) {
+        size_t slot = ThreadSlot::current();
+        // Un notify() appelé par un callback lit déjà sous l'époque du
+        // notify() qui l'entoure.
+        bool outermost = slot == ThreadSlot::none
+            || readers[slot].epoch.load(std::memory_order_relaxed) == 0;
+        if (slot == ThreadSlot::none) {
+            unslottedReaders.fetch_add(1);
+        } else if (outermost) {
+            readers[slot].epoch.store(epoch.load());
+        }
+        try {
+            if (const auto* subscribers = table.load()->find(event)) {
+                for (const Subscriber& subscriber : *subscribers) {
+                    subscriber.callback();
+                }
+            }
+        } catch (...) {
+            leave(slot, outermost);
+            throw;
+        }
+        leave(slot, outermost);
+    }
+};
+
+template<typename TEvent, typename TPayload>
+class AsyncObserver {
+    /** @brief Variante de Observer dont les événements portent un TPayload
+     * et sont traités par un WorkerPool : notify() ne fait que mettre
+     * l'événement dans une file, et un abonné lent ne bloque pas le thread
+     * qui publie.
+     * 
+     * exemple :
+     * 
+     * AsyncObserver<GameEvent, int> observer;
+     * observer.subscribe(GameEvent::LEVEL_UP, [](const int& level) { ... });
+     * observer.notify(GameEvent::LEVEL_UP, 3);  // depuis n'importe quel thread
+     * observer.flush();                         // attend les callbacks
+     * 
+     * Les événements sont répartis entre laneCount files, bornées et
+     * lock-free (plusieurs producteurs, un consommateur). Quand une file
+     * reçoit un événement alors qu'elle est inactive, un job du WorkerPool
+     * la vide par lots de batchSize événements ; une file n'a jamais plus
+     * d'un job à la fois. Un événement va toujours dans la même file : les
+     * événements d'un même type sont traités dans l'ordre de leur
+     * publication. Les payloads sont construits dans un Pool : une fois le
+     * pool à sa taille, publier n'alloue plus.
+     * 
+     * Les callbacks ne doivent pas lever d'exception (std::terminate()). Ils
+     * peuvent appeler subscribe() et notify() : chaque lot lit une copie
+     * de la table des abonnés, sans verrou pendant les appels. Le
+     * destructeur traite les événements encore en file.
+     * 
+     * @throws std::runtime_error "Invalid queue size" - Si queueCapacity,
+     * laneCount ou batchSize vaut 0
+     * @throws std::runtime_error "Invalid event" - Si subscribe() reçoit une
+     * valeur d'enum hors de [0, EnumSize::value)
+     */
+private:
+    using PayloadCallback = InplaceFunction<void(const TPayload&)>;
+    using PayloadPool = Pool<TPayload>;
+    using Table = EventTable<TEvent, std::vector<PayloadCallback>>;
+
+    // Lots traités par un job avant de laisser la place aux autres jobs
+    // du WorkerPool.
+    static constexpr size_t batchesPerJob = 16;
+
+    struct Message {
+        TEvent event{};
+        typename PayloadPool::Object payload;
+    };
+
+    // File bornée de Vyukov : la séquence d'une case indique si elle est
+    // libre pour la position position (sequence == position) ou remplie
+    // (sequence == position + 1).
+    struct alignas(64) Cell {
+        std::atomic<uint64_t> sequence;
+        Message message;
+    };
+
+    struct Lane {
+        std::unique_ptr<Cell[]> cells;
+        size_t mask;
+        alignas(64) std::atomic<uint64_t> tail{0};
+        alignas(64) uint64_t head = 0;
+        // Un job vide la file.
+        std::atomic<bool> scheduled{false};
+        // Position jusqu'à laquelle les événements ont été traités, pour
+        // flush().
+        std::atomic<uint64_t> done{0};
+        std::mutex mutex;
+        std::condition_variable drained;
+        std::vector<Message> batch;
+
+        Lane(size_t capacity, size_t batchSize)
+            : cells(new Cell[capacity]), mask(capacity - 1), batch(batchSize) {
+            for (size_t i = 0; i < capacity; ++i) {
+                cells[i].sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        bool tryPush(Message& message) {
+            uint64_t position = tail.load(std::memory_order_relaxed);
+            for (;;) {
+                Cell& cell = cells[position & mask];
+                uint64_t sequence = cell.sequence.load(
+                        std::memory_order_acquire);
+                int64_t difference = static_cast<int64_t>(sequence - position);
+                if (difference < 0) {
+                    return false;
+                }
+                if (difference > 0) {
+                    position = tail.load(std::memory_order_relaxed);
+                } else if (tail.compare_exchange_weak(position, position + 1,
+                            std::memory_order_acq_rel,
+                            std::memory_order_relaxed)) {
+                    cell.message = std::move(message);
+                    cell.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+        }
+
+        bool tryPop(Message& message) {
+            Cell& cell = cells[head & mask];
+            if (cell.sequence.load(std::memory_order_acquire) != head + 1) {
+                return false;
+            }
+            message = std::move(cell.message);
+            cell.sequence.store(head + mask + 1, std::memory_order_release);
+            ++head;
+            return true;
+        }
+
+        bool empty() {
+            return cells[head & mask].sequence.load(std::memory_order_acquire)
+                != head + 1;
+        }
+
+        // Un événement a été réservé par tryPush() après la position
+        // consumed, même s'il n'est pas encore écrit. Lecture de tail par un
+        // fetch_add(0), voir schedule().
+        bool claimedAfter(uint64_t consumed) {
+            return tail.fetch_add(0, std::memory_order_acq_rel) != consumed;
+        }
+    };
+
+    WorkerPool& workers;
+    PayloadPool payloads;
+    // Remplacée par une copie modifiée à chaque subscribe() : un lot garde
+    // la table qu'il a lue, même si un callback en publie une nouvelle.
+    std::shared_ptr<const Table> subscribers = std::make_shared<Table>();
+    std::mutex subscribersMutex;
+    std::vector<std::unique_ptr<Lane>> lanes;
+    size_t batchSize;
+    // Jobs en cours, attendus par le destructeur.
+    size_t activeJobs = 0;
+    std::mutex jobsMutex;
+    std::condition_variable jobsDone;
+
+    Lane& laneFor(const TEvent& event) {
+        size_t hash = 0;
+        if constexpr (std::is_enum_v<TEvent>) {
+            hash = static_cast<size_t>(event);
+        } else if constexpr (Hashable<TEvent>) {
+            hash = std::hash<TEvent>{}(event);
+        }
+        return *lanes[hash % lanes.size()];
+    }
+
+    // Lance un job sur la file si elle n'en a pas. Le job remet scheduled à
+    // false puis relit tail par un read-modify-write, et tryPush() avance
+    // tail par un autre avant cet appel : soit le job voit l'événement, soit
+    // le compare-and-swap de tryPush() se synchronise avec lui et scheduled
+    // est lu à false ici.
+    void schedule(Lane& lane) {
+        if (lane.scheduled.load(std::memory_order_acquire)
+                || lane.scheduled.exchange(true)) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(jobsMutex);
+            ++activeJobs;
+        }
+        workers.addJob([this, &lane]() {
+            drain(lane);
+        });
+    }
+
+    // Traite au plus un lot, et retourne le nombre d'événements traités.
+    size_t dispatchBatch(Lane& lane) {
+        size_t count = 0;
+        while (count < batchSize && lane.tryPop(lane.batch[count])) {
+            ++count;
+        }
+        if (count == 0) {
+            return 0;
+        }
+        std::shared_ptr<const Table> table;
+        {
+            std::lock_guard<std::mutex> lock(subscribersMutex);
+            table = subscribers;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            if (const auto* callbacks = table->find(lane.batch[i].event)) {
+                for (const PayloadCallback& callback : *callbacks) {
+                    callback(*lane.batch[i].payload);
+                }
+            }
+        }
+        for (size_t i = 0; i < count; ++i) {
+            lane.batch[i].payload = typename PayloadPool::Object();
+        }
+        {
+            std::lock_guard<std::mutex> lock(lane.mutex);
+            lane.done.store(lane.head);
+        }
+        lane.drained.notify_all();
+        return count;
+    }
+
+    void drain(Lane& lane) noexcept {
+        for (size_t batches = 0; ; ) {
+            if (dispatchBatch(lane) > 0) {
+                if (++batches == batchesPerJob) {
+                    // La file reste marquée : le nouveau job prend la suite.
+                    workers.addJob([this, &lane]() {
+                        drain(lane);
+                    });
+                    return;
+                }
+                continue;
+            }
+            // head est lu avant de rendre la file : ensuite, un autre job
+            // peut la vider.
+            uint64_t consumed = lane.head;
+            lane.scheduled.store(false);
+            if (!lane.claimedAfter(consumed)
+                    || lane.scheduled.exchange(true)) {
+                break;
+            }
+        }
+        std::lock_guard<std::mutex> lock(jobsMutex);
+        --activeJobs;
+        jobsDone.notify_all();
+    }
+
+public:
+    AsyncObserver(size_t queueCapacity = 1024, size_t laneCount = 1,
+            size_t p_batchSize = 64, WorkerPool& p_workers
+            = WorkerPool::shared()) : workers(p_workers),
+        batchSize(p_batchSize) {
+        if (queueCapacity == 0 || laneCount == 0 || batchSize == 0) {
+            throw std::runtime_error("Invalid queue size");
+        }
+        size_t capacity = std::bit_ceil(queueCapacity);
+        // Assez de payloads pour des files pleines et un lot en cours par
+        // file ; au-delà (producteurs en attente), le pool grandit.
+        payloads.resize(laneCount * (capacity + batchSize));
+        payloads.growWhenEmpty(batchSize);
+        for (size_t i = 0; i < laneCount; ++i) {
+            lanes.push_back(std::make_unique<Lane>(capacity, batchSize));
+        }
+    }
+
+    AsyncObserver(const AsyncObserver&) = delete;
+    AsyncObserver& operator=(const AsyncObserver&) = delete;
+
+    ~AsyncObserver() {
+        flush();
+        std::unique_lock<std::mutex> lock(jobsMutex);
+        jobsDone.wait(lock, [this]() {
+            return activeJobs == 0;
+        });
+    }
+
+    // Peut être appelé pendant que des événements sont traités, y compris
+    // par un callback : le nouvel abonné reçoit les lots suivants.
+    void subscribe(const TEvent& event, const PayloadCallback& lambda) {
+        std::lock_guard<std::mutex> lock(subscribersMutex);
+        auto newTable = std::make_shared<Table>(*subscribers);
+        (*newTable)[event].push_back(lambda);
+        subscribers = std::move(newTable);
+    }
+
+    // Met l'événement en file et retourne tout de suite, ou retourne false
+    // si sa file est pleine.
+    template<typename TArg>
+    bool tryNotify(const TEvent& event, TArg&& payload) {
+        Lane& lane = laneFor(event);
+        Message message{event, payloads.acquire(std::forward<TArg>(payload))};
+        if (!lane.tryPush(message)) {
+            return false;
+        }
+        schedule(lane);
+        return true;
+    }
+
+    // Comme tryNotify(), mais attend de la place dans la file si elle est
+    // pleine.
+    template<typename TArg>
+    void notify(const TEvent& event, TArg&& payload) {
+        Lane& lane = laneFor(event);
+        Message message{event, payloads.acquire(std::forward<TArg>(payload))};
+        while (!lane.tryPush(message)) {
+            schedule(lane);
+            std::this_thread::yield();
+        }
+        schedule(lane);
+    }
+
+    // Attend que les événements publiés avant l'appel aient été traités.
+    // Ne doit pas être appelé depuis un callback.
+    void flush() {
+        for (auto& lane : lanes) {
+            uint64_t target = lane->tail.load();
+            std::unique_lock<std::mutex> lock(lane->mutex);
+            lane->drained.wait(lock, [&]() {
+                return lane->done.load() >= target;
+            });
+        }
+    }
+};
+
+class SingletonRegistry {
+    /** @brief Registre des Singleton instanciés, pour les détruire dans un
+     * ordre déterminé : l'inverse de leur instanciation, comme des objets
+     * statiques. Un singleton qui en utilise un autre dans son destructeur
+     * (un Logger par exemple) doit donc être instancié après lui.
+     * 
+     * Les singletons encore vivants sont détruits à la fin du programme, ou
+     * plus tôt par destroyAll(), quand plus aucun thread ne les utilise.
+     */
+public:
+    static void destroyAll() {
+        std::vector<void (*)()> releases;
+        {
+            std::lock_guard<std::mutex> lock(registry().mutex);
+            releases.swap(registry().releases);
+        }
+        releaseAll(releases);
+    }
+
+private:
+    template<typename TType>
+    friend class Singleton;
+
+    struct Registry {
+        std::mutex mutex;
+        std::vector<void (*)()> releases;
+
+        ~Registry() {
+            releaseAll(releases);
+        }
+    };
+
+    static Registry& registry() {
+        static Registry instance;
+        return instance;
+    }
+
+    static void releaseAll(std::vector<void (*)()>& releases) {
+        while (!releases.empty()) {
+            void (*release)() = releases.back();
+            releases.pop_back();
+            release();
+        }
+    }
+
+    static void add(void (*release)()) {
+        std::lock_guard<std::mutex> lock(registry().mutex);
+        registry().releases.push_back(release);
+    }
+
+    // Retire une seule inscription de release : chaque instance en a une.
+    static void remove(void (*release)()) {
+        std::lock_guard<std::mutex> lock(registry().mutex);
+        std::vector<void (*)()>& releases = registry().releases;
+        auto found = std::find(releases.rbegin(), releases.rend(), release);
+        if (found != releases.rend()) {
+            releases.erase(std::next(found).base());
+        }
+    }
+};
+
 template<typename TType>
 class Singleton {
     /** @brief la class Singleton permet de s'assurer qu'une seule instance
@@ -134,31 +1342,79 @@ class Singleton {
      *     void log(const std::string& msg) { ... }
      * };
      * 
+     * instance() n'est qu'une lecture atomique (acquire), sans verrou.
+     * instanciate() peut être appelé par plusieurs threads en même temps :
+     * un seul construit l'instance, sous un mutex propre au type. L'instance
+     * est détruite par destroy(), ou par le SingletonRegistry à la fin du
+     * programme.
+     * 
+     * @throws std::runtime_error "Instance already exists" - Si instanciate()
+     * est appelé alors que l'instance existe
      */
 
 private:
-    static TType* instancePtr;
+    static std::atomic<TType*> instancePtr;
+    static std::mutex instanceMutex;
+
+    // Détruit l'instance sans la retirer du registre, pour le registre.
+    static void release() {
+        TType* instancePointer;
+        {
+            std::lock_guard<std::mutex> lock(instanceMutex);
+            instancePointer = instancePtr.exchange(nullptr,
+                    std::memory_order_acq_rel);
+        }
+        delete instancePointer;
+    }
 
 public:
     static TType* instance() {
-        return instancePtr;
+        return instancePtr.load(std::memory_order_acquire);
     }
 
     template<typename... TArgs>
     static void instanciate(TArgs&&... p_args) {
-        if (instancePtr) {
+        std::lock_guard<std::mutex> lock(instanceMutex);
+        if (instancePtr.load(std::memory_order_relaxed)) {
             throw std::runtime_error("Instance already exists");
         }
-        instancePtr = new TType(std::forward<TArgs>(p_args)...);
+        TType* created = new TType(std::forward<TArgs>(p_args)...);
+        try {
+            SingletonRegistry::add(&Singleton::release);
+        } catch (...) {
+            delete created;
+            throw;
+        }
+        instancePtr.store(created, std::memory_order_release);
+    }
+
+    // Détruit l'instance, si elle existe ; instanciate() peut ensuite en
+    // créer une nouvelle. Aucun thread ne doit plus utiliser l'ancienne.
+    static void destroy() {
+        TType* instancePointer;
+        {
+            // Désinscrite sous le même verrou que l'inscription : un
+            // instanciate() concurrent ne peut pas perdre la sienne.
+            std::lock_guard<std::mutex> lock(instanceMutex);
+            instancePointer = instancePtr.exchange(nullptr,
+                    std::memory_order_acq_rel);
+            if (instancePointer) {
+                SingletonRegistry::remove(&Singleton::release);
+            }
+        }
+        delete instancePointer;
     }
 };
 
-// initialisation du membre statique instancePtr. 
+// initialisation des membres statiques instancePtr et instanceMutex.
 // En C++, les membres statiques doivent être définis en dehors de la classe.
 template<typename TType>
-TType* Singleton<TType>::instancePtr = nullptr;
+std::atomic<TType*> Singleton<TType>::instancePtr = nullptr;
 
-template<typename TState>
+template<typename TType>
+std::mutex Singleton<TType>::instanceMutex;
+
+template<typename TState, typename TCallback = InplaceFunction<void()>>
 class StateMachine {
     /** @brief StateMachine gère les états d'un système et les transitions entre
      * ces états.
@@ -192,16 +1448,32 @@ class StateMachine {
      * 3 - Transitions autorisées entre états.
      * 4 - État actuel.
      * 
+     * L'état actuel vaut TState{} (la première valeur d'un enum) à la
+     * construction : addState() ne le change pas, seul transitionTo() le
+     * modifie.
+     * 
+     * Si TState est un BoundedEnum (voir EnumSize), une spécialisation range
+     * les actions dans un tableau indexé par l'état et les transitions dans
+     * une table N×N : transitionTo() et update() ne font alors qu'un accès
+     * indexé suivi de l'appel, sans allocation ni recherche.
+     * 
+     * Les actions et les transitions sont des TCallback : des
+     * InplaceFunction par défaut, sans allocation, ou un type connu à la
+     * compilation (foncteur, pointeur de fonction) pour que update() puisse
+     * être inliné.
+     * 
      * @throws std::runtime_error "State not registered" - État non enregistré
      * @throws std::runtime_error "Invalid transition" - Transition non définie
      * @throws std::runtime_error "No action for current state" - Action
      * manquante
+     * @throws std::runtime_error "Invalid state" - Si addState() reçoit,
+     * pour un BoundedEnum, une valeur hors de [0, EnumSize::value)
      */
     
 private:
-    TState currentState;
-    std::map<TState, std::function<void()>> stateActions;
-    std::map<std::pair<TState, TState>, std::function<void()>> transitions;
+    TState currentState{};
+    std::map<TState, TCallback> stateActions;
+    std::map<std::pair<TState, TState>, TCallback> transitions;
     std::map<TState, bool> states;
 
 public:
@@ -210,21 +1482,23 @@ public:
     }
 
     void addTransition(const TState& startState, const TState& finalState, 
-                      const std::function<void()>& lambda) {
-        if (!states[startState] || !states[finalState]) {
+                      TCallback lambda) {
+        if (!hasState(startState) || !hasState(finalState)) {
             throw std::runtime_error("State not registered");
         }
-        transitions[{startState, finalState}] = lambda;
+        transitions.insert_or_assign({startState, finalState},
+                std::move(lambda));
     }
 
-    void addAction(const TState& state, const std::function<void()>& lambda) {
-        if (!states[state]) {
+    void addAction(const TState& state, TCallback lambda) {
+        if (!hasState(state)) {
             throw std::runtime_error("State not registered");
         }
-        stateActions[state] = lambda;
+        stateActions.insert_or_assign(state, std::move(lambda));
     }
 
     void transitionTo(const TState& state) {
+        LIBFTPP_TRACE_SCOPE_VALUE("StateMachine::transitionTo", "state", state);
         auto transitionIt = transitions.find({currentState, state});
         if (transitionIt == transitions.end()) {
             throw std::runtime_error("Invalid transition");
@@ -234,6 +1508,8 @@ public:
     }
 
     void update() {
+        LIBFTPP_TRACE_SCOPE_VALUE("StateMachine::update", "state",
+                currentState);
         auto actionIt = stateActions.find(currentState);
         if (actionIt == stateActions.end()) {
             throw std::runtime_error("No action for current state");
@@ -259,5 +1535,395 @@ public:
     }
 };
 
+template<typename TState, typename TCallback>
+    requires BoundedEnum<TState>
+class StateMachine<TState, TCallback> {
+    // Spécialisation dense de StateMachine pour un enum de N états : mêmes
+    // fonctions et mêmes exceptions. Une valeur hors de [0, N) n'est jamais
+    // enregistrée.
+private:
+    static constexpr size_t stateCount = EnumSize<TState>::value;
+    // Indice d'une transition dans transitionCallbacks, ou noTransition.
+    using TransitionIndex = std::conditional_t<(stateCount * stateCount
+                < UINT8_MAX), uint8_t, std::conditional_t<(stateCount
+                    * stateCount < UINT16_MAX), uint16_t, uint32_t>>;
+    static constexpr TransitionIndex noTransition
+        = std::numeric_limits<TransitionIndex>::max();
+
+    TState currentState{};
+    std::array<bool, stateCount> states{};
+    std::array<std::optional<TCallback>, stateCount> stateActions;
+    std::array<TransitionIndex, stateCount * stateCount> transitions;
+    std::vector<TCallback> transitionCallbacks;
+
+    static size_t index(const TState& state) {
+        return static_cast<size_t>(static_cast<std::underlying_type_t<TState>>(
+                    state));
+    }
+
+    static size_t transitionIndex(const TState& from, const TState& to) {
+        return index(from) * stateCount + index(to);
+    }
+
+public:
+    StateMachine() {
+        transitions.fill(noTransition);
+    }
+
+    void addState(const TState& state) {
+        if (index(state) >= stateCount) {
+            throw std::runtime_error("Invalid state");
+        }
+        states[index(state)] = true;
+    }
+
+    void addTransition(const TState& startState, const TState& finalState,
+                      TCallback lambda) {
+        if (!hasState(startState) || !hasState(finalState)) {
+            throw std::runtime_error("State not registered");
+        }
+        TransitionIndex& slot = transitions[transitionIndex(startState,
+                finalState)];
+        if (slot != noTransition) {
+            transitionCallbacks[slot] = std::move(lambda);
+            return;
+        }
+        slot = static_cast<TransitionIndex>(transitionCallbacks.size());
+        transitionCallbacks.push_back(std::move(lambda));
+    }
+
+    void addAction(const TState& state, TCallback lambda) {
+        if (!hasState(state)) {
+            throw std::runtime_error("State not registered");
+        }
+        stateActions[index(state)] = std::move(lambda);
+    }
+
+    void transitionTo(const TState& state) {
+        LIBFTPP_TRACE_SCOPE_VALUE("StateMachine::transitionTo", "state", state);
+        if (index(state) >= stateCount) {
+            throw std::runtime_error("Invalid transition");
+        }
+        TransitionIndex slot = transitions[transitionIndex(currentState,
+                state)];
+        if (slot == noTransition) {
+            throw std::runtime_error("Invalid transition");
+        }
+        transitionCallbacks[slot]();
+        currentState = state;
+    }
+
+    void update() {
+        LIBFTPP_TRACE_SCOPE_VALUE("StateMachine::update", "state",
+                currentState);
+        std::optional<TCallback>& action = stateActions[index(currentState)];
+        if (!action) {
+            throw std::runtime_error("No action for current state");
+        }
+        (*action)();
+    }
+
+    TState getCurrentState() const { return currentState; }
+
+    bool hasState(const TState& state) const {
+        return index(state) < stateCount && states[index(state)];
+    }
+
+    bool hasTransition(const TState& from, const TState& to) const {
+        return hasState(from) && hasState(to)
+            && transitions[transitionIndex(from, to)] != noTransition;
+    }
+
+    bool hasAction(const TState& state) const {
+        return hasState(state) && stateActions[index(state)].has_value();
+    }
+};
+
+template<typename TState>
+    requires BoundedEnum<TState>
+class StateMachineBatch {
+    /** @brief Ensemble de machines à états qui partagent le même graphe
+     * d'états, d'actions et de transitions : seul l'état courant de chaque
+     * machine (entité) est stocké, sur un ou deux octets.
+     * 
+     * exemple :
+     * 
+     * auto graph = std::make_shared<StateMachineBatch<PlayerState>::Graph>();
+     * graph->addState(PlayerState::IDLE);
+     * graph->addState(PlayerState::WALKING);
+     * graph->addTransition(PlayerState::IDLE, PlayerState::WALKING,
+     *     [](uint32_t entity) { ... });
+     * graph->addAction(PlayerState::WALKING,
+     *     [](std::span<const uint32_t> entities) { ... });
+     * 
+     * StateMachineBatch<PlayerState> players(graph, 50000, PlayerState::IDLE);
+     * players.transitionTo(42, PlayerState::WALKING);
+     * players.updateAll(4);  // sur 4 threads
+     * 
+     * updateAll() regroupe les entités par état courant (tri par comptage,
+     * dans un tableau réutilisé) et appelle l'action de chaque état une fois
+     * par plage contiguë d'entités. Sur plusieurs threads, les plages sont
+     * découpées en morceaux d'au moins minRangeSize entités, traités par les
+     * workers de WorkerPool::shared() : une action peut alors être appelée en
+     * même temps pour des entités différentes.
+     * 
+     * Le graphe ne doit plus être modifié une fois partagé.
+     * 
+     * @throws std::runtime_error "State not registered" - État non enregistré
+     * @throws std::runtime_error "Invalid transition" - Transition non définie
+     * @throws std::runtime_error "No action for current state" - Si une
+     * entité est dans un état sans action lors de updateAll()
+     * @throws std::runtime_error "Invalid entity" - Indice d'entité invalide
+     */
+public:
+    using StateAction = InplaceFunction<void(std::span<const uint32_t>)>;
+    using TransitionAction = InplaceFunction<void(uint32_t)>;
+
+    static constexpr size_t stateCount = EnumSize<TState>::value;
+    static constexpr size_t minRangeSize = 1024;
+
+    // Graphe partagé par toutes les entités d'un StateMachineBatch.
+    class Graph {
+        friend class StateMachineBatch;
+    private:
+        using TransitionIndex = std::conditional_t<(stateCount * stateCount
+                    < UINT16_MAX), uint16_t, uint32_t>;
+        static constexpr TransitionIndex noTransition
+            = std::numeric_limits<TransitionIndex>::max();
+
+        std::array<bool, stateCount> states{};
+        std::array<std::optional<StateAction>, stateCount> actions;
+        std::array<TransitionIndex, stateCount * stateCount> transitions;
+        std::vector<TransitionAction> transitionActions;
+
+        static size_t transitionIndex(const TState& from, const TState& to) {
+            return index(from) * stateCount + index(to);
+        }
+
+    public:
+        Graph() {
+            transitions.fill(noTransition);
+        }
+
+        void addState(const TState& state) {
+            if (index(state) >= stateCount) {
+                throw std::runtime_error("Invalid state");
+            }
+            states[index(state)] = true;
+        }
+
+        void addTransition(const TState& startState, const TState& finalState,
+                TransitionAction lambda) {
+            if (!hasState(startState) || !hasState(finalState)) {
+                throw std::runtime_error("State not registered");
+            }
+            TransitionIndex& slot = transitions[transitionIndex(startState,
+                    finalState)];
+            if (slot != noTransition) {
+                transitionActions[slot] = std::move(lambda);
+                return;
+            }
+            slot = static_cast<TransitionIndex>(transitionActions.size());
+            transitionActions.push_back(std::move(lambda));
+        }
+
+        void addAction(const TState& state, StateAction lambda) {
+            if (!hasState(state)) {
+                throw std::runtime_error("State not registered");
+            }
+            actions[index(state)] = std::move(lambda);
+        }
+
+        bool hasState(const TState& state) const {
+            return index(state) < stateCount && states[index(state)];
+        }
+
+        bool hasTransition(const TState& from, const TState& to) const {
+            return hasState(from) && hasState(to)
+                && transitions[transitionIndex(from, to)] != noTransition;
+        }
+
+        bool hasAction(const TState& state) const {
+            return hasState(state) && actions[index(state)].has_value();
+        }
+    };
+
+private:
+    using StoredState = std::conditional_t<(stateCount <= 256), uint8_t,
+          uint16_t>;
+
+    struct Range {
+        size_t state;
+        size_t begin;
+        size_t end;
+    };
+
+    std::shared_ptr<const Graph> graph;
+    std::vector<StoredState> states;
+    // Réutilisés par updateAll() : entités triées par état, et plages.
+    std::vector<uint32_t> order;
+    std::vector<Range> ranges;
+
+    static size_t index(const TState& state) {
+        return static_cast<size_t>(static_cast<std::underlying_type_t<TState>>(
+                    state));
+    }
+
+    void checkEntity(size_t entity) const {
+        if (entity >= states.size()) {
+            throw std::runtime_error("Invalid entity");
+        }
+    }
+
+    // Trie les entités par état dans order et découpe chaque état en
+    // plages d'au plus rangeSize entités.
+    void groupByState(size_t rangeSize) {
+        std::array<size_t, stateCount + 1> offsets{};
+        for (StoredState state : states) {
+            ++offsets[state + 1];
+        }
+        for (size_t state = 0; state < stateCount; ++state) {
+            if (offsets[state + 1] > 0 && !graph->actions[state]) {
+                throw std::runtime_error("No action for current state");
+            }
+            offsets[state + 1] += offsets[state];
+        }
+        ranges.clear();
+        for (size_t state = 0; state < stateCount; ++state) {
+            for (size_t begin = offsets[state]; begin < offsets[state + 1];
+                    begin += rangeSize) {
+                ranges.push_back(Range{state, begin, std::min(begin
+                            + rangeSize, offsets[state + 1])});
+            }
+        }
+        order.resize(states.size());
+        for (size_t entity = 0; entity < states.size(); ++entity) {
+            order[offsets[states[entity]]++] = static_cast<uint32_t>(entity);
+        }
+    }
+
+    void run(const Range& range) const {
+        (*graph->actions[range.state])(std::span<const uint32_t>(
+                    order.data() + range.begin, range.end - range.begin));
+    }
+
+public:
+    /**
+     * @brief count entités dans l'état initial.
+     * @throws std::runtime_error "State not registered" - Si initial n'est
+     * pas un état du graphe
+     */
+    StateMachineBatch(std::shared_ptr<const Graph> p_graph, size_t count,
+            const TState& initial) : graph(std::move(p_graph)) {
+        if (!graph->hasState(initial)) {
+            throw std::runtime_error("State not registered");
+        }
+        if (count > UINT32_MAX) {
+            throw std::runtime_error("Invalid entity");
+        }
+        states.assign(count, static_cast<StoredState>(index(initial)));
+    }
+
+    // Ajoute une entité dans l'état state et retourne son indice.
+    uint32_t add(const TState& state) {
+        if (!graph->hasState(state)) {
+            throw std::runtime_error("State not registered");
+        }
+        if (states.size() >= UINT32_MAX) {
+            throw std::runtime_error("Invalid entity");
+        }
+        states.push_back(static_cast<StoredState>(index(state)));
+        return static_cast<uint32_t>(states.size() - 1);
+    }
+
+    size_t size() const {
+        return states.size();
+    }
+
+    TState getState(size_t entity) const {
+        checkEntity(entity);
+        return static_cast<TState>(states[entity]);
+    }
+
+    void transitionTo(size_t entity, const TState& state) {
+        checkEntity(entity);
+        if (index(state) >= stateCount) {
+            throw std::runtime_error("Invalid transition");
+        }
+        typename Graph::TransitionIndex slot = graph->transitions[
+            states[entity] * stateCount + index(state)];
+        if (slot == Graph::noTransition) {
+            throw std::runtime_error("Invalid transition");
+        }
+        graph->transitionActions[slot](static_cast<uint32_t>(entity));
+        states[entity] = static_cast<StoredState>(index(state));
+    }
+
+    /**
+     * @brief Appelle l'action de l'état courant de chaque entité. Avec
+     * threadCount > 1, les plages sont découpées pour threadCount threads et
+     * traitées par des jobs de WorkerPool::shared(), un par plage, et par le
+     * thread appelant. Les actions ne doivent pas changer l'état des
+     * entités, et updateAll() ne doit pas être appelé depuis un job du pool
+     * partagé.
+     * @throws relance la première exception levée par une action
+     */
+    void updateAll(size_t threadCount = 1) {
+        if (threadCount <= 1) {
+            groupByState(states.size() > 0 ? states.size() : 1);
+            for (const Range& range : ranges) {
+                run(range);
+            }
+            return;
+        }
+        groupByState(std::max(minRangeSize, states.size() / (4 * threadCount)
+                    + 1));
+        // Chaque job, comme le thread appelant, prend la prochaine plage
+        // libre : un job qui démarre tard n'a plus rien à faire.
+        struct Progress {
+            std::atomic<size_t> next{0};
+            size_t finished = 0;
+            std::exception_ptr error;
+            std::mutex mutex;
+            std::condition_variable done;
+        } progress;
+        auto claim = [this, &progress]() {
+            size_t i = progress.next.fetch_add(1, std::memory_order_relaxed);
+            if (i >= ranges.size()) {
+                return false;
+            }
+            try {
+                run(ranges[i]);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(progress.mutex);
+                if (!progress.error) {
+                    progress.error = std::current_exception();
+                }
+            }
+            return true;
+        };
+        size_t jobs = ranges.empty() ? 0 : ranges.size() - 1;
+        for (size_t i = 0; i < jobs; ++i) {
+            WorkerPool::shared().addJob([&claim, &progress]() {
+                claim();
+                std::lock_guard<std::mutex> lock(progress.mutex);
+                ++progress.finished;
+                progress.done.notify_one();
+            });
+        }
+        while (claim()) {
+        }
+        // Les jobs lisent progress : l'attendre même s'ils n'ont plus rien
+        // à faire.
+        std::unique_lock<std::mutex> lock(progress.mutex);
+        progress.done.wait(lock, [&progress, jobs]() {
+            return progress.finished == jobs;
+        });
+        if (progress.error) {
+            std::rethrow_exception(progress.error);
+        }
+    }
+};
+
 
 #endif
\ No newline at end of file
@@ -0,0 +1,501 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   instrumentation.hpp                                :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sdestann <sdestann@student.42perpignan.    +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/11/18 15:12:12 by sdestann          #+#    #+#             */
+/*   Updated: 2024/11/18 16:56:02 by sdestann         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef INSTRUMENTATION_HPP
+# define INSTRUMENTATION_HPP
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+# include <x86intrin.h>
+#endif
+
+// Mesures gardées par thread dans l'anneau de Trace. Chaque thread qui
+// mesure réserve 32 octets par mesure plus environ 135 Ko d'histogrammes,
+// soit environ 1,1 Mo avec la valeur par défaut. Se règle à la compilation
+// (-DLIBFTPP_TRACE_RING_SIZE=4096), une puissance de deux de préférence.
+#ifndef LIBFTPP_TRACE_RING_SIZE
+# define LIBFTPP_TRACE_RING_SIZE (1 << 15)
+#endif
+
+/**
+ * @brief Mesure du temps passé dans des portions de code, par nom : chaque
+ * mesure est ajoutée à l'histogramme de son nom et à une trace exportable
+ * au format Chrome (chrome://tracing, Perfetto).
+ *
+ * exemple :
+ *
+ * void Game::tick() {
+ *     LIBFTPP_TRACE_SCOPE("Game::tick");
+ *     ...
+ * }
+ *
+ * Trace::writeChromeTrace("trace.json");
+ * for (const Trace::Histogram& histogram : Trace::histograms()) {
+ *     std::cout << histogram.name << " " << histogram.percentile(0.99);
+ * }
+ *
+ * Les mesures ne sont faites que si LIBFTPP_TRACE est défini à la
+ * compilation (-DLIBFTPP_TRACE) : sinon les macros ne produisent aucun code.
+ * La librairie mesure elle-même Observer::notify(), StateMachine::
+ * transitionTo() et update(), Pool::acquire() et les écritures et lectures
+ * composées de DataBuffer (chaînes, conteneurs, structures décrites,
+ * compression).
+ *
+ * Le temps est lu avec RDTSC sur x86, steady_clock ailleurs. Chaque thread
+ * écrit dans son propre anneau de Trace::ringSize mesures
+ * (LIBFTPP_TRACE_RING_SIZE), sans verrou : les plus anciennes sont
+ * remplacées quand il est plein, alors que les histogrammes comptent toutes
+ * les mesures.
+ */
+class Trace {
+public:
+    static constexpr size_t ringSize = LIBFTPP_TRACE_RING_SIZE;
+    static_assert(ringSize > 0, "LIBFTPP_TRACE_RING_SIZE must be positive");
+    static constexpr size_t maxSites = 256;
+    // Mesure d'un site au-delà de maxSites : gardée dans l'anneau, mais
+    // sans histogramme.
+    static constexpr uint32_t noSite = UINT32_MAX;
+    // Le seau i compte les durées de moins de 2^i ticks.
+    static constexpr size_t bucketCount = 64;
+
+    // Portion de code mesurée : un nom, et le nom de la valeur associée à
+    // chaque mesure (nullptr si aucune).
+    class Site {
+    private:
+        uint32_t id;
+
+    public:
+        Site(const char* name, const char* valueName = nullptr)
+            : id(registry().intern(name, valueName)) {
+        }
+
+        uint32_t index() const {
+            return id;
+        }
+    };
+
+    struct Histogram {
+        std::string name;
+        uint64_t count = 0;
+        double totalNanoseconds = 0;
+        // Bornes des seaux, en nanosecondes : counts[i] mesures de moins
+        // de upperBounds[i].
+        std::array<double, bucketCount> upperBounds{};
+        std::array<uint64_t, bucketCount> counts{};
+
+        double mean() const {
+            return count ? totalNanoseconds / static_cast<double>(count) : 0;
+        }
+
+        // Borne haute, en nanosecondes, du seau qui contient la fraction
+        // rank (0.5 pour la médiane) des mesures.
+        double percentile(double rank) const {
+            uint64_t target = static_cast<uint64_t>(rank
+                    * static_cast<double>(count));
+            uint64_t seen = 0;
+            for (size_t i = 0; i < bucketCount; ++i) {
+                seen += counts[i];
+                if (seen > target || (seen == count && counts[i] > 0)) {
+                    return upperBounds[i];
+                }
+            }
+            return 0;
+        }
+    };
+
+    static uint64_t now() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return static_cast<uint64_t>(std::chrono::duration_cast<
+                std::chrono::nanoseconds>(std::chrono::steady_clock::now()
+                    .time_since_epoch()).count());
+#endif
+    }
+
+    // Ajoute une mesure commencée à start (voir now()) pour site.
+    static void record(const Site& site, uint64_t start, int64_t value = 0) {
+        uint64_t end = now();
+        localBuffer().push(site.index(), start, end > start ? end - start : 0,
+                value);
+    }
+
+    /**
+     * @brief Écrit les mesures encore dans les anneaux au format JSON de
+     * Chrome : un événement complet ("ph": "X") par mesure, avec sa valeur
+     * dans "args". Peut être appelé pendant que d'autres threads mesurent :
+     * les mesures remplacées pendant la lecture sont ignorées.
+     */
+    static void writeChromeTrace(std::ostream& output) {
+        Registry& traces = registry();
+        double nsPerTick = traces.nanosecondsPerTick();
+        std::vector<std::pair<std::string, std::string>> names
+            = traces.siteNames();
+        output << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+        bool first = true;
+        std::vector<Entry> entries;
+        for (Buffer* buffer : traces.allBuffers()) {
+            buffer->snapshot(entries);
+            for (const Entry& entry : entries) {
+                output << (first ? "\n" : ",\n");
+                first = false;
+                output << "{\"name\":";
+                writeJsonString(output, entry.site < names.size()
+                        ? names[entry.site].first : "?");
+                output << ",\"ph\":\"X\",\"pid\":1"
+                    << ",\"tid\":" << entry.thread << ",\"ts\":"
+                    << traces.microseconds(entry.start, nsPerTick)
+                    << ",\"dur\":" << static_cast<double>(entry.duration)
+                        * nsPerTick / 1000.0;
+                if (entry.site < names.size()
+                        && !names[entry.site].second.empty()) {
+                    output << ",\"args\":{";
+                    writeJsonString(output, names[entry.site].second);
+                    output << ":" << entry.value << "}";
+                }
+                output << "}";
+            }
+        }
+        output << "\n]}\n";
+    }
+
+    // @throws std::runtime_error "Cannot open file" - Si path ne peut pas
+    // être créé
+    static void writeChromeTrace(const std::string& path) {
+        std::ofstream file(path);
+        if (!file) {
+            throw std::runtime_error("Cannot open file");
+        }
+        writeChromeTrace(file);
+    }
+
+    // Histogrammes de tous les sites mesurés, additionnés sur les threads.
+    static std::vector<Histogram> histograms() {
+        Registry& traces = registry();
+        double nsPerTick = traces.nanosecondsPerTick();
+        std::vector<std::pair<std::string, std::string>> names
+            = traces.siteNames();
+        std::vector<Histogram> result(names.size());
+        for (size_t site = 0; site < names.size(); ++site) {
+            result[site].name = names[site].first;
+            for (size_t i = 0; i < bucketCount; ++i) {
+                result[site].upperBounds[i] = std::ldexp(1.0,
+                        static_cast<int>(i)) * nsPerTick;
+            }
+        }
+        for (Buffer* buffer : traces.allBuffers()) {
+            for (size_t site = 0; site < names.size(); ++site) {
+                buffer->sites[site].addTo(result[site], nsPerTick);
+            }
+        }
+        return result;
+    }
+
+private:
+    // Écrit text entre guillemets, avec les échappements de JSON.
+    static void writeJsonString(std::ostream& output, const std::string& text) {
+        static const char digits[] = "0123456789abcdef";
+        output << '"';
+        for (char character : text) {
+            unsigned char byte = static_cast<unsigned char>(character);
+            if (character == '"' || character == '\\') {
+                output << '\\' << character;
+            } else if (byte < 0x20) {
+                output << "\\u00" << digits[byte >> 4] << digits[byte & 0xf];
+            } else {
+                output << character;
+            }
+        }
+        output << '"';
+    }
+
+    struct Entry {
+        uint64_t start;
+        uint64_t duration;
+        int64_t value;
+        uint32_t site;
+        uint32_t thread;
+    };
+
+    // Mesure dans l'anneau. Les champs sont atomiques (accès relaxed) pour
+    // qu'un export puisse les lire pendant que le thread propriétaire les
+    // remplace.
+    struct Record {
+        std::atomic<uint64_t> start{0};
+        std::atomic<uint64_t> duration{0};
+        std::atomic<int64_t> value{0};
+        std::atomic<uint32_t> site{0};
+    };
+
+    // Histogramme d'un site dans un thread : seul le thread propriétaire
+    // écrit, sans opération atomique read-modify-write.
+    struct SiteCounters {
+        std::atomic<uint64_t> count{0};
+        std::atomic<uint64_t> totalTicks{0};
+        std::array<std::atomic<uint64_t>, bucketCount> buckets{};
+
+        void add(uint64_t duration) {
+            bump(count, 1);
+            bump(totalTicks, duration);
+            size_t bucket = std::min<size_t>(std::bit_width(duration),
+                    bucketCount - 1);
+            bump(buckets[bucket], 1);
+        }
+
+        void addTo(Histogram& histogram, double nsPerTick) const {
+            histogram.count += count.load(std::memory_order_relaxed);
+            histogram.totalNanoseconds += static_cast<double>(
+                    totalTicks.load(std::memory_order_relaxed)) * nsPerTick;
+            for (size_t i = 0; i < bucketCount; ++i) {
+                histogram.counts[i] += buckets[i].load(
+                        std::memory_order_relaxed);
+            }
+        }
+
+        static void bump(std::atomic<uint64_t>& counter, uint64_t amount) {
+            counter.store(counter.load(std::memory_order_relaxed) + amount,
+                    std::memory_order_relaxed);
+        }
+    };
+
+    // Anneau et histogrammes d'un thread. Un Buffer n'est jamais détruit :
+    // quand son thread se termine, il est repris par le prochain thread qui
+    // mesure, avec ses mesures.
+    struct Buffer {
+        std::atomic<uint32_t> thread{0};
+        std::atomic<bool> owned{false};
+        // Mesures commencées et terminées : l'écart permet à snapshot() de
+        // repérer celles remplacées pendant sa lecture. reserved est écrit
+        // par exchange() et relu par fetch_add(0) : soit snapshot() voit la
+        // réservation, soit ses lectures de l'anneau précèdent l'écriture.
+        mutable std::atomic<uint64_t> reserved{0};
+        std::atomic<uint64_t> committed{0};
+        std::array<Record, ringSize> records;
+        std::array<SiteCounters, maxSites> sites;
+
+        void push(uint32_t site, uint64_t start, uint64_t duration,
+                int64_t value) {
+            uint64_t index = committed.load(std::memory_order_relaxed);
+            reserved.exchange(index + 1, std::memory_order_acq_rel);
+            Record& record = records[index % ringSize];
+            record.start.store(start, std::memory_order_relaxed);
+            record.duration.store(duration, std::memory_order_relaxed);
+            record.value.store(value, std::memory_order_relaxed);
+            record.site.store(site, std::memory_order_relaxed);
+            committed.store(index + 1, std::memory_order_release);
+            if (site < maxSites) {
+                sites[site].add(duration);
+            }
+        }
+
+        void snapshot(std::vector<Entry>& output) const {
+            output.clear();
+            uint64_t end = committed.load(std::memory_order_acquire);
+            uint64_t begin = end > ringSize ? end - ringSize : 0;
+            uint32_t owner = thread.load(std::memory_order_relaxed);
+            for (uint64_t index = begin; index < end; ++index) {
+                const Record& record = records[index % ringSize];
+                output.push_back(Entry{
+                        record.start.load(std::memory_order_relaxed),
+                        record.duration.load(std::memory_order_relaxed),
+                        record.value.load(std::memory_order_relaxed),
+                        record.site.load(std::memory_order_relaxed), owner});
+            }
+            uint64_t overwritten = reserved.fetch_add(0,
+                    std::memory_order_acq_rel);
+            overwritten = overwritten > ringSize ? overwritten - ringSize : 0;
+            if (overwritten > begin) {
+                output.erase(output.begin(), output.begin() + static_cast<
+                        std::ptrdiff_t>(std::min(overwritten, end) - begin));
+            }
+        }
+    };
+
+    class Registry {
+    private:
+        mutable std::mutex mutex;
+        std::vector<std::pair<std::string, std::string>> names;
+        std::vector<std::unique_ptr<Buffer>> buffers;
+        uint32_t nextThread = 1;
+        uint64_t originTicks;
+        std::chrono::steady_clock::time_point originTime;
+
+    public:
+        Registry() : originTicks(now()),
+            originTime(std::chrono::steady_clock::now()) {
+        }
+
+        uint32_t intern(const char* name, const char* valueName) {
+            std::string value = valueName ? valueName : "";
+            std::lock_guard<std::mutex> lock(mutex);
+            for (size_t i = 0; i < names.size(); ++i) {
+                if (names[i].first == name && names[i].second == value) {
+                    return static_cast<uint32_t>(i);
+                }
+            }
+            if (names.size() == maxSites) {
+                return noSite;
+            }
+            names.emplace_back(name, value);
+            return static_cast<uint32_t>(names.size() - 1);
+        }
+
+        Buffer* claim() {
+            std::lock_guard<std::mutex> lock(mutex);
+            Buffer* buffer = nullptr;
+            for (const std::unique_ptr<Buffer>& candidate : buffers) {
+                // acquire : les écritures du thread précédent, publiées par
+                // ~LocalBuffer(), sont visibles du nouveau propriétaire.
+                if (!candidate->owned.load(std::memory_order_acquire)) {
+                    buffer = candidate.get();
+                    break;
+                }
+            }
+            if (!buffer) {
+                buffers.push_back(std::make_unique<Buffer>());
+                buffer = buffers.back().get();
+            }
+            buffer->owned.store(true, std::memory_order_relaxed);
+            buffer->thread.store(nextThread++, std::memory_order_relaxed);
+            return buffer;
+        }
+
+        std::vector<Buffer*> allBuffers() const {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::vector<Buffer*> result;
+            for (const std::unique_ptr<Buffer>& buffer : buffers) {
+                result.push_back(buffer.get());
+            }
+            return result;
+        }
+
+        std::vector<std::pair<std::string, std::string>> siteNames() const {
+            std::lock_guard<std::mutex> lock(mutex);
+            return names;
+        }
+
+        // Rapport entre ticks et nanosecondes, mesuré depuis la création du
+        // registre (au moins 10 ms, attendues en dormant si besoin).
+        double nanosecondsPerTick() const {
+#if defined(__x86_64__) || defined(__i386__)
+            std::this_thread::sleep_until(originTime
+                    + std::chrono::milliseconds(10));
+            double elapsed = static_cast<double>(std::chrono::duration_cast<
+                    std::chrono::nanoseconds>(std::chrono::steady_clock::now()
+                        - originTime).count());
+            return elapsed / static_cast<double>(now() - originTicks);
+#else
+            return 1.0;
+#endif
+        }
+
+        double microseconds(uint64_t ticks, double nsPerTick) const {
+            double sinceOrigin = ticks > originTicks
+                ? static_cast<double>(ticks - originTicks) : 0;
+            return sinceOrigin * nsPerTick / 1000.0;
+        }
+    };
+
+    // Rend son Buffer au registre quand le thread se termine.
+    struct LocalBuffer {
+        Buffer* buffer = registry().claim();
+
+        ~LocalBuffer() {
+            buffer->owned.store(false, std::memory_order_release);
+        }
+    };
+
+    // Jamais détruit, pour les mesures faites pendant la destruction des
+    // objets statiques.
+    static Registry& registry() {
+        static Registry* instance = new Registry();
+        return *instance;
+    }
+
+    static Buffer& localBuffer() {
+        thread_local LocalBuffer local;
+        return *local.buffer;
+    }
+};
+
+// Mesure la portée qui la contient, avec LIBFTPP_TRACE_SCOPE.
+class TraceScope {
+private:
+    const Trace::Site& site;
+    int64_t value;
+    uint64_t start;
+
+public:
+    TraceScope(const Trace::Site& p_site, int64_t p_value = 0)
+        : site(p_site), value(p_value), start(Trace::now()) {
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+    ~TraceScope() {
+        Trace::record(site, start, value);
+    }
+
+    // Valeur à convertir pour une mesure : les entiers et les enums sont
+    // gardés, les autres types donnent 0.
+    template<typename T>
+    static int64_t valueOf(const T& value) {
+        if constexpr (std::is_integral_v<T> || std::is_enum_v<T>) {
+            return static_cast<int64_t>(value);
+        } else if constexpr (std::is_pointer_v<T>) {
+            return static_cast<int64_t>(reinterpret_cast<intptr_t>(value));
+        } else {
+            return 0;
+        }
+    }
+};
+
+#define LIBFTPP_TRACE_CONCAT2(a, b) a##b
+#define LIBFTPP_TRACE_CONCAT(a, b) LIBFTPP_TRACE_CONCAT2(a, b)
+
+#if defined(LIBFTPP_TRACE)
+// Mesure la fin de la portée courante sous le nom name (une chaîne).
+# define LIBFTPP_TRACE_SCOPE(name) \
+    static const Trace::Site LIBFTPP_TRACE_CONCAT(traceSite, __LINE__)(name); \
+    TraceScope LIBFTPP_TRACE_CONCAT(traceScope, __LINE__)( \
+            LIBFTPP_TRACE_CONCAT(traceSite, __LINE__))
+// Comme LIBFTPP_TRACE_SCOPE, avec value (entier, enum ou pointeur) gardée
+// dans la trace sous le nom valueName.
+# define LIBFTPP_TRACE_SCOPE_VALUE(name, valueName, value) \
+    static const Trace::Site LIBFTPP_TRACE_CONCAT(traceSite, __LINE__)(name, \
+            valueName); \
+    TraceScope LIBFTPP_TRACE_CONCAT(traceScope, __LINE__)( \
+            LIBFTPP_TRACE_CONCAT(traceSite, __LINE__), \
+            TraceScope::valueOf(value))
+#else
+# define LIBFTPP_TRACE_SCOPE(name)
+# define LIBFTPP_TRACE_SCOPE_VALUE(name, valueName, value)
+#endif
+
+#endif
@@ -13,8 +13,11 @@
 #ifndef LIBFTPP_HPP
 # define LIBFTPP_HPP
 
+# include "instrumentation.hpp"
 # include "data_structures.hpp"
+# include "threading.hpp"
 # include "design_patterns.hpp"
+# include "network.hpp"
 
 // la libftpp est une librairie qui regroupe des classes et des fonctions utiles
 // pour le développement d'applications en C++.
@@ -0,0 +1,934 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   network.hpp                                        :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sdestann <sdestann@student.42perpignan.    +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/11/18 15:12:12 by sdestann          #+#    #+#             */
+/*   Updated: 2024/11/18 16:56:02 by sdestann         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef NETWORK_HPP
+# define NETWORK_HPP
+
+#include "data_structures.hpp"
+#include "design_patterns.hpp"
+#include <unordered_map>
+#include <exception>
+#include <utility>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#if defined(__linux__)
+# include <sys/epoll.h>
+#else
+# include <sys/event.h>
+#endif
+
+class Message {
+    /** @brief Message échangé par Server et Client : un type et un corps
+     * DataBuffer, écrit et lu avec << et >>.
+     *
+     * exemple :
+     *
+     * Message message(MOVE);
+     * message << x << y;
+     * client.send(message);
+     *
+     * server.defineAction(MOVE, [](long long& client, const Message& msg) {
+     *     int x, y;
+     *     msg >> x >> y;
+     * });
+     *
+     * Sur le réseau, un message est précédé d'un en-tête de 8 octets en
+     * little-endian : la taille du corps puis le type. Le corps est écrit
+     * en ByteOrder::Little, pour passer d'une architecture à l'autre. Un
+     * message reçu lit son corps directement dans le buffer de réception
+     * de la connexion : il n'est valable que pendant son callback.
+     *
+     * Type reste un int, comme dans l'interface d'origine. Les actions sont
+     * rangées dans une EventTable : les types de 0 à 255 y sont un accès
+     * indexé, les autres passent par une table de hachage.
+     */
+public:
+    using Type = int;
+
+private:
+    Type messageType;
+    // Lire un message reçu avance le curseur de son corps.
+    mutable DataBuffer body;
+
+    friend class MessageStream;
+
+    Message(Type p_type, DataBuffer p_body) : messageType(p_type),
+        body(std::move(p_body)) {
+        body.setByteOrder(DataBuffer::ByteOrder::Little);
+    }
+
+public:
+    explicit Message(Type p_type = 0) : messageType(p_type) {
+        body.setByteOrder(DataBuffer::ByteOrder::Little);
+    }
+
+    Type type() const {
+        return messageType;
+    }
+
+    // Taille du corps, en octets.
+    size_t size() const {
+        return body.size();
+    }
+
+    // Corps du message, par exemple pour setEncoding().
+    DataBuffer& buffer() {
+        return body;
+    }
+
+    const DataBuffer& buffer() const {
+        return body;
+    }
+
+    // Revient au début du corps, pour le relire.
+    void rewind() const {
+        body.rewind();
+    }
+
+    template<typename T>
+    Message& operator<<(const T& data) {
+        body << data;
+        return *this;
+    }
+
+    template<typename T>
+    const Message& operator>>(T& data) const {
+        body >> data;
+        return *this;
+    }
+};
+
+class MessageStream {
+    // Découpage des messages sur une connexion, partagé par Server et
+    // Client : en-têtes, tampons d'émission et de réception.
+public:
+    static constexpr size_t headerSize = 8;
+    // Au-delà, le message est refusé et la connexion fermée.
+    static constexpr size_t maxMessageSize = 64 * 1024 * 1024;
+    // Lecture maximale par appel système.
+    static constexpr size_t receiveSize = 64 * 1024;
+    // Un tampon plus grand que cela est libéré une fois vide : une
+    // connexion inactive ne garde que les octets inline de ses DataBuffer.
+    static constexpr size_t keptCapacity = 16 * 1024;
+
+#if defined(MSG_NOSIGNAL)
+    static constexpr int sendFlags = MSG_NOSIGNAL;
+#else
+    static constexpr int sendFlags = 0;
+#endif
+
+    // Ajoute message, en-tête compris, à la fin de output.
+    static void append(DataBuffer& output, const Message& message) {
+        const DataBuffer& body = message.body;
+        if (body.remaining() > maxMessageSize) {
+            throw std::runtime_error("Message is too large");
+        }
+        unsigned char header[headerSize];
+        store32(header, static_cast<uint32_t>(body.remaining()));
+        store32(header + 4, static_cast<uint32_t>(message.messageType));
+        output.write(header, headerSize);
+        body.forEachChunk([&output](std::span<const std::byte> chunk) {
+            output.write(chunk.data(), chunk.size());
+        });
+    }
+
+    /**
+     * @brief Envoie le plus possible de output sur fd, sans bloquer, avec
+     * DataBuffer::sendTo().
+     * @return true si tout a été envoyé
+     * @throws std::runtime_error "Send failed" - Si send() échoue
+     */
+    static bool flush(int fd, DataBuffer& output) {
+        output.sendTo(fd, sendFlags);
+        if (output.remaining() > 0) {
+            return false;
+        }
+        release(output);
+        return true;
+    }
+
+    /**
+     * @brief Reçoit ce qui est disponible sur fd, au plus maxBytes octets,
+     * et appelle dispatch(const Message&) pour chaque message complet. Les
+     * messages sont lus directement dans shared (commun à toutes les
+     * connexions) ; seul le début d'un message incomplet est gardé dans
+     * pending.
+     * @throws std::runtime_error "Connection closed" - Si le pair a fermé
+     * @throws std::runtime_error "Invalid message" - Si un en-tête annonce
+     * plus de maxMessageSize octets
+     */
+    template<typename TDispatch>
+    static void receive(int fd, DataBuffer& pending, DataBuffer& shared,
+            TDispatch&& dispatch, size_t maxBytes = SIZE_MAX) {
+        while (maxBytes > 0) {
+            // Un message déjà commencé est complété en place, pour ne pas
+            // recopier un gros message à chaque lecture.
+            DataBuffer& input = pending.remaining() > 0 ? pending : shared;
+            size_t wanted = std::min(receiveSize, maxBytes);
+            if (&input == &shared) {
+                shared.clear();
+            } else {
+                // Le tampon d'un message incomplet double avec les octets
+                // reçus, à partir de keptCapacity, au lieu de prendre la
+                // taille annoncée par l'en-tête : un client qui n'envoie
+                // qu'un en-tête ne coûte pas maxMessageSize octets.
+                pending.reserve(std::min(pending.size() + wanted, std::max(
+                                2 * pending.reserved(), keptCapacity)));
+                wanted = std::min(wanted, pending.reserved() - pending.size());
+            }
+            size_t received = input.receiveFrom(fd, wanted);
+            if (received == 0) {
+                return;
+            }
+            maxBytes -= received;
+            parse(input, dispatch);
+            if (&input == &shared && shared.remaining() > 0) {
+                const char* frame = shared.data() + (shared.size()
+                        - shared.remaining());
+                pending.clear();
+                pending.write(frame, shared.remaining());
+            } else if (&input == &pending) {
+                pending.compact();
+                release(pending);
+            }
+        }
+    }
+
+    /**
+     * @brief Appelle les actions de actions associées au type de message,
+     * avec arguments puis message. Une exception levée par une action ne
+     * concerne pas la connexion : la première est gardée dans error pour
+     * être relancée par l'appelant, les suivantes sont ignorées, et les
+     * autres actions et messages sont quand même distribués.
+     */
+    template<typename TActions, typename... TArguments>
+    static void dispatch(const TActions& actions, std::exception_ptr& error,
+            const Message& message, TArguments&... arguments) {
+        if (const auto* callbacks = actions.find(message.type())) {
+            for (const auto& action : *callbacks) {
+                message.rewind();
+                try {
+                    action(arguments..., message);
+                } catch (...) {
+                    if (!error) {
+                        error = std::current_exception();
+                    }
+                }
+            }
+        }
+    }
+
+private:
+    static void store32(unsigned char* output, uint32_t value) {
+        for (int i = 0; i < 4; ++i) {
+            output[i] = static_cast<unsigned char>(value >> (8 * i));
+        }
+    }
+
+    static uint32_t load32(const char* input) {
+        uint32_t value = 0;
+        for (int i = 0; i < 4; ++i) {
+            value |= static_cast<uint32_t>(static_cast<unsigned char>(
+                        input[i])) << (8 * i);
+        }
+        return value;
+    }
+
+    static void release(DataBuffer& buffer) {
+        if (buffer.remaining() == 0 && buffer.reserved() > keptCapacity) {
+            buffer = DataBuffer();
+        }
+    }
+
+    // Appelle dispatch pour chaque message complet de input, et consomme
+    // leurs octets.
+    template<typename TDispatch>
+    static void parse(DataBuffer& input, TDispatch& dispatch) {
+        while (input.remaining() >= headerSize) {
+            const char* frame = input.data() + (input.size()
+                    - input.remaining());
+            size_t length = load32(frame);
+            if (length > maxMessageSize) {
+                throw std::runtime_error("Invalid message");
+            }
+            if (input.remaining() - headerSize < length) {
+                return;
+            }
+            Message message(static_cast<Message::Type>(load32(frame + 4)),
+                    DataBuffer::wrap(frame + headerSize, length));
+            dispatch(message);
+            input.skip(headerSize + length);
+        }
+    }
+};
+
+class EventPoller {
+    // Attente d'événements sur des sockets : epoll sous Linux, kqueue
+    // ailleurs (BSD, macOS). Chaque fd est associé à un jeton.
+public:
+    struct Event {
+        uint64_t token;
+        bool readable;
+        bool writable;
+        bool closed;
+    };
+
+    static constexpr size_t maxEvents = 256;
+
+private:
+    int fd;
+#if defined(__linux__)
+    epoll_event events[maxEvents];
+#else
+    struct kevent events[maxEvents];
+#endif
+
+public:
+    EventPoller() {
+#if defined(__linux__)
+        fd = ::epoll_create1(EPOLL_CLOEXEC);
+#else
+        fd = ::kqueue();
+#endif
+        if (fd < 0) {
+            throw std::runtime_error("Failed to create poller");
+        }
+    }
+
+    EventPoller(const EventPoller&) = delete;
+    EventPoller& operator=(const EventPoller&) = delete;
+
+    ~EventPoller() {
+        ::close(fd);
+    }
+
+    void add(int socket, uint64_t token) {
+#if defined(__linux__)
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLRDHUP;
+        event.data.u64 = token;
+        if (::epoll_ctl(fd, EPOLL_CTL_ADD, socket, &event) < 0) {
+            throw std::runtime_error("Failed to watch socket");
+        }
+#else
+        change(socket, EVFILT_READ, EV_ADD, token);
+#endif
+    }
+
+    // Active ou non l'attente de place pour écrire sur socket.
+    void watchWrite(int socket, uint64_t token, bool enabled) {
+#if defined(__linux__)
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLRDHUP;
+        if (enabled) {
+            event.events |= EPOLLOUT;
+        }
+        event.data.u64 = token;
+        if (::epoll_ctl(fd, EPOLL_CTL_MOD, socket, &event) < 0) {
+            throw std::runtime_error("Failed to watch socket");
+        }
+#else
+        change(socket, EVFILT_WRITE, enabled ? EV_ADD : EV_DELETE, token);
+#endif
+    }
+
+    // Fermer le socket le retire aussi ; remove() est pour un socket gardé.
+    void remove(int socket) {
+#if defined(__linux__)
+        ::epoll_ctl(fd, EPOLL_CTL_DEL, socket, nullptr);
+#else
+        struct kevent changes[2];
+        EV_SET(&changes[0], socket, EVFILT_READ, EV_DELETE, 0, 0, nullptr);
+        EV_SET(&changes[1], socket, EVFILT_WRITE, EV_DELETE, 0, 0, nullptr);
+        ::kevent(fd, changes, 2, nullptr, 0, nullptr);
+#endif
+    }
+
+    /**
+     * @brief Attend au plus timeoutMs millisecondes (0 : pas d'attente) et
+     * appelle handler(const Event&) pour chaque événement.
+     * @throws std::runtime_error "Poll failed" - Si l'attente échoue
+     */
+    template<typename THandler>
+    void wait(int timeoutMs, THandler&& handler) {
+#if defined(__linux__)
+        int count = ::epoll_wait(fd, events, maxEvents, timeoutMs);
+#else
+        timespec timeout{timeoutMs / 1000, (timeoutMs % 1000) * 1000000L};
+        int count = ::kevent(fd, nullptr, 0, events, maxEvents,
+                timeoutMs < 0 ? nullptr : &timeout);
+#endif
+        if (count < 0) {
+            if (errno == EINTR) {
+                return;
+            }
+            throw std::runtime_error("Poll failed");
+        }
+        for (int i = 0; i < count; ++i) {
+#if defined(__linux__)
+            const epoll_event& event = events[i];
+            handler(Event{event.data.u64, (event.events & EPOLLIN) != 0,
+                    (event.events & EPOLLOUT) != 0, (event.events
+                        & (EPOLLHUP | EPOLLRDHUP | EPOLLERR)) != 0});
+#else
+            const struct kevent& event = events[i];
+            handler(Event{reinterpret_cast<uint64_t>(event.udata),
+                    event.filter == EVFILT_READ, event.filter == EVFILT_WRITE,
+                    (event.flags & (EV_EOF | EV_ERROR)) != 0});
+#endif
+        }
+    }
+
+private:
+#if !defined(__linux__)
+    void change(int socket, int16_t filter, uint16_t flags, uint64_t token) {
+        struct kevent event;
+        EV_SET(&event, socket, filter, flags, 0, 0,
+                reinterpret_cast<void*>(token));
+        if (::kevent(fd, &event, 1, nullptr, 0, nullptr) < 0
+                && flags != EV_DELETE) {
+            throw std::runtime_error("Failed to watch socket");
+        }
+    }
+#endif
+};
+
+class Server {
+    /** @brief Serveur TCP non bloquant qui échange des Message avec ses
+     * clients, sur une boucle d'événements (epoll ou kqueue) avancée par
+     * update().
+     *
+     * exemple :
+     *
+     * Server server;
+     * server.defineAction(PING, [&](long long& client, const Message& msg) {
+     *     server.sendTo(Message(PONG), client);
+     * });
+     * server.start(8080);
+     * while (running) {
+     *     server.update();
+     * }
+     *
+     * Les messages envoyés sont accumulés par connexion et partent en un
+     * seul send() à la fin de update() : de nombreux petits messages ne
+     * coûtent qu'un appel système. Les messages reçus sont découpés en
+     * place dans le buffer de réception et distribués par type (EventTable).
+     * Les connexions sont des objets d'un Pool : un client inactif ne coûte
+     * que sa socket et les octets inline de ses deux DataBuffer.
+     *
+     * Un update() lit au plus receiveBudget octets par client : le reste
+     * est lu aux update() suivants, et un client qui envoie sans arrêt ne
+     * retarde pas les autres.
+     *
+     * Un client qui envoie un message invalide (voir MessageStream) ou qui
+     * ferme sa connexion est déconnecté. Une exception levée par une action
+     * ne déconnecte personne : update() termine son travail (les autres
+     * messages sont distribués) puis relance la première.
+     *
+     * @throws std::runtime_error "Server already started" - Si start() est
+     * appelé deux fois
+     * @throws std::runtime_error "Failed to start server" - Si le port ne peut
+     * pas être ouvert
+     * @throws std::runtime_error "Unknown client" - Si sendTo() reçoit un
+     * identifiant inconnu
+     */
+public:
+    using ClientId = long long;
+    using Action = InplaceFunction<void(ClientId&, const Message&)>;
+
+    // Octets lus au plus par client et par update(). Le poller signale par
+    // niveau : un client qui a encore des octets est repris au suivant.
+    static constexpr size_t receiveBudget = 4 * MessageStream::receiveSize;
+
+private:
+    struct Connection {
+        int fd = -1;
+        ClientId id = 0;
+        DataBuffer pending;
+        DataBuffer output;
+        // La connexion est dans dirty, ou attend EPOLLOUT.
+        bool queued = false;
+        bool watchingWrite = false;
+    };
+    using ConnectionPool = Pool<Connection>;
+
+    // Jeton du socket d'écoute dans l'EventPoller ; les clients ont leur
+    // identifiant, à partir de 1.
+    static constexpr uint64_t listenerToken = 0;
+    // Pause du socket d'écoute quand accept() manque de ressources.
+    static constexpr std::chrono::milliseconds acceptBackoff{100};
+
+    std::unique_ptr<EventPoller> poller;
+    int listener = -1;
+    // Descripteur gardé en réserve : le libérer quand il n'en reste plus
+    // permet d'accepter un client pour le refuser aussitôt.
+    int reserve = -1;
+    // Fin de la pause du socket d'écoute, retiré du poller en attendant.
+    std::optional<std::chrono::steady_clock::time_point> acceptPaused;
+    ClientId nextId = 1;
+    ConnectionPool connectionPool;
+    std::unordered_map<ClientId, ConnectionPool::Object> connections;
+    // Connexions qui ont des messages à envoyer.
+    std::vector<ClientId> dirty;
+    std::vector<ClientId> closing;
+    DataBuffer receiveBuffer;
+    EventTable<Message::Type, std::vector<Action>> actions;
+    // Première exception levée par une action, relancée par update().
+    std::exception_ptr actionError;
+
+    Connection* find(ClientId id) {
+        auto it = connections.find(id);
+        return it != connections.end() ? &*it->second : nullptr;
+    }
+
+    // Une connexion en attente qu'accept() ne peut pas prendre garde le
+    // socket d'écoute prêt : sans réserve ni pause, update() tournerait à
+    // vide.
+    void accept() {
+        for (;;) {
+            int client = ::accept(listener, nullptr, nullptr);
+            if (client < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) {
+                    continue;
+                }
+                if ((errno == EMFILE || errno == ENFILE) && reserve >= 0) {
+                    ::close(reserve);
+                    client = ::accept(listener, nullptr, nullptr);
+                    if (client >= 0) {
+                        ::close(client);
+                    }
+                    reserve = openReserve();
+                    if (client >= 0) {
+                        continue;
+                    }
+                }
+                if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS
+                        || errno == ENOMEM) {
+                    poller->remove(listener);
+                    acceptPaused = std::chrono::steady_clock::now()
+                        + acceptBackoff;
+                }
+                return;
+            }
+            // Le socket est fermé si la connexion ne peut pas être créée ;
+            // fermé, il quitte aussi le poller.
+            try {
+                configureSocket(client);
+                ConnectionPool::Object connection = connectionPool.acquire();
+                connection->fd = client;
+                connection->id = nextId;
+                poller->add(client, static_cast<uint64_t>(connection->id));
+                connections.emplace(connection->id, std::move(connection));
+                ++nextId;
+            } catch (...) {
+                ::close(client);
+                throw;
+            }
+        }
+    }
+
+    // Seules les erreurs de la connexion (fermeture, message invalide) la
+    // ferment : l'exception d'une action est gardée pour update().
+    void receive(Connection& connection) {
+        try {
+            ClientId id = connection.id;
+            MessageStream::receive(connection.fd, connection.pending,
+                    receiveBuffer, [this, &id](const Message& message) {
+                MessageStream::dispatch(actions, actionError, message, id);
+            }, receiveBudget);
+        } catch (const std::runtime_error&) {
+            closing.push_back(connection.id);
+        }
+    }
+
+    void flush(Connection& connection) {
+        try {
+            bool done = MessageStream::flush(connection.fd, connection.output);
+            if (done != !connection.watchingWrite) {
+                connection.watchingWrite = !done;
+                poller->watchWrite(connection.fd,
+                        static_cast<uint64_t>(connection.id),
+                        connection.watchingWrite);
+            }
+            connection.queued = !done;
+        } catch (const std::runtime_error&) {
+            closing.push_back(connection.id);
+        }
+    }
+
+    void close(ClientId id) {
+        auto it = connections.find(id);
+        if (it == connections.end()) {
+            return;
+        }
+        ::close(it->second->fd);
+        connections.erase(it);
+    }
+
+    void queue(Connection& connection, const Message& message) {
+        MessageStream::append(connection.output, message);
+        if (!connection.queued) {
+            connection.queued = true;
+            dirty.push_back(connection.id);
+        }
+    }
+
+    static int openReserve() {
+        return ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+    }
+
+    // Remet le socket d'écoute dans le poller à la fin de sa pause, et
+    // retourne le temps d'attente à ne pas dépasser jusque-là.
+    int resumeAccept(int timeoutMs) {
+        if (!acceptPaused) {
+            return timeoutMs;
+        }
+        auto now = std::chrono::steady_clock::now();
+        if (now < *acceptPaused) {
+            int left = static_cast<int>(std::chrono::ceil<
+                    std::chrono::milliseconds>(*acceptPaused - now).count());
+            return timeoutMs < 0 ? left : std::min(timeoutMs, left);
+        }
+        acceptPaused.reset();
+        if (reserve < 0) {
+            reserve = openReserve();
+        }
+        poller->add(listener, listenerToken);
+        return timeoutMs;
+    }
+
+    static void configureSocket(int socket) {
+        int flags = ::fcntl(socket, F_GETFL, 0);
+        ::fcntl(socket, F_SETFL, flags | O_NONBLOCK);
+        ::fcntl(socket, F_SETFD, FD_CLOEXEC);
+        int enabled = 1;
+        ::setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &enabled,
+                sizeof(enabled));
+#if defined(SO_NOSIGPIPE)
+        ::setsockopt(socket, SOL_SOCKET, SO_NOSIGPIPE, &enabled,
+                sizeof(enabled));
+#endif
+    }
+
+public:
+    Server() {
+        connectionPool.growWhenEmpty(64);
+    }
+
+    Server(const Server&) = delete;
+    Server& operator=(const Server&) = delete;
+
+    ~Server() {
+        stop();
+    }
+
+    void start(const size_t& port) {
+        if (listener >= 0) {
+            throw std::runtime_error("Server already started");
+        }
+        int socket = ::socket(AF_INET6, SOCK_STREAM, 0);
+        if (socket < 0) {
+            throw std::runtime_error("Failed to start server");
+        }
+        int enabled = 1;
+        int disabled = 0;
+        ::setsockopt(socket, SOL_SOCKET, SO_REUSEADDR, &enabled,
+                sizeof(enabled));
+        ::setsockopt(socket, IPPROTO_IPV6, IPV6_V6ONLY, &disabled,
+                sizeof(disabled));
+        sockaddr_in6 address{};
+        address.sin6_family = AF_INET6;
+        address.sin6_addr = in6addr_any;
+        address.sin6_port = htons(static_cast<uint16_t>(port));
+        if (port > UINT16_MAX || ::bind(socket, reinterpret_cast<sockaddr*>(
+                        &address), sizeof(address)) < 0
+                || ::listen(socket, SOMAXCONN) < 0) {
+            ::close(socket);
+            throw std::runtime_error("Failed to start server");
+        }
+        configureSocket(socket);
+        poller = std::make_unique<EventPoller>();
+        poller->add(socket, listenerToken);
+        listener = socket;
+        reserve = openReserve();
+    }
+
+    // Ferme toutes les connexions et le port.
+    void stop() {
+        for (auto& [id, connection] : connections) {
+            ::close(connection->fd);
+        }
+        connections.clear();
+        dirty.clear();
+        closing.clear();
+        if (listener >= 0) {
+            ::close(listener);
+            listener = -1;
+        }
+        if (reserve >= 0) {
+            ::close(reserve);
+            reserve = -1;
+        }
+        acceptPaused.reset();
+        actionError = nullptr;
+        poller.reset();
+    }
+
+    void defineAction(const Message::Type& messageType, Action action) {
+        actions[messageType].push_back(std::move(action));
+    }
+
+    // Les messages partent à la fin du prochain update().
+    void sendTo(const Message& message, ClientId clientID) {
+        Connection* connection = find(clientID);
+        if (!connection) {
+            throw std::runtime_error("Unknown client");
+        }
+        queue(*connection, message);
+    }
+
+    void sendToArray(const Message& message,
+            const std::vector<ClientId>& clientIDs) {
+        for (ClientId id : clientIDs) {
+            sendTo(message, id);
+        }
+    }
+
+    void sendToAll(const Message& message) {
+        for (auto& [id, connection] : connections) {
+            queue(*connection, message);
+        }
+    }
+
+    // Nombre de clients connectés.
+    size_t size() const {
+        return connections.size();
+    }
+
+    /**
+     * @brief Accepte les nouveaux clients, appelle les actions des messages
+     * reçus puis envoie les messages en attente. Attend au plus timeoutMs
+     * millisecondes qu'un événement arrive (0 : pas d'attente).
+     */
+    void update(int timeoutMs = 0) {
+        if (!poller) {
+            return;
+        }
+        timeoutMs = resumeAccept(timeoutMs);
+        poller->wait(timeoutMs, [this](const EventPoller::Event& event) {
+            if (event.token == listenerToken) {
+                accept();
+                return;
+            }
+            Connection* connection = find(static_cast<ClientId>(event.token));
+            if (!connection) {
+                return;
+            }
+            if (event.readable || event.closed) {
+                receive(*connection);
+            }
+            if (event.writable) {
+                flush(*connection);
+            }
+        });
+        for (ClientId id : dirty) {
+            if (Connection* connection = find(id)) {
+                flush(*connection);
+            }
+        }
+        dirty.clear();
+        for (ClientId id : closing) {
+            close(id);
+        }
+        closing.clear();
+        if (actionError) {
+            std::rethrow_exception(std::exchange(actionError, nullptr));
+        }
+    }
+};
+
+class Client {
+    /** @brief Client TCP qui échange des Message avec un Server.
+     *
+     * exemple :
+     *
+     * Client client;
+     * client.defineAction(PONG, [](const Message& msg) { ... });
+     * client.connect("localhost", 8080);
+     * client.send(Message(PING));
+     * client.update();
+     *
+     * Comme pour Server, les messages envoyés partent ensemble au prochain
+     * update(), qui appelle aussi les actions des messages reçus.
+     *
+     * @throws std::runtime_error "Failed to connect" - Si la connexion échoue
+     * @throws std::runtime_error "Connection timed out" - Si aucune adresse
+     * n'a répondu dans le délai donné à connect()
+     * @throws std::runtime_error "Not connected" - Si send() ou update() est
+     * appelé sans connexion
+     * @throws std::runtime_error "Connection closed" - Si update() trouve la
+     * connexion fermée par le serveur ; le client est alors déconnecté
+     *
+     * Comme pour Server, update() relance la première exception levée par
+     * une action, après avoir distribué les autres messages, sans fermer la
+     * connexion.
+     */
+public:
+    using Action = InplaceFunction<void(const Message&)>;
+
+    static constexpr std::chrono::milliseconds defaultConnectTimeout{10000};
+
+private:
+    int fd = -1;
+    DataBuffer pending;
+    DataBuffer output;
+    DataBuffer receiveBuffer;
+    EventTable<Message::Type, std::vector<Action>> actions;
+
+    // Socket non bloquant et fermé par exec() dès sa création, connecté à
+    // address : le connect() en cours est attendu avec poll(), jusqu'à
+    // deadline. Retourne -1 si la connexion échoue, et met timedOut à true
+    // si c'est faute de réponse à temps.
+    static int openSocket(const addrinfo& address,
+            std::chrono::steady_clock::time_point deadline, bool& timedOut) {
+#if defined(SOCK_CLOEXEC) && defined(SOCK_NONBLOCK)
+        int socket = ::socket(address.ai_family, address.ai_socktype
+                | SOCK_CLOEXEC | SOCK_NONBLOCK, address.ai_protocol);
+#else
+        int socket = ::socket(address.ai_family, address.ai_socktype,
+                address.ai_protocol);
+        if (socket >= 0) {
+            ::fcntl(socket, F_SETFD, FD_CLOEXEC);
+            ::fcntl(socket, F_SETFL, ::fcntl(socket, F_GETFL, 0) | O_NONBLOCK);
+        }
+#endif
+        if (socket < 0) {
+            return -1;
+        }
+        if (::connect(socket, address.ai_addr, address.ai_addrlen) == 0) {
+            return socket;
+        }
+        if (errno == EINPROGRESS || errno == EINTR) {
+            pollfd waited{socket, POLLOUT, 0};
+            int ready;
+            do {
+                auto left = std::chrono::ceil<std::chrono::milliseconds>(
+                        deadline - std::chrono::steady_clock::now());
+                ready = ::poll(&waited, 1, static_cast<int>(std::max<
+                            std::chrono::milliseconds::rep>(left.count(), 0)));
+            } while (ready < 0 && errno == EINTR);
+            if (ready == 0) {
+                timedOut = true;
+            }
+            int error = 0;
+            socklen_t length = sizeof(error);
+            if (ready == 1 && ::getsockopt(socket, SOL_SOCKET, SO_ERROR,
+                        &error, &length) == 0 && error == 0) {
+                return socket;
+            }
+        }
+        ::close(socket);
+        return -1;
+    }
+
+public:
+    Client() = default;
+    Client(const Client&) = delete;
+    Client& operator=(const Client&) = delete;
+
+    ~Client() {
+        disconnect();
+    }
+
+    // Essaie chaque adresse de address tant que timeout n'est pas écoulé.
+    void connect(const std::string& address, const size_t& port,
+            std::chrono::milliseconds timeout = defaultConnectTimeout) {
+        disconnect();
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        bool timedOut = false;
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* results = nullptr;
+        std::string service = std::to_string(port);
+        if (port > UINT16_MAX || ::getaddrinfo(address.c_str(),
+                    service.c_str(), &hints, &results) != 0) {
+            throw std::runtime_error("Failed to connect");
+        }
+        for (addrinfo* result = results; result && fd < 0 && !timedOut;
+                result = result->ai_next) {
+            fd = openSocket(*result, deadline, timedOut);
+        }
+        ::freeaddrinfo(results);
+        if (fd < 0) {
+            throw std::runtime_error(timedOut ? "Connection timed out"
+                    : "Failed to connect");
+        }
+        int enabled = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enabled, sizeof(enabled));
+#if defined(SO_NOSIGPIPE)
+        ::setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &enabled, sizeof(enabled));
+#endif
+    }
+
+    void disconnect() {
+        if (fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+        pending.clear();
+        output.clear();
+    }
+
+    bool isConnected() const {
+        return fd >= 0;
+    }
+
+    void defineAction(const Message::Type& messageType, Action action) {
+        actions[messageType].push_back(std::move(action));
+    }
+
+    // Le message part au prochain update().
+    void send(const Message& message) {
+        if (fd < 0) {
+            throw std::runtime_error("Not connected");
+        }
+        MessageStream::append(output, message);
+    }
+
+    void update() {
+        if (fd < 0) {
+            throw std::runtime_error("Not connected");
+        }
+        std::exception_ptr actionError;
+        try {
+            MessageStream::receive(fd, pending, receiveBuffer,
+                    [this, &actionError](const Message& message) {
+                MessageStream::dispatch(actions, actionError, message);
+            });
+            MessageStream::flush(fd, output);
+        } catch (const std::runtime_error&) {
+            disconnect();
+            if (!actionError) {
+                throw std::runtime_error("Connection closed");
+            }
+        }
+        if (actionError) {
+            std::rethrow_exception(actionError);
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,465 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   threading.hpp                                      :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sdestann <sdestann@student.42perpignan.    +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/11/18 15:12:12 by sdestann          #+#    #+#             */
+/*   Updated: 2024/11/18 16:56:02 by sdestann         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef THREADING_HPP
+# define THREADING_HPP
+
+#include "data_structures.hpp"
+#include <thread>
+#include <exception>
+
+template<typename TType>
+class ThreadSafeQueue {
+    /** @brief File FIFO bornée, lock-free, utilisable par plusieurs
+     * producteurs et plusieurs consommateurs en même temps (file de Vyukov :
+     * chaque case porte une séquence qui indique si elle est libre ou
+     * remplie pour le tour en cours, un seul compare-and-swap par push ou
+     * pop).
+     *
+     * exemple :
+     *
+     * ThreadSafeQueue<int> queue(1024);
+     * queue.push(42);                // attend de la place si la file est pleine
+     * int value;
+     * if (queue.tryPop(value)) { ... }
+     *
+     * @throws std::runtime_error "Invalid queue size" - Si capacity vaut 0
+     * @throws std::runtime_error "Queue is empty" - Si pop() est appelé sur une
+     * file vide
+     */
+private:
+    struct alignas(64) Cell {
+        std::atomic<uint64_t> sequence;
+        alignas(TType) unsigned char storage[sizeof(TType)];
+
+        TType* value() {
+            return std::launder(reinterpret_cast<TType*>(storage));
+        }
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    size_t mask;
+    alignas(64) std::atomic<uint64_t> tail{0};
+    alignas(64) std::atomic<uint64_t> head{0};
+
+public:
+    explicit ThreadSafeQueue(size_t capacity = 1024) {
+        if (capacity == 0) {
+            throw std::runtime_error("Invalid queue size");
+        }
+        capacity = std::bit_ceil(capacity);
+        cells.reset(new Cell[capacity]);
+        mask = capacity - 1;
+        for (size_t i = 0; i < capacity; ++i) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    ThreadSafeQueue(const ThreadSafeQueue&) = delete;
+    ThreadSafeQueue& operator=(const ThreadSafeQueue&) = delete;
+
+    // Détruit sur place les éléments restants : TType n'a pas besoin d'être
+    // constructible par défaut.
+    ~ThreadSafeQueue() {
+        uint64_t last = tail.load(std::memory_order_relaxed);
+        for (uint64_t position = head.load(std::memory_order_relaxed);
+                position != last; ++position) {
+            cells[position & mask].value()->~TType();
+        }
+    }
+
+    // Ajoute value à la fin de la file, ou retourne false (sans toucher à
+    // value) si la file est pleine.
+    template<typename TArg>
+    bool tryPush(TArg&& value) {
+        uint64_t position = tail.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells[position & mask];
+            uint64_t sequence = cell.sequence.load(std::memory_order_acquire);
+            int64_t difference = static_cast<int64_t>(sequence - position);
+            if (difference < 0) {
+                return false;
+            }
+            if (difference > 0) {
+                position = tail.load(std::memory_order_relaxed);
+            } else if (tail.compare_exchange_weak(position, position + 1,
+                        std::memory_order_relaxed)) {
+                new (cell.storage) TType(std::forward<TArg>(value));
+                cell.sequence.store(position + 1, std::memory_order_release);
+                return true;
+            }
+        }
+    }
+
+    // Comme tryPush(), mais attend de la place si la file est pleine.
+    template<typename TArg>
+    void push(TArg&& value) {
+        while (!tryPush(std::forward<TArg>(value))) {
+            std::this_thread::yield();
+        }
+    }
+
+    // Retire le premier élément dans value, ou retourne false si la file
+    // est vide.
+    bool tryPop(TType& value) {
+        uint64_t position = head.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells[position & mask];
+            uint64_t sequence = cell.sequence.load(std::memory_order_acquire);
+            int64_t difference = static_cast<int64_t>(sequence
+                    - (position + 1));
+            if (difference < 0) {
+                return false;
+            }
+            if (difference > 0) {
+                position = head.load(std::memory_order_relaxed);
+            } else if (head.compare_exchange_weak(position, position + 1,
+                        std::memory_order_relaxed)) {
+                value = std::move(*cell.value());
+                cell.value()->~TType();
+                cell.sequence.store(position + mask + 1,
+                        std::memory_order_release);
+                return true;
+            }
+        }
+    }
+
+    TType pop() {
+        TType value;
+        if (!tryPop(value)) {
+            throw std::runtime_error("Queue is empty");
+        }
+        return value;
+    }
+
+    // Approximatif si d'autres threads utilisent la file.
+    bool empty() const {
+        return tail.load(std::memory_order_acquire)
+            <= head.load(std::memory_order_acquire);
+    }
+
+    size_t capacity() const {
+        return mask + 1;
+    }
+};
+
+class WorkerPool {
+    /** @brief Pool de threads qui exécute des jobs, avec vol de travail :
+     * chaque worker a sa propre deque de Chase-Lev, où il empile et dépile
+     * ses jobs sans synchronisation coûteuse, et les workers inoccupés volent
+     * les jobs des autres par l'autre bout. Les jobs ajoutés depuis un
+     * thread extérieur vont, à tour de rôle, dans la boîte de réception
+     * (ThreadSafeQueue) d'un worker : aucune file n'est partagée par tous.
+     *
+     * exemple :
+     *
+     * WorkerPool workers(4);
+     * workers.addJob([]{ ... });
+     * workers.addJob([](DataBuffer& scratch) {  // buffer propre au worker
+     *     scratch.clear();
+     *     scratch << ...;
+     * });
+     * workers.wait();                           // attend la fin des jobs
+     *
+     * Les jobs sont des InplaceFunction construits dans un Pool : une fois
+     * le pool à sa taille, ajouter un job n'alloue plus. Un job peut
+     * lui-même ajouter des jobs, qui vont alors dans la deque de son worker.
+     * Le destructeur exécute les jobs restants avant d'arrêter les workers.
+     *
+     * @throws std::runtime_error "Invalid worker count" - Si workerCount
+     * vaut 0
+     * @throws wait() relance la première exception levée par un job depuis
+     * le précédent wait()
+     */
+public:
+    using Job = InplaceFunction<void()>;
+    using ScratchJob = InplaceFunction<void(DataBuffer&)>;
+
+private:
+    // Un job vit dans le Pool tant que son Object : celui-ci est rangé dans
+    // le job lui-même pendant qu'il passe de deque en deque, et en est
+    // sorti pour le libérer.
+    struct Task {
+        Job job;
+        ScratchJob scratchJob;
+        Pool<Task>::Object self;
+    };
+
+    // Deque de Chase-Lev de taille fixe (Lê et al., "Correct and Efficient
+    // Work-Stealing for Weak Memory Models") : le worker propriétaire
+    // empile et dépile en bas, les autres volent en haut.
+    class Deque {
+    private:
+        static constexpr size_t capacity = 1024;
+        std::array<std::atomic<Task*>, capacity> tasks{};
+        alignas(64) std::atomic<int64_t> top{0};
+        alignas(64) std::atomic<int64_t> bottom{0};
+
+    public:
+        bool push(Task* task) {
+            int64_t last = bottom.load(std::memory_order_relaxed);
+            int64_t first = top.load(std::memory_order_acquire);
+            if (last - first >= static_cast<int64_t>(capacity)) {
+                return false;
+            }
+            tasks[last & (capacity - 1)].store(task, std::memory_order_relaxed);
+            bottom.store(last + 1, std::memory_order_release);
+            return true;
+        }
+
+        Task* pop() {
+            // L'écriture de bottom et la lecture de top sont seq_cst, comme
+            // les lectures de steal() : l'un des deux voit l'autre, et le
+            // compare-and-swap sur top départage le dernier job.
+            int64_t last = bottom.load(std::memory_order_relaxed) - 1;
+            bottom.store(last, std::memory_order_seq_cst);
+            int64_t first = top.load(std::memory_order_seq_cst);
+            Task* task = nullptr;
+            if (first <= last) {
+                task = tasks[last & (capacity - 1)].load(
+                        std::memory_order_relaxed);
+                if (first == last) {
+                    if (!top.compare_exchange_strong(first, first + 1,
+                                std::memory_order_seq_cst,
+                                std::memory_order_relaxed)) {
+                        task = nullptr;
+                    }
+                    bottom.store(last + 1, std::memory_order_relaxed);
+                }
+            } else {
+                bottom.store(last + 1, std::memory_order_relaxed);
+            }
+            return task;
+        }
+
+        Task* steal() {
+            int64_t first = top.load(std::memory_order_seq_cst);
+            int64_t last = bottom.load(std::memory_order_seq_cst);
+            if (first >= last) {
+                return nullptr;
+            }
+            Task* task = tasks[first & (capacity - 1)].load(
+                    std::memory_order_relaxed);
+            if (!top.compare_exchange_strong(first, first + 1,
+                        std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                return nullptr;
+            }
+            return task;
+        }
+    };
+
+    struct alignas(64) Worker {
+        Deque deque;
+        ThreadSafeQueue<Task*> inbox;
+        DataBuffer scratch;
+        std::thread thread;
+    };
+
+    // Worker du thread courant, s'il en est un.
+    struct Current {
+        WorkerPool* pool = nullptr;
+        size_t index = 0;
+    };
+
+    static Current& current() {
+        thread_local Current instance;
+        return instance;
+    }
+
+    Pool<Task> tasks;
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<size_t> nextInbox{0};
+    std::atomic<bool> stopping{false};
+    // Jobs ajoutés mais pas encore terminés, pour wait().
+    std::atomic<size_t> pending{0};
+    std::atomic<size_t> sleepers{0};
+    std::mutex sleepMutex;
+    std::condition_variable wakeUp;
+    std::condition_variable idle;
+    std::exception_ptr error;
+
+    void submit(Pool<Task>::Object object) {
+        Task* task = &*object;
+        task->self = std::move(object);
+        pending.fetch_add(1, std::memory_order_relaxed);
+        Current& worker = current();
+        if (worker.pool != this) {
+            nextWorkerInbox().push(task);
+        } else if (!workers[worker.index]->deque.push(task)
+                && !nextWorkerInbox().tryPush(task)) {
+            // Tout est plein : attendre pourrait bloquer le seul worker
+            // qui vide ces files.
+            run(task, *workers[worker.index]);
+            return;
+        }
+        wakeSleeper();
+    }
+
+    ThreadSafeQueue<Task*>& nextWorkerInbox() {
+        return workers[nextInbox.fetch_add(1, std::memory_order_relaxed)
+            % workers.size()]->inbox;
+    }
+
+    // Lecture de sleepers par un fetch_add(0), comme Pool::hasWaiters() :
+    // soit l'incrément du worker qui s'endort vient avant et il est vu ici,
+    // soit il vient après et le worker voit le job publié avant cet appel.
+    void wakeSleeper() {
+        if (sleepers.fetch_add(0, std::memory_order_acq_rel) != 0) {
+            {
+                std::lock_guard<std::mutex> lock(sleepMutex);
+            }
+            wakeUp.notify_one();
+        }
+    }
+
+    Task* find(size_t index) {
+        Worker& self = *workers[index];
+        Task* task = self.deque.pop();
+        if (task || self.inbox.tryPop(task)) {
+            return task;
+        }
+        for (size_t offset = 1; offset < workers.size(); ++offset) {
+            Worker& victim = *workers[(index + offset) % workers.size()];
+            if ((task = victim.deque.steal()) || victim.inbox.tryPop(task)) {
+                return task;
+            }
+        }
+        return nullptr;
+    }
+
+    void run(Task* task, Worker& worker) {
+        Pool<Task>::Object object = std::move(task->self);
+        try {
+            if (task->job) {
+                task->job();
+            } else {
+                task->scratchJob(worker.scratch);
+            }
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            if (!error) {
+                error = std::current_exception();
+            }
+        }
+        object = Pool<Task>::Object();
+        if (pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            {
+                std::lock_guard<std::mutex> lock(sleepMutex);
+            }
+            idle.notify_all();
+        }
+    }
+
+    void workerLoop(size_t index) {
+        current() = Current{this, index};
+        Worker& worker = *workers[index];
+        for (;;) {
+            if (Task* task = find(index)) {
+                run(task, worker);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            sleepers.fetch_add(1, std::memory_order_acq_rel);
+            Task* task = find(index);
+            while (!task && !stopping.load()) {
+                wakeUp.wait(lock);
+                task = find(index);
+            }
+            sleepers.fetch_sub(1, std::memory_order_relaxed);
+            lock.unlock();
+            if (!task) {
+                return;
+            }
+            run(task, worker);
+        }
+    }
+
+public:
+    explicit WorkerPool(size_t workerCount
+            = std::max(1u, std::thread::hardware_concurrency())) {
+        if (workerCount == 0) {
+            throw std::runtime_error("Invalid worker count");
+        }
+        tasks.growWhenEmpty(64);
+        for (size_t i = 0; i < workerCount; ++i) {
+            workers.push_back(std::make_unique<Worker>());
+        }
+        for (size_t i = 0; i < workerCount; ++i) {
+            workers[i]->thread = std::thread(&WorkerPool::workerLoop, this, i);
+        }
+    }
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    ~WorkerPool() {
+        waitIdle();
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping.store(true);
+        }
+        wakeUp.notify_all();
+        for (auto& worker : workers) {
+            worker->thread.join();
+        }
+    }
+
+    // Pool partagé par les classes de la librairie (Memento::saveAsync(),
+    // AsyncObserver), avec un worker par coeur. Jamais détruit, pour rester
+    // utilisable pendant la destruction des objets statiques.
+    static WorkerPool& shared() {
+        static WorkerPool* instance = new WorkerPool();
+        return *instance;
+    }
+
+    size_t size() const {
+        return workers.size();
+    }
+
+    template<typename TJob>
+    void addJob(TJob&& job) {
+        Pool<Task>::Object object = tasks.acquire();
+        if constexpr (std::is_invocable_v<std::decay_t<TJob>&, DataBuffer&>) {
+            object->scratchJob = std::forward<TJob>(job);
+        } else {
+            object->job = std::forward<TJob>(job);
+        }
+        submit(std::move(object));
+    }
+
+    /**
+     * @brief Attend que tous les jobs ajoutés soient terminés, y compris ceux
+     * qu'ils ajoutent. Ne doit pas être appelé depuis un job.
+     * @throws relance la première exception levée par un job
+     */
+    void wait() {
+        waitIdle();
+        std::exception_ptr thrown;
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            std::swap(thrown, error);
+        }
+        if (thrown) {
+            std::rethrow_exception(thrown);
+        }
+    }
+
+private:
+    void waitIdle() {
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        idle.wait(lock, [this]() {
+            return pending.load(std::memory_order_acquire) == 0;
+        });
+    }
+};
+
+#endif
@@ -0,0 +1,16 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   libftpp.cpp                                        :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sdestann <sdestann@student.42perpignan.    +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/11/18 10:14:36 by sdestann          #+#    #+#             */
+/*   Updated: 2024/11/18 16:35:17 by sdestann         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+// La libftpp est header-only : cette unité de compilation vérifie que
+// libftpp.hpp compile seul avec les options de la librairie, et donne un
+// objet à libftpp.a.
+#include "libftpp.hpp"
@@ -0,0 +1,823 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   data_buffer.cpp                                    :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sdestann <sdestann@student.42perpignan.    +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/11/18 15:12:12 by sdestann          #+#    #+#             */
+/*   Updated: 2024/11/18 16:56:02 by sdestann         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "test.hpp"
+#include "libftpp.hpp"
+#include <sys/socket.h>
+#include <unistd.h>
+
+TEST(dataBufferReadsWithoutErasing) {
+    DataBuffer buffer;
+    buffer << 1 << 2.5 << std::string("three");
+    size_t size = buffer.size();
+    int first;
+    double second;
+    std::string third;
+    buffer >> first >> second >> third;
+    CHECK(first == 1);
+    CHECK(second == 2.5);
+    CHECK(third == "three");
+    CHECK(buffer.size() == size);
+    CHECK(buffer.remaining() == 0);
+    buffer.rewind();
+    CHECK(buffer.remaining() == size);
+    buffer >> first;
+    CHECK(first == 1);
+}
+
+TEST(dataBufferCompactDropsReadBytes) {
+    DataBuffer buffer;
+    buffer << 1 << 2;
+    int value;
+    buffer >> value;
+    buffer.compact();
+    CHECK(buffer.size() == sizeof(int));
+    buffer << 3;
+    buffer >> value;
+    CHECK(value == 2);
+    buffer >> value;
+    CHECK(value == 3);
+    buffer.clear();
+    CHECK(buffer.size() == 0);
+    CHECK(buffer.remaining() == 0);
+}
+
+TEST(dataBufferRejectsUnderflow) {
+    DataBuffer buffer;
+    buffer << static_cast<short>(1);
+    int value = 0;
+    CHECK_THROWS(buffer >> value, "Buffer underflow");
+    // Un string dont la longueur dépasse les octets restants.
+    DataBuffer truncated;
+    truncated << std::string("truncated");
+    std::string copy(truncated.data(), truncated.size() - 1);
+    DataBuffer corrupt;
+    corrupt.write(copy.data(), copy.size());
+    std::string result;
+    CHECK_THROWS(corrupt >> result, "Buffer underflow");
+    CHECK_THROWS(corrupt.skip(copy.size() + 1), "Buffer underflow");
+}
+
+TEST(dataBufferGrowsAndReserves) {
+    DataBuffer buffer;
+    buffer.reserve(4096);
+    CHECK(buffer.reserved() >= 4096);
+    for (int i = 0; i < 10000; ++i) {
+        buffer << i;
+    }
+    CHECK(buffer.size() == 10000 * sizeof(int));
+    for (int i = 0; i < 10000; ++i) {
+        int value;
+        buffer >> value;
+        if (value != i) {
+            CHECK(value == i);
+            break;
+        }
+    }
+}
+
+// Copies et déplacements gardent les octets et la position de lecture, que
+// les octets soient en place (petit buffer) ou sur le tas.
+TEST(dataBufferCopiesAndMovesKeepCursor) {
+    for (size_t count : {size_t{4}, size_t{1000}}) {
+        DataBuffer buffer;
+        for (size_t i = 0; i < count; ++i) {
+            buffer << static_cast<int>(i);
+        }
+        int value;
+        buffer >> value;
+        DataBuffer copy(buffer);
+        DataBuffer assigned;
+        assigned = buffer;
+        DataBuffer moved(std::move(buffer));
+        for (DataBuffer* each : {&copy, &assigned, &moved}) {
+            CHECK(each->remaining() == (count - 1) * sizeof(int));
+            *each >> value;
+            CHECK(value == 1);
+        }
+        DataBuffer moveAssigned;
+        moveAssigned << 42;
+        moveAssigned = std::move(copy);
+        moveAssigned >> value;
+        CHECK(value == 2);
+    }
+}
+
+TEST(dataBufferStringViewPointsIntoBuffer) {
+    DataBuffer buffer;
+    buffer << std::string_view("hello") << std::string("world");
+    std::string_view first;
+    std::string_view second;
+    buffer >> first >> second;
+    CHECK(first == "hello");
+    CHECK(second == "world");
+    CHECK(first.data() > buffer.data());
+    CHECK(first.data() < buffer.data() + buffer.size());
+    buffer.rewind();
+    std::span<const std::byte> bytes;
+    buffer >> bytes;
+    CHECK(bytes.size() == 5);
+    CHECK(reinterpret_cast<const char*>(bytes.data()) == first.data());
+}
+
+TEST(dataBufferWrapAndViewAreReadOnly) {
+    DataBuffer source;
+    source << 1 << 2 << 3;
+    int value;
+    source >> value;
+    DataBuffer view = source.view();
+    CHECK(view.remaining() == 2 * sizeof(int));
+    view >> value;
+    CHECK(value == 2);
+    CHECK_THROWS(view << 4, "Buffer is read-only");
+    // wrap() ne copie pas la mémoire externe.
+    DataBuffer wrapped = DataBuffer::wrap(source.data(), source.size());
+    CHECK(wrapped.data() == source.data());
+    wrapped >> value;
+    CHECK(value == 1);
+    CHECK_THROWS(wrapped << 5, "Buffer is read-only");
+    // Vidée, une vue redevient un buffer accessible en écriture.
+    view.clear();
+    view << 6;
+    view >> value;
+    CHECK(value == 6);
+}
+
+namespace {
+
+// Écrit value en Encoding::Compact et retourne le nombre d'octets écrits,
+// après avoir vérifié qu'il se relit à l'identique.
+template<typename T>
+size_t compactRoundTrip(T value) {
+    DataBuffer buffer;
+    buffer.setEncoding(DataBuffer::Encoding::Compact);
+    buffer << value;
+    T result{};
+    buffer >> result;
+    CHECK(result == value);
+    CHECK(buffer.remaining() == 0);
+    return buffer.size();
+}
+
+// Buffer compact contenant les octets donnés tels quels.
+DataBuffer compactBytes(std::initializer_list<unsigned char> bytes) {
+    DataBuffer buffer;
+    buffer.setEncoding(DataBuffer::Encoding::Compact);
+    for (unsigned char byte : bytes) {
+        buffer.write(&byte, 1);
+    }
+    return buffer;
+}
+
+}
+
+TEST(dataBufferVarintRoundTrips) {
+    CHECK(compactRoundTrip<uint32_t>(0) == 1);
+    CHECK(compactRoundTrip<uint32_t>(127) == 1);
+    CHECK(compactRoundTrip<uint32_t>(128) == 2);
+    CHECK(compactRoundTrip<uint16_t>(65535) == 3);
+    CHECK(compactRoundTrip(std::numeric_limits<uint32_t>::max()) == 5);
+    CHECK(compactRoundTrip(std::numeric_limits<uint64_t>::max()) == 10);
+    CHECK(compactRoundTrip(uint64_t{1} << 55) == 8);
+    CHECK(compactRoundTrip(uint64_t{1} << 56) == 9);
+    // Zigzag : les petits négatifs restent courts.
+    CHECK(compactRoundTrip<int32_t>(-1) == 1);
+    CHECK(compactRoundTrip<int32_t>(-64) == 1);
+    CHECK(compactRoundTrip<int32_t>(-65) == 2);
+    CHECK(compactRoundTrip<int16_t>(-32768) == 3);
+    CHECK(compactRoundTrip(std::numeric_limits<int64_t>::min()) == 10);
+    CHECK(compactRoundTrip(std::numeric_limits<int64_t>::max()) == 10);
+    // La longueur d'un string est aussi un varint.
+    CHECK(compactRoundTrip(std::string("abc")) == 4);
+    // Les valeurs suivies d'autres octets, lues par le chemin sans boucle.
+    DataBuffer buffer;
+    buffer.setEncoding(DataBuffer::Encoding::Compact);
+    for (int64_t value = -100000; value <= 100000; value += 37) {
+        buffer << value << static_cast<uint64_t>(value * value);
+    }
+    for (int64_t value = -100000; value <= 100000; value += 37) {
+        int64_t signedValue;
+        uint64_t square;
+        buffer >> signedValue >> square;
+        if (signedValue != value
+                || square != static_cast<uint64_t>(value * value)) {
+            CHECK(signedValue == value);
+            break;
+        }
+    }
+}
+
+TEST(dataBufferVarintRejectsCorruptInput) {
+    // Trop long pour 64 bits.
+    DataBuffer tooLong = compactBytes({0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+            0xff, 0xff, 0xff, 0x02});
+    uint64_t value;
+    CHECK_THROWS(tooLong >> value, "Invalid varint");
+    DataBuffer eleven = compactBytes({0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+            0x80, 0x80, 0x80, 0x80, 0x00});
+    CHECK_THROWS(eleven >> value, "Invalid varint");
+    // Trop grand pour le type lu.
+    DataBuffer wide;
+    wide.setEncoding(DataBuffer::Encoding::Compact);
+    wide << uint32_t{70000} << int32_t{-40000};
+    uint16_t narrow;
+    int16_t narrowSigned;
+    CHECK_THROWS(wide >> narrow, "Invalid varint");
+    wide.rewind();
+    uint32_t skipped;
+    wide >> skipped;
+    CHECK_THROWS(wide >> narrowSigned, "Invalid varint");
+    // Tronqué : le dernier octet annonce une suite.
+    DataBuffer truncated = compactBytes({0x80, 0x80});
+    CHECK_THROWS(truncated >> value, "Buffer underflow");
+    // Une longueur de string plus grande que les octets restants.
+    DataBuffer length = compactBytes({0xff, 0xff, 0x03, 'a'});
+    std::string text;
+    CHECK_THROWS(length >> text, "Buffer underflow");
+}
+
+TEST(dataBufferContainersRoundTrip) {
+    for (DataBuffer::Encoding encoding : {DataBuffer::Encoding::Fixed,
+            DataBuffer::Encoding::Compact}) {
+        DataBuffer buffer;
+        buffer.setEncoding(encoding);
+        std::vector<int> numbers{1, -2, 300000};
+        std::vector<std::string> words{"a", "", "word"};
+        std::array<uint16_t, 3> array{7, 8, 9};
+        std::map<std::string, std::vector<double>> map{{"x", {1.5}},
+            {"y", {}}};
+        std::optional<int> some = 5;
+        std::optional<int> none;
+        const float floats[] = {0.5f, 1.5f};
+        buffer << numbers << words << array << map << some << none
+            << std::span<const float>(floats);
+        std::vector<int> numbersRead;
+        std::vector<std::string> wordsRead;
+        std::array<uint16_t, 3> arrayRead{};
+        std::map<std::string, std::vector<double>> mapRead;
+        std::optional<int> someRead;
+        std::optional<int> noneRead = 1;
+        std::vector<float> floatsRead;
+        buffer >> numbersRead >> wordsRead >> arrayRead >> mapRead
+            >> someRead >> noneRead >> floatsRead;
+        CHECK(numbersRead == numbers);
+        CHECK(wordsRead == words);
+        CHECK(arrayRead == array);
+        CHECK(mapRead == map);
+        CHECK(someRead == some);
+        CHECK(!noneRead);
+        CHECK(floatsRead == std::vector<float>(floats, floats + 2));
+        CHECK(buffer.remaining() == 0);
+    }
+}
+
+TEST(dataBufferContainersRejectHugeCounts) {
+    // Refusé avant de réserver la mémoire.
+    DataBuffer buffer;
+    buffer << (size_t{1} << 40) << 1;
+    std::vector<int> vector;
+    CHECK_THROWS(buffer >> vector, "Buffer underflow");
+    // Moins d'éléments que le nombre annoncé.
+    DataBuffer shortVector;
+    shortVector << size_t{6} << 1 << 2;
+    CHECK_THROWS(shortVector >> vector, "Buffer underflow");
+    DataBuffer map;
+    map << size_t{2} << 1 << 2 << 3;
+    std::map<int, int> mapRead;
+    CHECK_THROWS(map >> mapRead, "Buffer underflow");
+}
+
+namespace {
+
+struct Padded {
+    char tag;
+    int id;
+    double x;
+    DATABUFFER_FIELDS(Padded, tag, id, x)
+};
+
+struct Player {
+    int id;
+    std::string name;
+    Padded position;
+    std::vector<Padded> path;
+    DATABUFFER_FIELDS(Player, id, name, position, path)
+};
+
+bool operator==(const Padded& a, const Padded& b) {
+    return a.tag == b.tag && a.id == b.id && a.x == b.x;
+}
+
+}
+
+TEST(dataBufferDescribedStructsSkipPadding) {
+    DataBuffer buffer;
+    buffer << Padded{'a', 1, 2.5};
+    CHECK(buffer.size() == sizeof(char) + sizeof(int) + sizeof(double));
+    Padded padded{};
+    buffer >> padded;
+    CHECK(padded == (Padded{'a', 1, 2.5}));
+}
+
+TEST(dataBufferDescribedStructsRoundTrip) {
+    for (DataBuffer::Encoding encoding : {DataBuffer::Encoding::Fixed,
+            DataBuffer::Encoding::Compact}) {
+        DataBuffer buffer;
+        buffer.setEncoding(encoding);
+        Player player{42, "player", {'p', -3, 1.0},
+            {{'a', 1, 0.5}, {'b', 2, 1.5}}};
+        buffer << player;
+        Player read{};
+        buffer >> read;
+        CHECK(read.id == 42);
+        CHECK(read.name == "player");
+        CHECK(read.position == player.position);
+        CHECK(read.path == player.path);
+        CHECK(buffer.remaining() == 0);
+    }
+}
+
+namespace {
+
+constexpr size_t chunkSize = DataBuffer::Chunk::size;
+
+// Octets non lus d'un buffer, recopiés chunk par chunk.
+std::string unreadBytes(const DataBuffer& buffer) {
+    std::string result;
+    buffer.forEachChunk([&result](std::span<const std::byte> chunk) {
+        result.append(reinterpret_cast<const char*>(chunk.data()),
+                chunk.size());
+    });
+    return result;
+}
+
+struct Tagged {
+    uint32_t values[4];
+    uint8_t tag;
+    DATABUFFER_FIELDS(Tagged, values, tag)
+};
+
+}
+
+// Les éléments d'un tableau C suivent l'encodage et l'ordre des octets.
+TEST(dataBufferDescribedArraysFollowFormat) {
+    DataBuffer compact;
+    compact.setEncoding(DataBuffer::Encoding::Compact);
+    compact << Tagged{{1, 2, 300, 4}, 7};
+    CHECK(compact.size() == 6);
+    Tagged read{};
+    compact >> read;
+    CHECK(read.values[0] == 1 && read.values[1] == 2 && read.values[2] == 300
+            && read.values[3] == 4 && read.tag == 7);
+    DataBuffer little;
+    little.setByteOrder(DataBuffer::ByteOrder::Little);
+    little << Tagged{{0x01020304, 0, 0, 0x0a0b0c0d}, 9};
+    CHECK(little.size() == 4 * sizeof(uint32_t) + 1);
+    CHECK(unreadBytes(little).starts_with(std::string("\x04\x03\x02\x01", 4)));
+    read = {};
+    little >> read;
+    CHECK(read.values[0] == 0x01020304 && read.values[3] == 0x0a0b0c0d
+            && read.tag == 9);
+}
+
+TEST(dataBufferChunksSpanLargeWrites) {
+    DataBuffer::ChunkPool pool;
+    pool.resize(8);
+    pool.enableStatistics();
+    DataBuffer buffer;
+    buffer.useChunks(pool);
+    CHECK(buffer.isChunked());
+    std::string large(chunkSize * 2 + 100, '\0');
+    for (size_t i = 0; i < large.size(); ++i) {
+        large[i] = static_cast<char>(i * 7);
+    }
+    buffer << 1 << large << 2;
+    CHECK_THROWS(buffer.data(), "Buffer is chunked");
+    size_t chunks = 0;
+    buffer.forEachChunk([&chunks](std::span<const std::byte>) { ++chunks; });
+    CHECK(chunks == 3);
+    int first;
+    std::string read;
+    int last;
+    buffer >> first >> read >> last;
+    CHECK(first == 1);
+    CHECK(read == large);
+    CHECK(last == 2);
+    // compact() rend au pool les chunks entièrement lus, sauf le dernier.
+    buffer.compact();
+    CHECK(pool.statistics().inUse == 1);
+    buffer.clear();
+    CHECK(pool.statistics().inUse <= 1);
+}
+
+TEST(dataBufferChunksReadAcrossBoundaries) {
+    DataBuffer::ChunkPool pool;
+    pool.resize(4);
+    // Un varint et un string_view à cheval sur deux chunks : write() répartit
+    // une écriture plus grande qu'un chunk.
+    std::string raw(chunkSize + 64, 'x');
+    raw[chunkSize - 2] = static_cast<char>(0xac);
+    raw[chunkSize - 1] = static_cast<char>(0x82);
+    raw[chunkSize] = 0x01;
+    DataBuffer buffer;
+    buffer.useChunks(pool);
+    buffer.setEncoding(DataBuffer::Encoding::Compact);
+    buffer.write(raw.data(), raw.size());
+    buffer.skip(chunkSize - 2);
+    uint32_t value;
+    buffer >> value;
+    CHECK(value == 0x412c);
+    CHECK(unreadBytes(buffer) == std::string(63, 'x'));
+
+    DataBuffer text;
+    text.useChunks(pool);
+    DataBuffer header;
+    header << std::string(chunkSize, 'y');
+    text.write(header.data(), header.size());
+    std::string_view view;
+    text >> view;
+    CHECK(view == std::string(chunkSize, 'y'));
+
+    // Une vue vide pointe à la position courante, comme sans chunks.
+    DataBuffer chunked;
+    chunked.useChunks();
+    DataBuffer contiguous;
+    for (DataBuffer* buffer : {&chunked, &contiguous}) {
+        *buffer << std::string_view("abc") << std::string_view()
+            << std::string_view("d");
+        std::string_view first;
+        std::string_view empty;
+        std::string_view last;
+        *buffer >> first >> empty >> last;
+        CHECK(empty.empty());
+        // Chaque vue est précédée de sa taille, sur sizeof(size_t) octets.
+        CHECK(empty.data() == first.data() + first.size() + sizeof(size_t));
+        CHECK(last.data() == empty.data() + sizeof(size_t));
+    }
+}
+
+TEST(dataBufferChunksCopiesAreIndependent) {
+    DataBuffer::ChunkPool pool;
+    pool.resize(8);
+    DataBuffer buffer;
+    buffer.useChunks(pool);
+    buffer << std::string(chunkSize, 'a') << 1;
+    DataBuffer copy(buffer);
+    std::string text;
+    buffer >> text;
+    buffer.clear();
+    buffer << 5;
+    copy >> text;
+    CHECK(text == std::string(chunkSize, 'a'));
+    int value;
+    copy >> value;
+    CHECK(value == 1);
+    // Une vue garde les mêmes chunks et reste en lecture seule.
+    DataBuffer view = buffer.view();
+    view >> value;
+    CHECK(value == 5);
+    CHECK_THROWS(view << 1, "Buffer is read-only");
+    CHECK_THROWS(buffer.useChunks(pool), "Buffer is not empty");
+}
+
+namespace {
+
+// Paire de sockets Unix non bloquants, fermés à la destruction.
+struct SocketPair {
+    int fds[2];
+
+    SocketPair() {
+        if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds) < 0) {
+            throw std::runtime_error("socketpair failed");
+        }
+    }
+    ~SocketPair() {
+        ::close(fds[0]);
+        if (fds[1] >= 0) {
+            ::close(fds[1]);
+        }
+    }
+};
+
+}
+
+// Un buffer en chunks est envoyé par writev() en plusieurs appels quand le
+// socket est plein, et reçu par readv() dans un autre buffer en chunks.
+TEST(dataBufferSendsAndReceivesVectors) {
+    SocketPair sockets;
+    std::string payload(chunkSize * 3 + 17, '\0');
+    for (size_t i = 0; i < payload.size(); ++i) {
+        payload[i] = static_cast<char>(i * 13);
+    }
+    DataBuffer output;
+    output.useChunks();
+    output.write(payload.data(), payload.size());
+    DataBuffer input;
+    input.useChunks();
+    while (output.remaining() > 0 || input.size() < payload.size()) {
+        output.sendTo(sockets.fds[0]);
+        input.receiveFrom(sockets.fds[1], chunkSize);
+    }
+    CHECK(input.receiveFrom(sockets.fds[1]) == 0);
+    CHECK(unreadBytes(input) == payload);
+
+    DataBuffer contiguous;
+    contiguous << 1 << std::string("two");
+    CHECK(contiguous.sendTo(sockets.fds[1]) == contiguous.size());
+    CHECK(contiguous.remaining() == 0);
+    DataBuffer received;
+    CHECK(received.receiveFrom(sockets.fds[0]) == contiguous.size());
+    int number;
+    std::string text;
+    received >> number >> text;
+    CHECK(number == 1);
+    CHECK(text == "two");
+
+    ::close(sockets.fds[1]);
+    sockets.fds[1] = -1;
+    CHECK_THROWS(received.receiveFrom(sockets.fds[0]), "Connection closed");
+    CHECK_THROWS(DataBuffer().view().receiveFrom(sockets.fds[0]),
+            "Buffer is read-only");
+}
+
+namespace {
+
+// En-tête des fichiers de saveToFile() : magic sur 8 octets, version sur 4,
+// encodage, ordre des octets, compression et réservé sur 1, puis taille et
+// somme de contrôle sur 8.
+constexpr long headerSize = 32;
+constexpr long versionOffset = 8;
+constexpr long encodingOffset = 12;
+
+// Remplace les octets du fichier path à partir de offset.
+void patchFile(const std::string& path, long offset, const std::string& bytes) {
+    std::FILE* file = std::fopen(path.c_str(), "r+b");
+    std::fseek(file, offset, SEEK_SET);
+    std::fwrite(bytes.data(), 1, bytes.size(), file);
+    std::fclose(file);
+}
+
+}
+
+TEST(dataBufferFileRoundTrip) {
+    TemporaryFile file("round_trip.dat");
+    DataBuffer buffer;
+    buffer.setEncoding(DataBuffer::Encoding::Compact);
+    buffer << 1 << std::string("mapped") << std::vector<int>{4, 5};
+    int skipped;
+    buffer >> skipped;
+    // Seuls les octets non lus sont écrits.
+    buffer.saveToFile(file.path);
+    DataBuffer mapped = DataBuffer::mapFile(file.path);
+    CHECK(mapped.getEncoding() == DataBuffer::Encoding::Compact);
+    CHECK(mapped.remaining() == buffer.remaining());
+    std::string text;
+    std::vector<int> numbers;
+    mapped >> text >> numbers;
+    CHECK(text == "mapped");
+    CHECK(numbers == (std::vector<int>{4, 5}));
+    CHECK_THROWS(mapped << 1, "Buffer is read-only");
+    // Une copie garde le fichier mappé après la destruction de l'original.
+    DataBuffer copy = mapped;
+    mapped = DataBuffer();
+    copy.rewind();
+    copy >> text;
+    CHECK(text == "mapped");
+
+    DataBuffer chunked;
+    chunked.useChunks();
+    chunked << std::string(chunkSize + 10, 'c');
+    chunked.saveToFile(file.path);
+    DataBuffer chunkedMapped = DataBuffer::mapFile(file.path);
+    chunkedMapped >> text;
+    CHECK(text == std::string(chunkSize + 10, 'c'));
+}
+
+TEST(dataBufferFileRejectsCorruptFiles) {
+    TemporaryFile file("corrupt.dat");
+    CHECK_THROWS(DataBuffer::mapFile(file.path), "Cannot open file");
+    DataBuffer buffer;
+    buffer << std::string("payload");
+    buffer.saveToFile(file.path);
+    // Un octet modifié est détecté avec Checksum::Verify seulement.
+    patchFile(file.path, headerSize + 10, "P");
+    CHECK_THROWS(DataBuffer::mapFile(file.path, DataBuffer::Checksum::Verify),
+            "Checksum mismatch");
+    CHECK(DataBuffer::mapFile(file.path).remaining() == buffer.size());
+
+    buffer.saveToFile(file.path);
+    patchFile(file.path, 0, "X");
+    CHECK_THROWS(DataBuffer::mapFile(file.path), "Invalid file");
+
+    buffer.saveToFile(file.path);
+    patchFile(file.path, versionOffset, std::string("\x02", 1));
+    CHECK_THROWS(DataBuffer::mapFile(file.path), "Unsupported file version");
+
+    buffer.saveToFile(file.path);
+    patchFile(file.path, encodingOffset, std::string("\x07", 1));
+    CHECK_THROWS(DataBuffer::mapFile(file.path), "Invalid file");
+
+    // Tronqué : la taille de l'en-tête ne correspond plus au fichier.
+    buffer.saveToFile(file.path);
+    CHECK(::truncate(file.path.c_str(), headerSize + 3) == 0);
+    CHECK_THROWS(DataBuffer::mapFile(file.path), "Invalid file");
+    CHECK(::truncate(file.path.c_str(), 4) == 0);
+    CHECK_THROWS(DataBuffer::mapFile(file.path), "Invalid file");
+}
+
+// Un échec d'écriture laisse l'ancien fichier intact.
+TEST(dataBufferFileSurvivesFailedSave) {
+    TemporaryFile file("atomic.dat");
+    DataBuffer saved;
+    saved << std::string("before");
+    saved.saveToFile(file.path);
+    // Le fichier temporaire ne peut pas être créé : c'est un dossier.
+    std::string temporary = file.path + ".tmp";
+    CHECK(::mkdir(temporary.c_str(), 0700) == 0);
+    DataBuffer replacement;
+    replacement << std::string("after");
+    CHECK_THROWS(replacement.saveToFile(file.path), "Cannot open file");
+    ::rmdir(temporary.c_str());
+    std::string text;
+    DataBuffer::mapFile(file.path, DataBuffer::Checksum::Verify) >> text;
+    CHECK(text == "before");
+    // Les chunks sont écrits bout à bout, avec la même somme de contrôle.
+    DataBuffer chunked;
+    chunked.useChunks();
+    chunked << std::string(chunkSize + 13, 'c') << 7;
+    chunked.saveToFile(file.path);
+    DataBuffer mapped = DataBuffer::mapFile(file.path,
+            DataBuffer::Checksum::Verify);
+    int number;
+    mapped >> text >> number;
+    CHECK(text == std::string(chunkSize + 13, 'c') && number == 7);
+    CHECK(::access(temporary.c_str(), F_OK) != 0);
+}
+
+namespace {
+
+// Octets du buffer, dans l'ordre.
+std::vector<unsigned char> bytesOf(const DataBuffer& buffer) {
+    std::string bytes = unreadBytes(buffer);
+    return std::vector<unsigned char>(bytes.begin(), bytes.end());
+}
+
+}
+
+// Avec ByteOrder::Little, les octets écrits sont les mêmes sur toutes les
+// architectures.
+TEST(dataBufferLittleEndianWireFormat) {
+    DataBuffer buffer;
+    buffer.setByteOrder(DataBuffer::ByteOrder::Little);
+    buffer << uint32_t{0x01020304} << int16_t{-2} << 1.0f;
+    CHECK(bytesOf(buffer) == (std::vector<unsigned char>{0x04, 0x03, 0x02,
+                0x01, 0xfe, 0xff, 0x00, 0x00, 0x80, 0x3f}));
+
+    DataBuffer bulk;
+    bulk.setByteOrder(DataBuffer::ByteOrder::Little);
+    std::vector<uint16_t> values(40);
+    for (size_t i = 0; i < values.size(); ++i) {
+        values[i] = static_cast<uint16_t>(0x0100 + i);
+    }
+    bulk << values << Padded{'t', 0x0a0b0c0d, 0.0};
+    std::vector<unsigned char> bytes = bytesOf(bulk);
+    CHECK(bytes.size() == sizeof(size_t) + 80 + 13);
+    CHECK(bytes[0] == 40);
+    CHECK(bytes[sizeof(size_t)] == 0x00);
+    CHECK(bytes[sizeof(size_t) + 1] == 0x01);
+    CHECK(bytes[sizeof(size_t) + 78] == 39);
+    CHECK(bytes[sizeof(size_t) + 81] == 0x0d);
+    CHECK(bytes[sizeof(size_t) + 84] == 0x0a);
+    std::vector<uint16_t> read;
+    Padded padded{};
+    bulk >> read >> padded;
+    CHECK(read == values);
+    CHECK(padded == (Padded{'t', 0x0a0b0c0d, 0.0}));
+}
+
+namespace {
+
+// Octets pseudo-aléatoires reproductibles, donc incompressibles.
+std::string randomBytes(size_t size, uint64_t seed) {
+    std::string result(size, '\0');
+    for (size_t i = 0; i < size; ++i) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        result[i] = static_cast<char>(seed >> 56);
+    }
+    return result;
+}
+
+// Buffer contenant bytes tels quels.
+DataBuffer rawBuffer(const std::string& bytes, bool chunked = false) {
+    DataBuffer buffer;
+    if (chunked) {
+        buffer.useChunks();
+    }
+    buffer.write(bytes.data(), bytes.size());
+    return buffer;
+}
+
+}
+
+TEST(dataBufferCompressionRoundTrips) {
+    std::string text;
+    while (text.size() < 200000) {
+        text += "the quick brown fox " + std::to_string(text.size() % 97);
+    }
+    const std::string inputs[] = {"", "a", std::string(100000, 'z'), text,
+        randomBytes(100000, 1), text.substr(0, 33000) + randomBytes(40000, 2)};
+    for (const std::string& input : inputs) {
+        for (bool chunked : {false, true}) {
+            DataBuffer compressed = rawBuffer(input, chunked).compress();
+            CHECK(compressed.isCompressed());
+            CHECK(compressed.isChunked() == chunked);
+            DataBuffer output;
+            if (chunked) {
+                output.useChunks();
+            }
+            compressed.decompressTo(output);
+            CHECK(!output.isCompressed());
+            CHECK(unreadBytes(output) == input);
+        }
+    }
+    // Les données redondantes sont réellement compressées.
+    CHECK(rawBuffer(text).compress().size() < text.size() / 4);
+    CHECK(rawBuffer(randomBytes(100000, 3)).compress().size() < 100100);
+}
+
+TEST(dataBufferCompressionKeepsFormat) {
+    TemporaryFile file("compressed.dat");
+    DataBuffer buffer;
+    buffer.setEncoding(DataBuffer::Encoding::Compact);
+    buffer.setByteOrder(DataBuffer::ByteOrder::Little);
+    buffer << -5 << std::string(1000, 'q');
+    DataBuffer compressed = buffer.compress();
+    CHECK_THROWS(compressed.compress(), "Buffer is already compressed");
+    CHECK_THROWS(buffer.decompress(), "Buffer is not compressed");
+    compressed.saveToFile(file.path);
+    DataBuffer mapped = DataBuffer::mapFile(file.path);
+    CHECK(mapped.isCompressed());
+    DataBuffer output = mapped.decompress();
+    CHECK(output.getEncoding() == DataBuffer::Encoding::Compact);
+    CHECK(output.getByteOrder() == DataBuffer::ByteOrder::Little);
+    int value;
+    std::string text;
+    output >> value >> text;
+    CHECK(value == -5);
+    CHECK(text == std::string(1000, 'q'));
+}
+
+TEST(dataBufferDecompressionRejectsCorruptInput) {
+    std::string text;
+    while (text.size() < 100000) {
+        text += "corrupt me " + std::to_string(text.size() % 13);
+    }
+    DataBuffer compressed = rawBuffer(text).compress();
+    std::string bytes(compressed.data(), compressed.size());
+    // Tronqué, ou suivi d'octets en trop.
+    for (size_t size : {size_t{0}, size_t{5}, size_t{10}, size_t{14},
+            bytes.size() / 2, bytes.size() - 1}) {
+        CHECK_THROWS(DataBuffer::wrapCompressed(bytes.data(), size)
+                .decompress(), "Invalid compressed data");
+    }
+    std::string longer = bytes + "x";
+    CHECK_THROWS(DataBuffer::wrapCompressed(longer.data(), longer.size())
+            .decompress(), "Invalid compressed data");
+    // Une taille annoncée démesurée est refusée sans réserver la mémoire.
+    std::string huge = bytes;
+    uint64_t total = uint64_t(1) << 50;
+    std::memcpy(huge.data(), &total, sizeof(total));
+    CHECK_THROWS(DataBuffer::wrapCompressed(huge.data(), huge.size())
+            .decompress(), "Invalid compressed data");
+    // Plausible, mais au-delà de la limite demandée.
+    CHECK_THROWS(compressed.decompress(1000),
+            "Decompressed data is too large");
+    CHECK(compressed.decompress(text.size()).size() == text.size());
+    // Des octets modifiés au hasard sont refusés ou donnent des octets de
+    // la bonne taille, sans jamais lire ni écrire hors des buffers.
+    uint64_t seed = 7;
+    for (size_t round = 0; round < 2000; ++round) {
+        std::string corrupt = bytes;
+        for (int flip = 0; flip < 3; ++flip) {
+            seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+            size_t position = 10 + (seed >> 33) % (corrupt.size() - 10);
+            corrupt[position] = static_cast<char>(seed >> 24);
+        }
+        try {
+            DataBuffer output = DataBuffer::wrapCompressed(corrupt.data(),
+                    corrupt.size()).decompress();
+            CHECK(output.size() == text.size());
+        } catch (const std::runtime_error& error) {
+            CHECK(std::string(error.what()) == "Invalid compressed data");
+        }
+    }
+}
@@ -0,0 +1,65 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   inplace_function.cpp                               :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sdestann <sdestann@student.42perpignan.    +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/11/18 15:12:12 by sdestann          #+#    #+#             */
+/*   Updated: 2024/11/18 16:56:02 by sdestann         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "test.hpp"
+#include "libftpp.hpp"
+
+namespace {
+
+int twice(int value) {
+    return value * 2;
+}
+
+}
+
+TEST(inplaceFunctionCallsStoredCallables) {
+    InplaceFunction<int(int)> empty;
+    CHECK(!empty);
+    CHECK_THROWS(empty(1), "Empty function");
+    InplaceFunction<int(int)> pointer = twice;
+    CHECK(pointer(4) == 8);
+    int (*null)(int) = nullptr;
+    CHECK(!InplaceFunction<int(int)>(null));
+    int offset = 10;
+    InplaceFunction<int(int)> lambda = [offset](int value) {
+        return value + offset;
+    };
+    CHECK(lambda(1) == 11);
+    InplaceFunction<void(std::string&)> reference = [](std::string& text) {
+        text += "!";
+    };
+    std::string text = "hi";
+    reference(text);
+    CHECK(text == "hi!");
+}
+
+// Les callables non trivialement copiables sont copiés, déplacés et
+// détruits par leurs propres opérations.
+TEST(inplaceFunctionCopiesAndDestroysCallables) {
+    auto token = std::make_shared<int>(3);
+    {
+        InplaceFunction<int()> function = [token] { return *token; };
+        CHECK(token.use_count() == 2);
+        InplaceFunction<int()> copy = function;
+        CHECK(token.use_count() == 3);
+        InplaceFunction<int()> moved = std::move(copy);
+        CHECK(moved() == 3);
+        InplaceFunction<int()> assigned;
+        assigned = moved;
+        CHECK(assigned() == 3);
+        assigned = nullptr;
+        CHECK(!assigned);
+        function.reset();
+        CHECK(!function);
+    }
+    CHECK(token.use_count() == 1);
+}
@@ -0,0 +1,302 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   instrumentation.cpp                                :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sdestann <sdestann@student.42perpignan.    +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/11/18 15:12:12 by sdestann          #+#    #+#             */
+/*   Updated: 2024/11/18 16:56:02 by sdestann         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+// Compilé dans libftpp_tests, sans LIBFTPP_TRACE, et dans
+// libftpp_trace_tests avec -DLIBFTPP_TRACE -DLIBFTPP_TRACE_RING_SIZE=64.
+
+#include "test.hpp"
+#include "libftpp.hpp"
+#include <cctype>
+#include <cstring>
+#include <sstream>
+#include <thread>
+
+namespace {
+
+// Vérifie qu'un texte est un document JSON valide (RFC 8259), sans le
+// décoder.
+class JsonChecker {
+private:
+    const std::string& text;
+    size_t position = 0;
+
+    void skipSpaces() {
+        while (position < text.size() && std::isspace(
+                    static_cast<unsigned char>(text[position]))) {
+            ++position;
+        }
+    }
+
+    bool consume(char expected) {
+        skipSpaces();
+        if (position < text.size() && text[position] == expected) {
+            ++position;
+            return true;
+        }
+        return false;
+    }
+
+    bool string() {
+        if (!consume('"')) {
+            return false;
+        }
+        while (position < text.size()) {
+            unsigned char character = static_cast<unsigned char>(
+                    text[position++]);
+            if (character == '"') {
+                return true;
+            }
+            if (character < 0x20) {
+                return false;
+            }
+            if (character != '\\') {
+                continue;
+            }
+            if (position == text.size()) {
+                return false;
+            }
+            char escaped = text[position++];
+            if (escaped == 'u') {
+                for (int i = 0; i < 4; ++i) {
+                    if (position == text.size() || !std::isxdigit(
+                                static_cast<unsigned char>(text[position++]))) {
+                        return false;
+                    }
+                }
+            } else if (!std::strchr("\"\\/bfnrt", escaped)) {
+                return false;
+            }
+        }
+        return false;
+    }
+
+    bool number() {
+        skipSpaces();
+        size_t start = position;
+        while (position < text.size()
+                && std::strchr("+-.eE0123456789", text[position])) {
+            ++position;
+        }
+        return position > start;
+    }
+
+    bool value() {
+        skipSpaces();
+        if (position == text.size()) {
+            return false;
+        }
+        switch (text[position]) {
+            case '{':
+                ++position;
+                if (consume('}')) {
+                    return true;
+                }
+                do {
+                    if (!string() || !consume(':') || !value()) {
+                        return false;
+                    }
+                } while (consume(','));
+                return consume('}');
+            case '[':
+                ++position;
+                if (consume(']')) {
+                    return true;
+                }
+                do {
+                    if (!value()) {
+                        return false;
+                    }
+                } while (consume(','));
+                return consume(']');
+            case '"':
+                return string();
+            default:
+                return number();
+        }
+    }
+
+public:
+    explicit JsonChecker(const std::string& p_text) : text(p_text) {
+    }
+
+    bool valid() {
+        bool parsed = value();
+        skipSpaces();
+        return parsed && position == text.size();
+    }
+};
+
+std::string chromeTrace() {
+    std::ostringstream output;
+    Trace::writeChromeTrace(output);
+    return output.str();
+}
+
+size_t occurrences(const std::string& text, const std::string& pattern) {
+    size_t count = 0;
+    for (size_t found = text.find(pattern); found != std::string::npos;
+            found = text.find(pattern, found + pattern.size())) {
+        ++count;
+    }
+    return count;
+}
+
+const Trace::Histogram* histogramOf(const std::vector<Trace::Histogram>&
+        histograms, const std::string& name) {
+    for (const Trace::Histogram& histogram : histograms) {
+        if (histogram.name == name) {
+            return &histogram;
+        }
+    }
+    return nullptr;
+}
+
+enum class Signal { PING, COUNT };
+
+}
+
+// Percentiles et moyenne sur des seaux connus.
+TEST(traceHistogramPercentiles) {
+    Trace::Histogram histogram;
+    for (size_t i = 0; i < Trace::bucketCount; ++i) {
+        histogram.upperBounds[i] = static_cast<double>(1ull << i);
+    }
+    histogram.counts[2] = 50;
+    histogram.counts[5] = 40;
+    histogram.counts[9] = 10;
+    histogram.count = 100;
+    histogram.totalNanoseconds = 1000;
+    CHECK(histogram.mean() == 10);
+    CHECK(histogram.percentile(0) == 4);
+    CHECK(histogram.percentile(0.49) == 4);
+    CHECK(histogram.percentile(0.5) == 32);
+    CHECK(histogram.percentile(0.9) == 512);
+    CHECK(histogram.percentile(1) == 512);
+    CHECK(Trace::Histogram().percentile(0.5) == 0);
+    CHECK(Trace::Histogram().mean() == 0);
+}
+
+// Chaque mesure va dans le seau de sa durée.
+TEST(traceHistogramCountsEveryRecord) {
+    static const Trace::Site site("test::sleep");
+    for (int i = 0; i < 3; ++i) {
+        uint64_t start = Trace::now();
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        Trace::record(site, start);
+    }
+    std::vector<Trace::Histogram> histograms = Trace::histograms();
+    const Trace::Histogram* histogram = histogramOf(histograms,
+            "test::sleep");
+    CHECK(histogram && histogram->count == 3);
+    if (!histogram) {
+        return;
+    }
+    uint64_t bucketed = 0;
+    for (uint64_t count : histogram->counts) {
+        bucketed += count;
+    }
+    CHECK(bucketed == 3);
+    // Un seau couvre un facteur 2 : la borne haute du seau médian est au
+    // moins la durée mesurée, et au plus son double (avec de la marge pour
+    // l'horloge).
+    CHECK(histogram->mean() >= 1.9e6);
+    CHECK(histogram->percentile(0.5) >= 1.9e6);
+    CHECK(histogram->percentile(0.5) <= 4 * histogram->mean());
+}
+
+// L'anneau d'un thread garde ses ringSize dernières mesures, dans l'ordre.
+TEST(traceRingKeepsLatestRecords) {
+    static const Trace::Site site("test::ring", "index");
+    size_t total = 3 * Trace::ringSize + 5;
+    std::thread([&] {
+        for (size_t i = 0; i < total; ++i) {
+            Trace::record(site, Trace::now(), static_cast<int64_t>(i));
+        }
+    }).join();
+    std::string trace = chromeTrace();
+    CHECK(occurrences(trace, "\"name\":\"test::ring\"") == Trace::ringSize);
+    CHECK(trace.find("\"index\":" + std::to_string(total - Trace::ringSize)
+                + "}") != std::string::npos);
+    CHECK(trace.find("\"index\":" + std::to_string(total - Trace::ringSize
+                    - 1) + "}") == std::string::npos);
+    CHECK(trace.find("\"index\":" + std::to_string(total - Trace::ringSize)
+                + "}") < trace.find("\"index\":" + std::to_string(total - 1)
+                + "}"));
+    std::vector<Trace::Histogram> histograms = Trace::histograms();
+    const Trace::Histogram* histogram = histogramOf(histograms,
+            "test::ring");
+    CHECK(histogram && histogram->count == total);
+}
+
+// Les noms sont échappés : la trace reste un JSON valide.
+TEST(traceChromeExportIsValidJson) {
+    static const Trace::Site site("test::\"quoted\" \\ path\n", "a\"b");
+    Trace::record(site, Trace::now(), 7);
+    std::string trace = chromeTrace();
+    CHECK(JsonChecker(trace).valid());
+    CHECK(trace.find("\"name\":\"test::\\\"quoted\\\" \\\\ path\\u000a\"")
+            != std::string::npos);
+    CHECK(trace.find("\"args\":{\"a\\\"b\":7}") != std::string::npos);
+    CHECK(!JsonChecker("{\"name\":\"a\"b\"}").valid());
+}
+
+#if defined(LIBFTPP_TRACE)
+
+// Les portées de la librairie sont mesurées.
+TEST(traceHooksRecordLibraryCalls) {
+    auto countOf = [](const std::string& name) -> uint64_t {
+        std::vector<Trace::Histogram> histograms = Trace::histograms();
+        const Trace::Histogram* histogram = histogramOf(histograms, name);
+        return histogram ? histogram->count : 0;
+    };
+    uint64_t acquires = countOf("Pool::acquire");
+    uint64_t notifies = countOf("Observer::notify");
+    uint64_t scopes = countOf("test::scope");
+    Pool<int> pool;
+    pool.resize(4);
+    for (int i = 0; i < 10; ++i) {
+        pool.acquire(i);
+    }
+    Observer<Signal> observer;
+    observer.subscribe(Signal::PING, [] {});
+    observer.notify(Signal::PING);
+    observer.notify(Signal::PING);
+    {
+        LIBFTPP_TRACE_SCOPE_VALUE("test::scope", "value", 3);
+    }
+    CHECK(countOf("Pool::acquire") == acquires + 10);
+    CHECK(countOf("Observer::notify") == notifies + 2);
+    CHECK(countOf("test::scope") == scopes + 1);
+    CHECK(chromeTrace().find("\"name\":\"test::scope\"") != std::string::npos);
+}
+
+#else
+
+// Sans LIBFTPP_TRACE, les macros ne mesurent rien.
+TEST(traceHooksCompileOut) {
+    Pool<int> pool;
+    pool.resize(1);
+    pool.acquire(1);
+    Observer<Signal> observer;
+    observer.notify(Signal::PING);
+    {
+        LIBFTPP_TRACE_SCOPE("test::scope");
+        LIBFTPP_TRACE_SCOPE_VALUE("test::scopeValue", "value", 3);
+    }
+    std::vector<Trace::Histogram> histograms = Trace::histograms();
+    CHECK(!histogramOf(histograms, "Pool::acquire"));
+    CHECK(!histogramOf(histograms, "Observer::notify"));
+    CHECK(!histogramOf(histograms, "test::scope"));
+    CHECK(!histogramOf(histograms, "test::scopeValue"));
+}
+
+#endif
@@ -0,0 +1,48 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   main.cpp                                           :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sdestann <sdestann@student.42perpignan.    +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/11/18 15:12:12 by sdestann          #+#    #+#             */
+/*   Updated: 2024/11/18 16:56:02 by sdestann         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "test.hpp"
+#include <csignal>
+#include <cstring>
+
+// Lance les tests dont le nom contient l'argument (tous sans argument).
+// Retourne 1 si un test a échoué.
+int main(int argc, char** argv) {
+    // Les tests réseau écrivent sur des sockets fermées par l'autre côté.
+    std::signal(SIGPIPE, SIG_IGN);
+    const char* filter = argc > 1 ? argv[1] : "";
+    size_t passed = 0;
+    size_t failed = 0;
+    for (const Tests::Test& test : Tests::all()) {
+        if (!std::strstr(test.name, filter)) {
+            continue;
+        }
+        Tests::failures() = 0;
+        std::printf("%s\n", test.name);
+        std::fflush(stdout);
+        try {
+            test.function();
+        } catch (const std::exception& exception) {
+            std::printf("    %s: unexpected exception \"%s\"\n", test.file,
+                    exception.what());
+            ++Tests::failures();
+        }
+        if (Tests::failures() == 0) {
+            ++passed;
+        } else {
+            std::printf("    FAILED\n");
+            ++failed;
+        }
+    }
+    std::printf("%zu passed, %zu failed\n", passed, failed);
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,287 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   memento.cpp                                        :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sdestann <sdestann@student.42perpignan.    +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/11/18 15:12:12 by sdestann          #+#    #+#             */
+/*   Updated: 2024/11/18 16:56:02 by sdestann         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "test.hpp"
+#include "libftpp.hpp"
+
+namespace {
+
+// Des compteurs et un nom, comme un objet de jeu.
+class Player : public Memento {
+private:
+    void _saveToSnapshot(Snapshot& snapshot) override {
+        snapshot << name << counters;
+    }
+
+    void _loadFromSnapshot(Snapshot& snapshot) override {
+        snapshot >> name >> counters;
+    }
+
+public:
+    using Memento::Snapshot;
+
+    std::string name = "player";
+    std::vector<uint32_t> counters;
+
+    explicit Player(size_t size = 0) : counters(size) {
+        for (size_t i = 0; i < size; ++i) {
+            counters[i] = static_cast<uint32_t>(i);
+        }
+    }
+
+    bool operator==(const Player& other) const {
+        return name == other.name && counters == other.counters;
+    }
+};
+
+}
+
+TEST(mementoSavesAndLoadsFiles) {
+    TemporaryFile file("memento.dat");
+    Player player(1000);
+    Player::Snapshot snapshot = player.save();
+    snapshot.saveToFile(file.path);
+    Player loaded;
+    loaded.load(Player::Snapshot::loadFromFile(file.path));
+    CHECK(loaded == player);
+    // Un delta ne peut pas être écrit seul.
+    Player::Snapshot base = player.save();
+    CHECK_THROWS(player.saveDelta(base).saveToFile(file.path),
+            "Snapshot is a delta");
+}
+
+TEST(mementoDeltaChainRebuildsState) {
+    Player player(500);
+    Player::Snapshot base = player.save();
+    Player::Snapshot first = player.save();
+    std::vector<Player::Snapshot> deltas;
+    std::vector<Player> states;
+    for (size_t tick = 0; tick < 20; ++tick) {
+        player.counters[tick * 20] += 1;
+        if (tick % 5 == 4) {
+            player.counters.resize(player.counters.size() + 3, 9);
+            player.name += "!";
+        }
+        if (tick == 10) {
+            player.counters.resize(100);
+        }
+        deltas.push_back(player.saveDelta(base));
+        CHECK(deltas.back().isDelta());
+        states.push_back(player);
+    }
+    for (size_t count = 0; count <= deltas.size(); ++count) {
+        Player loaded;
+        loaded.load(first, std::span<const Player::Snapshot>(deltas.data(),
+                    count));
+        CHECK(loaded == (count == 0 ? Player(500) : states[count - 1]));
+    }
+}
+
+TEST(mementoDeltaRejectsMisuse) {
+    Player player(10);
+    Player::Snapshot base = player.save();
+    Player::Snapshot original = player.save();
+    player.counters[0] = 7;
+    Player::Snapshot delta = player.saveDelta(base);
+    CHECK_THROWS(player.load(delta), "Snapshot is a delta");
+    CHECK_THROWS(player.saveDelta(delta), "Base is a delta");
+    CHECK_THROWS(player.load(delta, std::span<const Player::Snapshot>(
+                    &original, 1)), "Base is a delta");
+    CHECK_THROWS(player.load(original, std::span<const Player::Snapshot>(
+                    &original, 1)), "Snapshot is not a delta");
+    // Un delta calculé sur un état d'une autre taille.
+    Player other(20);
+    CHECK_THROWS(other.load(other.save(), std::span<const Player::Snapshot>(
+                    &delta, 1)), "Delta does not match base");
+    // Une plage qui dépasse l'état annoncé.
+    delta << size_t{1000} << std::string("corrupt");
+    CHECK_THROWS(player.load(original, std::span<const Player::Snapshot>(
+                    &delta, 1)), "Invalid delta");
+}
+
+TEST(mementoHistoryKeepsNewestSnapshots) {
+    CHECK_THROWS(Memento::History(0, 10), "Invalid history size");
+    Memento::History history(4, 1 << 20);
+    Player player(10);
+    for (uint32_t tick = 0; tick < 10; ++tick) {
+        player.counters[0] = tick;
+        history.push(player);
+    }
+    CHECK(history.size() == 4);
+    Player loaded;
+    history.load(loaded, 0);
+    CHECK(loaded.counters[0] == 6);
+    history.load(loaded, 3);
+    CHECK(loaded.counters[0] == 9);
+    CHECK_THROWS(history.load(loaded, 4), "Invalid snapshot index");
+    history.truncate(2);
+    CHECK(history.size() == 2);
+    player.counters[0] = 100;
+    history.push(player);
+    history.load(loaded, 2);
+    CHECK(loaded.counters[0] == 100);
+    history.load(loaded, 1);
+    CHECK(loaded.counters[0] == 7);
+}
+
+TEST(mementoHistoryEvictsWhenArenaIsFull) {
+    Player player(100);
+    // Un snapshot fait un peu plus de 400 octets : trois tiennent.
+    Memento::History history(100, 1300);
+    for (uint32_t tick = 0; tick < 10; ++tick) {
+        player.counters[1] = tick;
+        history.push(player);
+        CHECK(history.size() <= 3);
+        Player loaded;
+        history.load(loaded, history.size() - 1);
+        CHECK(loaded.counters[1] == tick);
+        history.load(loaded, 0);
+        CHECK(loaded.counters[1] + history.size() - 1 == tick);
+    }
+    Player large;
+    large.counters.assign(1000, 5);
+    CHECK_THROWS(history.push(large), "Snapshot is too large");
+    CHECK(history.size() == 3);
+}
+
+namespace {
+
+// Capture qui partage une copie des compteurs : _saveToSnapshot() n'est pas
+// appelé par saveAsync().
+class SharedPlayer : public Player {
+protected:
+    std::function<void(Snapshot&)> _captureSnapshot() override {
+        ++captures;
+        return [name = name, counters = std::make_shared<const
+                std::vector<uint32_t>>(counters)](Snapshot& snapshot) {
+            snapshot << name << *counters;
+        };
+    }
+
+    void _saveToSnapshot(Snapshot& snapshot) override {
+        ++saves;
+        snapshot << name << counters;
+    }
+
+public:
+    size_t captures = 0;
+    size_t saves = 0;
+
+    using Player::Player;
+};
+
+}
+
+TEST(mementoSaveAsyncCapturesCurrentState) {
+    std::vector<std::future<Player::Snapshot>> futures;
+    std::vector<Player> expected;
+    {
+        SharedPlayer player(1000);
+        for (uint32_t tick = 0; tick < 8; ++tick) {
+            player.counters[0] = tick;
+            futures.push_back(player.saveAsync());
+            expected.push_back(player);
+        }
+        // L'objet est détruit avant que les snapshots soient écrits.
+    }
+    for (size_t i = 0; i < futures.size(); ++i) {
+        Player loaded;
+        loaded.load(futures[i].get());
+        CHECK(loaded == expected[i]);
+    }
+    // La compression se fait sur le WorkerPool.
+    SharedPlayer player(1000);
+    player.setCompression(true);
+    Player::Snapshot compressed = player.saveAsync().get();
+    CHECK(compressed.isCompressed());
+    Player loaded;
+    loaded.load(compressed);
+    CHECK(loaded == player);
+    // Sans capture redéfinie, saveAsync() ne ferait pas mieux que save().
+    CHECK_THROWS(Player().saveAsync(), "Snapshot capture is not defined");
+}
+
+TEST(mementoSaveAsyncUsesOverriddenCapture) {
+    std::vector<std::future<Player::Snapshot>> futures;
+    std::vector<Player> expected;
+    SharedPlayer player(1000);
+    for (uint32_t tick = 0; tick < 8; ++tick) {
+        player.counters[0] = tick;
+        player.setCompression(tick % 2 == 1);
+        futures.push_back(player.saveAsync());
+        expected.push_back(player);
+        player.counters.assign(1000, 0);
+    }
+    CHECK(player.captures == 8);
+    CHECK(player.saves == 0);
+    for (size_t i = 0; i < futures.size(); ++i) {
+        Player::Snapshot snapshot = futures[i].get();
+        CHECK(snapshot.isCompressed() == (i % 2 == 1));
+        Player loaded;
+        loaded.load(snapshot);
+        CHECK(loaded == expected[i]);
+    }
+}
+
+namespace {
+
+// Capture qui échoue à l'écriture, sur le thread du WorkerPool.
+class Failing : public Player {
+protected:
+    std::function<void(Snapshot&)> _captureSnapshot() override {
+        return [](Snapshot&) {
+            throw std::runtime_error("Capture failed");
+        };
+    }
+};
+
+}
+
+TEST(mementoSaveAsyncForwardsExceptions) {
+    Failing failing;
+    std::future<Player::Snapshot> future = failing.saveAsync();
+    CHECK_THROWS(future.get(), "Capture failed");
+}
+
+TEST(mementoCompressedDeltas) {
+    Player player(2000);
+    player.setCompression(true);
+    Player::Snapshot base = player.save();
+    Player::Snapshot first = player.save();
+    CHECK(first.isCompressed());
+    player.counters[3] = 0;
+    Player::Snapshot delta = player.saveDelta(base);
+    CHECK(delta.isCompressed());
+    Player loaded;
+    loaded.load(first, std::span<const Player::Snapshot>(&delta, 1));
+    CHECK(loaded == player);
+}
+
+TEST(mementoHistoryCompressesSnapshots) {
+    Player large;
+    large.counters.assign(1000, 5);
+    Memento::History history(100, 1300);
+    CHECK_THROWS(history.push(large), "Snapshot is too large");
+    // Compressés, les snapshots de large tiennent dans la zone.
+    large.setCompression(true);
+    for (uint32_t tick = 0; tick < 5; ++tick) {
+        large.counters[tick] = tick;
+        history.push(large);
+    }
+    CHECK(history.size() == 5);
+    Player loaded;
+    history.load(loaded, 0);
+    CHECK(loaded.counters[0] == 0);
+    CHECK(loaded.counters[1] == 5);
+    history.load(loaded, history.size() - 1);
+    CHECK(loaded == large);
+}
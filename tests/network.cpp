@@ -0,0 +1,399 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   network.cpp                                        :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sdestann <sdestann@student.42perpignan.    +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/11/18 15:12:12 by sdestann          #+#    #+#             */
+/*   Updated: 2024/11/18 16:56:02 by sdestann         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "test.hpp"
+#include "libftpp.hpp"
+#include <sys/resource.h>
+
+namespace {
+
+struct SocketPair {
+    int fds[2];
+
+    SocketPair() {
+        if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds) < 0) {
+            throw std::runtime_error("socketpair failed");
+        }
+    }
+    ~SocketPair() {
+        ::close(fds[0]);
+        if (fds[1] >= 0) {
+            ::close(fds[1]);
+        }
+    }
+};
+
+// Messages reçus : type et corps.
+struct Received {
+    std::vector<std::pair<int, std::string>> messages;
+    DataBuffer pending;
+    DataBuffer shared;
+
+    void receive(int fd) {
+        MessageStream::receive(fd, pending, shared, [this](const Message& m) {
+            std::string text;
+            if (m.size() > 0) {
+                m >> text;
+            }
+            messages.emplace_back(m.type(), text);
+        });
+    }
+};
+
+Message makeMessage(int type, const std::string& text) {
+    Message message(type);
+    message << text;
+    return message;
+}
+
+}
+
+// Plusieurs messages partent en un seul envoi et sont découpés à l'arrivée.
+TEST(messageStreamFramesCoalescedMessages) {
+    SocketPair sockets;
+    DataBuffer output;
+    for (int i = 0; i < 100; ++i) {
+        MessageStream::append(output, makeMessage(i, std::to_string(i)));
+    }
+    MessageStream::append(output, Message(-1));
+    CHECK(MessageStream::flush(sockets.fds[0], output));
+    CHECK(output.remaining() == 0);
+    Received received;
+    received.receive(sockets.fds[1]);
+    CHECK(received.messages.size() == 101);
+    bool exact = true;
+    for (int i = 0; i < 100; ++i) {
+        exact = exact && received.messages[static_cast<size_t>(i)]
+            == std::make_pair(i, std::to_string(i));
+    }
+    CHECK(exact);
+    CHECK(received.messages.back().first == -1);
+}
+
+// Un message qui arrive octet par octet n'est distribué qu'une fois
+// complet, et un gros message traverse un socket plein en plusieurs envois.
+TEST(messageStreamFramesSplitMessages) {
+    SocketPair sockets;
+    DataBuffer output;
+    MessageStream::append(output, makeMessage(7, "split"));
+    const std::string frame(output.data(), output.size());
+    Received received;
+    for (char byte : frame) {
+        CHECK(received.messages.empty());
+        CHECK(::send(sockets.fds[0], &byte, 1, 0) == 1);
+        received.receive(sockets.fds[1]);
+    }
+    CHECK(received.messages.size() == 1);
+    CHECK(received.messages[0] == std::make_pair(7, std::string("split")));
+
+    std::string large(3 * 1024 * 1024, 'x');
+    DataBuffer big;
+    MessageStream::append(big, makeMessage(8, large));
+    MessageStream::append(big, makeMessage(9, "after"));
+    bool sent = false;
+    while (!sent || received.messages.size() < 3) {
+        sent = sent || MessageStream::flush(sockets.fds[0], big);
+        received.receive(sockets.fds[1]);
+    }
+    CHECK(received.messages[1] == std::make_pair(8, large));
+    CHECK(received.messages[2] == std::make_pair(9, std::string("after")));
+}
+
+TEST(messageStreamRejectsInvalidFrames) {
+    SocketPair sockets;
+    Message huge(1);
+    huge.buffer().write(std::string(MessageStream::maxMessageSize + 1, 'x')
+            .data(), MessageStream::maxMessageSize + 1);
+    DataBuffer output;
+    CHECK_THROWS(MessageStream::append(output, huge), "Message is too large");
+    CHECK(output.size() == 0);
+    // Un en-tête qui annonce plus de maxMessageSize octets.
+    const unsigned char header[MessageStream::headerSize] = {0xff, 0xff, 0xff,
+        0xff, 1, 0, 0, 0};
+    CHECK(::send(sockets.fds[0], header, sizeof(header), 0) == 8);
+    Received received;
+    CHECK_THROWS(received.receive(sockets.fds[1]), "Invalid message");
+    SocketPair other;
+    ::shutdown(other.fds[0], SHUT_WR);
+    Received ended;
+    CHECK_THROWS(ended.receive(other.fds[1]), "Connection closed");
+}
+
+// Un en-tête qui annonce un gros message ne réserve pas toute sa taille :
+// le tampon grandit avec les octets reçus.
+TEST(messageStreamGrowsPendingWithReceivedBytes) {
+    SocketPair sockets;
+    const unsigned char header[MessageStream::headerSize] = {0, 0, 0, 4, 1, 0,
+        0, 0};
+    CHECK(::send(sockets.fds[0], header, sizeof(header), 0) == 8);
+    Received received;
+    received.receive(sockets.fds[1]);
+    CHECK(received.pending.remaining() == MessageStream::headerSize);
+    CHECK(received.pending.reserved() <= MessageStream::keptCapacity);
+    std::string part(3 * MessageStream::receiveSize, 'x');
+    CHECK(::send(sockets.fds[0], part.data(), part.size(), 0)
+            == static_cast<ssize_t>(part.size()));
+    for (int round = 0; round < 10; ++round) {
+        received.receive(sockets.fds[1]);
+    }
+    CHECK(received.pending.remaining() == part.size() + 8);
+    CHECK(received.pending.reserved() <= 4 * part.size());
+    CHECK(received.messages.empty());
+}
+
+namespace {
+
+// Démarre server sur un port libre et le retourne.
+size_t startServer(Server& server) {
+    for (size_t port = 42420; port < 42520; ++port) {
+        try {
+            server.start(port);
+            return port;
+        } catch (const std::runtime_error&) {
+        }
+    }
+    throw std::runtime_error("No free port");
+}
+
+}
+
+TEST(serverAndClientExchangeMessages) {
+    Server server;
+    size_t port = startServer(server);
+    server.defineAction(1, [&server](long long& client, const Message& m) {
+        std::string text;
+        m >> text;
+        server.sendTo(makeMessage(2, text + "!"), client);
+    });
+    Client client;
+    std::vector<std::string> replies;
+    client.defineAction(2, [&replies](const Message& m) {
+        std::string text;
+        m >> text;
+        replies.push_back(text);
+    });
+    client.connect("localhost", port);
+    CHECK(client.isConnected());
+    for (int i = 0; i < 10; ++i) {
+        client.send(makeMessage(1, std::to_string(i)));
+    }
+    for (int round = 0; round < 1000 && replies.size() < 10; ++round) {
+        client.update();
+        server.update(1);
+    }
+    client.update();
+    CHECK(server.size() == 1);
+    CHECK(replies.size() == 10);
+    CHECK(!replies.empty() && replies.back() == "9!");
+    CHECK_THROWS(server.sendTo(Message(2), 99), "Unknown client");
+    server.stop();
+    Client refused;
+    CHECK_THROWS(refused.connect("localhost", port), "Failed to connect");
+    CHECK(!refused.isConnected());
+}
+
+// L'exception d'une action sort de update() sans fermer la connexion, et
+// les autres messages sont quand même distribués.
+TEST(serverAndClientPropagateActionExceptions) {
+    Server server;
+    size_t port = startServer(server);
+    std::vector<int> served;
+    server.defineAction(1, [&server, &served](long long& client,
+                const Message& m) {
+        int value;
+        m >> value;
+        if (value == 0) {
+            throw std::runtime_error("server action failed");
+        }
+        served.push_back(value);
+        server.sendTo(Message(2), client);
+    });
+    Client client;
+    size_t replies = 0;
+    client.defineAction(2, [&replies](const Message&) {
+        if (++replies == 1) {
+            throw std::runtime_error("client action failed");
+        }
+    });
+    client.connect("localhost", port);
+    for (int value : {0, 1, 2}) {
+        Message message(1);
+        message << value;
+        client.send(message);
+    }
+    client.update();
+    bool thrown = false;
+    for (int round = 0; round < 1000 && served.size() < 2; ++round) {
+        try {
+            server.update(1);
+        } catch (const std::runtime_error& error) {
+            thrown = std::string(error.what()) == "server action failed";
+        }
+    }
+    CHECK(thrown);
+    CHECK(served == (std::vector<int>{1, 2}));
+    CHECK(server.size() == 1);
+    thrown = false;
+    for (int round = 0; round < 1000 && replies < 2; ++round) {
+        server.update(1);
+        try {
+            client.update();
+        } catch (const std::runtime_error& error) {
+            thrown = std::string(error.what()) == "client action failed";
+        }
+    }
+    CHECK(thrown);
+    CHECK(replies == 2);
+    CHECK(client.isConnected());
+}
+
+// receive() s'arrête après maxBytes octets, et les messages restants sont
+// lus aux appels suivants.
+TEST(messageStreamLimitsBytesPerReceive) {
+    SocketPair pair;
+    DataBuffer output;
+    std::string text(1000, 'x');
+    for (int i = 0; i < 10; ++i) {
+        MessageStream::append(output, makeMessage(i, text));
+    }
+    MessageStream::flush(pair.fds[0], output);
+    Received received;
+    MessageStream::receive(pair.fds[1], received.pending, received.shared,
+            [&received](const Message& m) {
+        received.messages.emplace_back(m.type(), "");
+    }, 2500);
+    CHECK(received.messages.size() == 2);
+    for (int round = 0; round < 10; ++round) {
+        received.receive(pair.fds[1]);
+    }
+    CHECK(received.messages.size() == 10);
+    CHECK(received.messages.back().first == 9);
+}
+
+// Un client qui envoie beaucoup ne passe pas avant les autres : chaque
+// update() lit au plus Server::receiveBudget octets par client.
+TEST(serverSharesUpdatesBetweenClients) {
+    Server server;
+    size_t port = startServer(server);
+    size_t busyMessages = 0;
+    size_t quietMessages = 0;
+    server.defineAction(1, [&busyMessages](long long&, const Message&) {
+        ++busyMessages;
+    });
+    server.defineAction(2, [&quietMessages](long long&, const Message&) {
+        ++quietMessages;
+    });
+    Client busy;
+    Client quiet;
+    busy.connect("localhost", port);
+    quiet.connect("localhost", port);
+    for (int round = 0; round < 100 && server.size() < 2; ++round) {
+        server.update(1);
+    }
+    CHECK(server.size() == 2);
+    std::string text(1000, 'x');
+    size_t sent = 4 * Server::receiveBudget / text.size();
+    for (size_t i = 0; i < sent; ++i) {
+        busy.send(makeMessage(1, text));
+    }
+    busy.update();
+    quiet.send(makeMessage(2, "hello"));
+    quiet.update();
+    server.update(100);
+    CHECK(quietMessages == 1);
+    CHECK(busyMessages > 0);
+    CHECK(busyMessages <= Server::receiveBudget / text.size());
+    for (int round = 0; round < 1000 && busyMessages < sent; ++round) {
+        busy.update();
+        server.update(1);
+    }
+    CHECK(busyMessages == sent);
+}
+
+// Un pair qui ne répond pas au connect() : la file du socket d'écoute est
+// pleine et le noyau ignore les nouvelles demandes.
+TEST(clientConnectTimesOut) {
+    int listener = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    CHECK(::bind(listener, reinterpret_cast<sockaddr*>(&address),
+                sizeof(address)) == 0);
+    CHECK(::listen(listener, 0) == 0);
+    ::getsockname(listener, reinterpret_cast<sockaddr*>(&address), &length);
+    size_t port = ntohs(address.sin_port);
+    std::vector<std::unique_ptr<Client>> queued;
+    bool timedOut = false;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 8 && !timedOut; ++i) {
+        queued.push_back(std::make_unique<Client>());
+        try {
+            queued.back()->connect("127.0.0.1", port,
+                    std::chrono::milliseconds(200));
+        } catch (const std::runtime_error& error) {
+            timedOut = std::string(error.what()) == "Connection timed out";
+            CHECK(timedOut);
+            CHECK(!queued.back()->isConnected());
+        }
+    }
+    CHECK(timedOut);
+    CHECK(std::chrono::steady_clock::now() - start < std::chrono::seconds(5));
+    ::close(listener);
+}
+
+// Sans descripteur libre, le serveur refuse les clients en attente au lieu
+// de les garder prêts sur le socket d'écoute, puis accepte à nouveau une
+// fois des descripteurs libérés.
+TEST(serverRefusesClientsWithoutDescriptors) {
+    Server server;
+    size_t port = startServer(server);
+    rlimit original{};
+    ::getrlimit(RLIMIT_NOFILE, &original);
+    // Le client attend dans la file du socket d'écoute, puis la limite est
+    // abaissée et remplie de descripteurs.
+    Client first;
+    first.connect("localhost", port);
+    int probe = ::open("/dev/null", O_RDONLY);
+    rlimit lowered = original;
+    lowered.rlim_cur = static_cast<rlim_t>(probe + 16);
+    ::close(probe);
+    ::setrlimit(RLIMIT_NOFILE, &lowered);
+    std::vector<int> fillers;
+    for (int fd; (fd = ::open("/dev/null", O_RDONLY)) >= 0; ) {
+        fillers.push_back(fd);
+    }
+    for (int round = 0; round < 10; ++round) {
+        server.update(1);
+    }
+    CHECK(server.size() == 0);
+    for (int fd : fillers) {
+        ::close(fd);
+    }
+    ::setrlimit(RLIMIT_NOFILE, &original);
+    bool closed = false;
+    for (int round = 0; round < 100 && !closed; ++round) {
+        try {
+            first.update();
+        } catch (const std::runtime_error&) {
+            closed = true;
+        }
+        server.update(1);
+    }
+    CHECK(closed);
+    Client second;
+    second.connect("localhost", port);
+    for (int round = 0; round < 100 && server.size() == 0; ++round) {
+        server.update(1);
+    }
+    CHECK(server.size() == 1);
+}
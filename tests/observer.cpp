@@ -0,0 +1,314 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   observer.cpp                                       :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sdestann <sdestann@student.42perpignan.    +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/11/18 15:12:12 by sdestann          #+#    #+#             */
+/*   Updated: 2024/11/18 16:56:02 by sdestann         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "test.hpp"
+#include "libftpp.hpp"
+
+namespace {
+
+// Avec COUNT : EventTable à base de tableau.
+enum class Dense { Died, LevelUp, COUNT };
+// Sans COUNT : EventTable à base de table de hachage.
+enum class Sparse { Died = 3, LevelUp = 100 };
+
+}
+
+TEST(observerCallsSubscribersInOrder) {
+    Observer<Dense> observer;
+    std::vector<int> calls;
+    observer.subscribe(Dense::Died, [&calls] { calls.push_back(1); });
+    observer.subscribe(Dense::Died, [&calls] { calls.push_back(2); });
+    observer.subscribe(Dense::LevelUp, [&calls] { calls.push_back(3); });
+    observer.notify(Dense::Died);
+    CHECK(calls == (std::vector<int>{1, 2}));
+    observer.notify(Dense::LevelUp);
+    CHECK(calls == (std::vector<int>{1, 2, 3}));
+    // Une valeur hors de l'enum n'a pas d'abonnés.
+    observer.notify(static_cast<Dense>(7));
+    CHECK(calls.size() == 3);
+    CHECK_THROWS(observer.subscribe(static_cast<Dense>(7), [] {}),
+            "Invalid event");
+}
+
+TEST(observerAcceptsSparseAndHashedEvents) {
+    Observer<Sparse> sparse;
+    int died = 0;
+    sparse.subscribe(Sparse::Died, [&died] { ++died; });
+    sparse.notify(Sparse::Died);
+    sparse.notify(Sparse::LevelUp);
+    CHECK(died == 1);
+
+    Observer<std::string> named;
+    std::string last;
+    named.subscribe("save", [&last] { last = "save"; });
+    named.notify("load");
+    CHECK(last.empty());
+    named.notify("save");
+    CHECK(last == "save");
+
+    // Entiers : les petites valeurs sont indexées, les autres hachées.
+    Observer<int> numbered;
+    std::vector<int> calls;
+    for (int event : {0, 3, 255, 256, -1, 1 << 20}) {
+        numbered.subscribe(event, [&calls, event] { calls.push_back(event); });
+    }
+    for (int event : {1 << 20, -1, 1, 256, 255, 3, 0, 4, -2}) {
+        numbered.notify(event);
+    }
+    CHECK(calls == (std::vector<int>{1 << 20, -1, 256, 255, 3, 0}));
+}
+
+namespace {
+
+int functionCalls = 0;
+
+void countCall() {
+    ++functionCalls;
+}
+
+}
+
+TEST(observerWithFixedCallbackType) {
+    Observer<Dense, void (*)()> observer;
+    observer.subscribe(Dense::LevelUp, countCall);
+    observer.subscribe(Dense::LevelUp, countCall);
+    observer.notify(Dense::LevelUp);
+    CHECK(functionCalls == 2);
+}
+
+TEST(concurrentObserverSubscriptionsUnsubscribe) {
+    ConcurrentObserver<Dense> observer;
+    int calls = 0;
+    auto first = observer.subscribe(Dense::Died, [&calls] { ++calls; });
+    {
+        auto second = observer.subscribe(Dense::Died, [&calls] {
+            calls += 10;
+        });
+        observer.notify(Dense::Died);
+        CHECK(calls == 11);
+    }
+    observer.notify(Dense::Died);
+    CHECK(calls == 12);
+    ConcurrentObserver<Dense>::Subscription moved = std::move(first);
+    CHECK(!first.isActive());
+    CHECK(moved.isActive());
+    moved.reset();
+    CHECK(!moved.isActive());
+    observer.notify(Dense::Died);
+    CHECK(calls == 12);
+}
+
+// Les tables retirées sont libérées quand plus aucun notify() ne les lit :
+// le callback d'un abonné désabonné est alors détruit.
+TEST(concurrentObserverReclaimsRetiredTables) {
+    ConcurrentObserver<Dense> observer;
+    auto token = std::make_shared<int>(0);
+    {
+        auto subscription = observer.subscribe(Dense::Died, [token] {
+            ++*token;
+        });
+        observer.notify(Dense::Died);
+        CHECK(token.use_count() > 1);
+    }
+    // La table retirée par le désabonnement est libérée à l'écriture
+    // suivante, aucun thread ne la lisant.
+    auto other = observer.subscribe(Dense::LevelUp, [] {});
+    CHECK(*token == 1);
+    CHECK(token.use_count() == 1);
+}
+
+// Un callback peut notifier, s'abonner et se désabonner.
+TEST(concurrentObserverAllowsReentrantCallbacks) {
+    ConcurrentObserver<Dense> observer;
+    std::vector<ConcurrentObserver<Dense>::Subscription> added;
+    ConcurrentObserver<Dense>::Subscription self;
+    int levels = 0;
+    self = observer.subscribe(Dense::Died, [&] {
+        added.push_back(observer.subscribe(Dense::LevelUp, [&levels] {
+            ++levels;
+        }));
+        observer.notify(Dense::LevelUp);
+        self.reset();
+    });
+    observer.notify(Dense::Died);
+    observer.notify(Dense::Died);
+    CHECK(added.size() == 1);
+    CHECK(levels == 1);
+}
+
+namespace {
+
+// Dernier désabonnement terminé par le thread qui s'abonne, lu par chaque
+// thread qui notifie juste avant son notify().
+std::atomic<int> lastReset{-1};
+thread_local int resetSeenAtNotify = -1;
+
+}
+
+// Des threads notifient pendant qu'un autre s'abonne et se désabonne en
+// boucle : un callback désabonné n'est plus appelé par un notify() commencé
+// après le retour de reset(), et aucune table n'est libérée pendant sa
+// lecture (vérifié par ASan).
+TEST(concurrentObserverStress) {
+    ConcurrentObserver<Dense> observer;
+    std::atomic<bool> done{false};
+    std::atomic<uint64_t> notified{0};
+    std::atomic<bool> late{false};
+    auto permanent = observer.subscribe(Dense::Died, [&notified] {
+        notified.fetch_add(1, std::memory_order_relaxed);
+    });
+    std::vector<std::thread> notifiers;
+    for (int i = 0; i < 4; ++i) {
+        notifiers.emplace_back([&] {
+            while (!done) {
+                resetSeenAtNotify = lastReset.load();
+                observer.notify(Dense::Died);
+            }
+        });
+    }
+    for (int round = 0; round < 5000; ++round) {
+        auto payload = std::make_shared<int>(round);
+        auto subscription = observer.subscribe(Dense::Died,
+                [payload, &late] {
+            if (resetSeenAtNotify >= *payload) {
+                late = true;
+            }
+        });
+        subscription.reset();
+        lastReset.store(round);
+    }
+    done = true;
+    for (std::thread& notifier : notifiers) {
+        notifier.join();
+    }
+    CHECK(notified > 0);
+    CHECK(!late);
+}
+
+TEST(asyncObserverDeliversPayloadsInOrder) {
+    CHECK_THROWS((AsyncObserver<Dense, int>(0)), "Invalid queue size");
+    WorkerPool workers(2);
+    std::vector<int> died;
+    std::vector<std::string> levels;
+    {
+        AsyncObserver<Dense, std::string> observer(8, 2, 4, workers);
+        observer.subscribe(Dense::Died, [&died](const std::string& payload) {
+            died.push_back(std::stoi(payload));
+        });
+        observer.subscribe(Dense::LevelUp, [&levels](const std::string& p) {
+            levels.push_back(p);
+        });
+        for (int i = 0; i < 100; ++i) {
+            observer.notify(Dense::Died, std::to_string(i));
+        }
+        observer.notify(Dense::LevelUp, std::string("up"));
+        observer.flush();
+        CHECK(died.size() == 100);
+        CHECK(levels == std::vector<std::string>{"up"});
+        // Le destructeur traite les événements encore en file.
+        observer.notify(Dense::Died, std::string("100"));
+    }
+    CHECK(died.size() == 101);
+    for (size_t i = 0; i < died.size(); ++i) {
+        if (died[i] != static_cast<int>(i)) {
+            CHECK(died[i] == static_cast<int>(i));
+            break;
+        }
+    }
+}
+
+TEST(asyncObserverTryNotifyFailsWhenFull) {
+    WorkerPool workers(1);
+    std::atomic<bool> release{false};
+    std::atomic<int> handled{0};
+    AsyncObserver<Dense, int> observer(2, 1, 1, workers);
+    observer.subscribe(Dense::Died, [&](const int&) {
+        while (!release) {
+            std::this_thread::yield();
+        }
+        ++handled;
+    });
+    // Le premier événement bloque le job ; les suivants remplissent la file.
+    int pushed = 0;
+    bool full = false;
+    for (int i = 0; i < 10 && !full; ++i) {
+        full = !observer.tryNotify(Dense::Died, i);
+        pushed += !full;
+    }
+    CHECK(full);
+    CHECK(pushed >= 2 && pushed <= 3);
+    release = true;
+    observer.flush();
+    CHECK(handled == pushed);
+}
+
+// Un callback peut s'abonner : il ne doit pas attendre un verrou tenu
+// pendant son propre appel.
+TEST(asyncObserverAllowsSubscribeFromCallback) {
+    WorkerPool workers(2);
+    std::atomic<int> nested{0};
+    AsyncObserver<Dense, int> observer(16, 1, 8, workers);
+    observer.subscribe(Dense::Died, [&](const int& payload) {
+        if (payload == 0) {
+            observer.subscribe(Dense::LevelUp, [&nested](const int&) {
+                ++nested;
+            });
+            observer.notify(Dense::LevelUp, 1);
+        }
+    });
+    observer.notify(Dense::Died, 0);
+    observer.flush();
+    observer.flush();
+    CHECK(nested == 1);
+}
+
+// Plusieurs producteurs : chaque événement est traité une fois, et ceux
+// d'un même producteur et d'un même type dans l'ordre de publication.
+TEST(asyncObserverMultiProducerStress) {
+    constexpr int producers = 4;
+    constexpr int perProducer = 20000;
+    WorkerPool workers(4);
+    std::atomic<uint64_t> sum{0};
+    std::atomic<bool> unordered{false};
+    std::vector<int> last(producers, -1);
+    {
+        AsyncObserver<Dense, std::pair<int, int>> observer(64, 2, 16,
+                workers);
+        for (Dense event : {Dense::Died, Dense::LevelUp}) {
+            // Une file par événement, traitée par un seul job à la fois.
+            observer.subscribe(event, [&, event](const std::pair<int, int>& p) {
+                sum += static_cast<uint64_t>(p.second);
+                if (event == Dense::Died) {
+                    if (p.second <= last[static_cast<size_t>(p.first)]) {
+                        unordered = true;
+                    }
+                    last[static_cast<size_t>(p.first)] = p.second;
+                }
+            });
+        }
+        std::vector<std::thread> threads;
+        for (int producer = 0; producer < producers; ++producer) {
+            threads.emplace_back([&observer, producer] {
+                for (int i = 0; i < perProducer; ++i) {
+                    observer.notify(i % 2 ? Dense::LevelUp : Dense::Died,
+                            std::make_pair(producer, i));
+                }
+            });
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        observer.flush();
+    }
+    CHECK(sum == uint64_t{producers} * perProducer * (perProducer - 1) / 2);
+    CHECK(!unordered);
+}
@@ -0,0 +1,472 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   pool.cpp                                           :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sdestann <sdestann@student.42perpignan.    +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/11/18 15:12:12 by sdestann          #+#    #+#             */
+/*   Updated: 2024/11/18 16:56:02 by sdestann         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "test.hpp"
+#include "libftpp.hpp"
+#include <set>
+
+namespace {
+
+// Compte les objets vivants pour vérifier construction et destruction.
+struct Tracked {
+    static inline std::atomic<int> alive{0};
+    int value;
+
+    explicit Tracked(int p_value) : value(p_value) {
+        ++alive;
+    }
+    ~Tracked() {
+        --alive;
+    }
+};
+
+constexpr size_t stressThreads = 8;
+
+}
+
+TEST(poolReusesReleasedObjects) {
+    Pool<int> pool;
+    pool.resize(2);
+    {
+        auto first = pool.acquire(1);
+        auto second = pool.acquire(2);
+        CHECK(*first == 1);
+        CHECK(*second == 2);
+        CHECK(&*first != &*second);
+        CHECK_THROWS(pool.acquire(3), "Pool is empty");
+    }
+    auto again = pool.acquire(4);
+    CHECK(*again == 4);
+}
+
+TEST(poolConstructsAndDestroysInPlace) {
+    Pool<Tracked> pool;
+    pool.resize(4);
+    CHECK(Tracked::alive == 0);
+    {
+        auto object = pool.acquire(7);
+        CHECK(Tracked::alive == 1);
+        CHECK(object->value == 7);
+        auto moved = std::move(object);
+        CHECK(!object);
+        CHECK(moved);
+        CHECK(Tracked::alive == 1);
+    }
+    CHECK(Tracked::alive == 0);
+}
+
+TEST(poolMoveAssignmentReleasesPreviousObject) {
+    Pool<Tracked> pool;
+    pool.resize(2);
+    auto first = pool.acquire(1);
+    auto second = pool.acquire(2);
+    first = std::move(second);
+    CHECK(Tracked::alive == 1);
+    CHECK(first->value == 2);
+    // L'emplacement de l'ancien first est à nouveau disponible.
+    auto third = pool.acquire(3);
+    CHECK(third->value == 3);
+}
+
+TEST(poolResizeKeepsAcquiredObjects) {
+    Pool<int> pool;
+    pool.resize(1);
+    auto first = pool.acquire(1);
+    int* address = &*first;
+    pool.resize(64);
+    std::vector<Pool<int>::Object> others;
+    for (int i = 0; i < 63; ++i) {
+        others.push_back(pool.acquire(i));
+    }
+    CHECK(&*first == address);
+    CHECK(*first == 1);
+    CHECK_THROWS(pool.acquire(0), "Pool is empty");
+}
+
+// Plusieurs threads prennent et rendent des objets en boucle ; chaque objet
+// porte le numéro de son propriétaire. Une pile corrompue (ABA) donnerait
+// le même emplacement à deux threads, ou perdrait des emplacements.
+TEST(poolStressNeverSharesAnObject) {
+    constexpr size_t capacity = 64;
+    Pool<size_t> pool;
+    pool.resize(capacity);
+    std::atomic<bool> shared{false};
+    std::vector<std::thread> threads;
+    for (size_t thread = 0; thread < stressThreads; ++thread) {
+        threads.emplace_back([&, thread] {
+            std::vector<Pool<size_t>::Object> held;
+            for (size_t round = 0; round < 20000; ++round) {
+                // Chaque thread garde au plus capacity / stressThreads
+                // objets : acquire() ne doit jamais échouer.
+                if (held.size() < capacity / stressThreads
+                        && (round % 3 != 2 || held.empty())) {
+                    held.push_back(pool.acquire(thread));
+                } else {
+                    if (*held.back() != thread) {
+                        shared = true;
+                    }
+                    held.pop_back();
+                }
+            }
+            for (auto& object : held) {
+                if (*object != thread) {
+                    shared = true;
+                }
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    CHECK(!shared);
+    // Aucun emplacement perdu ni dupliqué.
+    std::set<size_t*> addresses;
+    std::vector<Pool<size_t>::Object> all;
+    for (size_t i = 0; i < capacity; ++i) {
+        all.push_back(pool.acquire(i));
+        addresses.insert(&*all.back());
+    }
+    CHECK(addresses.size() == capacity);
+    CHECK_THROWS(pool.acquire(0), "Pool is empty");
+}
+
+TEST(poolResizeWhileOtherThreadsAcquire) {
+    Pool<int> pool;
+    pool.resize(8);
+    std::atomic<bool> done{false};
+    std::atomic<bool> corrupted{false};
+    std::vector<std::thread> threads;
+    for (size_t thread = 0; thread < 4; ++thread) {
+        threads.emplace_back([&] {
+            while (!done) {
+                auto object = pool.try_acquire(1);
+                if (object && *object != 1) {
+                    corrupted = true;
+                }
+            }
+        });
+    }
+    for (size_t i = 1; i <= 100; ++i) {
+        pool.resize(8 + 8 * i);
+    }
+    done = true;
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    CHECK(!corrupted);
+    std::vector<Pool<int>::Object> all;
+    for (int i = 0; i < 808; ++i) {
+        all.push_back(pool.acquire(i));
+    }
+    CHECK_THROWS(pool.acquire(0), "Pool is empty");
+}
+
+TEST(poolThreadCacheRejectsInvalidBatchSizes) {
+    Pool<int> pool;
+    CHECK_THROWS(pool.enableThreadCache(0), "Invalid batch size");
+    CHECK_THROWS(pool.enableThreadCache(33), "Invalid batch size");
+    pool.enableThreadCache(4);
+    CHECK_THROWS(pool.enableThreadCache(4), "Thread cache already enabled");
+}
+
+// Les indices gardés dans le cache d'un thread reviennent aux piles
+// partagées par flushThreadCache().
+TEST(poolThreadCacheFlushReturnsIndices) {
+    constexpr size_t capacity = 256;
+    Pool<size_t> pool;
+    pool.resize(capacity);
+    pool.enableThreadCache(8);
+    std::atomic<bool> shared{false};
+    std::vector<std::thread> threads;
+    for (size_t thread = 0; thread < stressThreads; ++thread) {
+        threads.emplace_back([&, thread] {
+            std::vector<Pool<size_t>::Object> held;
+            for (size_t round = 0; round < 20000; ++round) {
+                // Au plus 2 * batchSize indices en cache par thread, plus
+                // ceux tenus : le pool ne se vide jamais.
+                if (held.size() < 8 && (round % 5 < 3 || held.empty())) {
+                    held.push_back(pool.acquire(thread));
+                } else {
+                    if (*held.back() != thread) {
+                        shared = true;
+                    }
+                    held.pop_back();
+                }
+            }
+            held.clear();
+            pool.flushThreadCache();
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    CHECK(!shared);
+    std::set<size_t*> addresses;
+    std::vector<Pool<size_t>::Object> all;
+    for (size_t i = 0; i < capacity; ++i) {
+        all.push_back(pool.acquire(i));
+        addresses.insert(&*all.back());
+    }
+    CHECK(addresses.size() == capacity);
+    CHECK_THROWS(pool.acquire(0), "Pool is empty");
+}
+
+// Le cache du thread courant sert en priorité les derniers objets rendus.
+TEST(poolThreadCacheReusesLastReleased) {
+    Pool<int> pool;
+    pool.resize(64);
+    pool.enableThreadCache(4);
+    int* address;
+    {
+        auto object = pool.acquire(1);
+        address = &*object;
+    }
+    auto object = pool.acquire(2);
+    CHECK(&*object == address);
+}
+
+// Quand les piles partagées sont vides, les indices en cache dans un autre
+// thread, vivant ou terminé, sont repris au lieu d'échouer.
+TEST(poolThreadCacheDrainedWhenEmpty) {
+    constexpr size_t capacity = 16;
+    Pool<int> pool;
+    pool.resize(capacity);
+    pool.enableThreadCache(8);
+    auto fillCache = [&pool] {
+        std::vector<Pool<int>::Object> held;
+        for (size_t i = 0; i < capacity; ++i) {
+            held.push_back(pool.acquire(0));
+        }
+    };
+    std::mutex mutex;
+    std::condition_variable changed;
+    int step = 0;
+    std::thread live([&] {
+        fillCache();
+        std::unique_lock<std::mutex> lock(mutex);
+        step = 1;
+        changed.notify_all();
+        changed.wait(lock, [&step] { return step == 2; });
+    });
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [&step] { return step == 1; });
+    }
+    std::vector<Pool<int>::Object> held;
+    for (size_t i = 0; i < capacity; ++i) {
+        held.push_back(pool.acquire(1));
+    }
+    CHECK(!pool.try_acquire(2));
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        step = 2;
+    }
+    changed.notify_all();
+    live.join();
+    held.clear();
+    pool.flushThreadCache();
+    // Un thread terminé rend son cache à sa sortie.
+    std::thread(fillCache).join();
+    for (size_t i = 0; i < capacity; ++i) {
+        held.push_back(pool.try_acquire(3));
+        CHECK(held.back());
+    }
+}
+
+// Avec le cache, un thread bloqué obtient les objets libérés par les
+// autres, et ceux qu'ils gardaient en cache avant le mode Block.
+TEST(poolThreadCacheWithBlockWhenEmpty) {
+    constexpr size_t capacity = 8;
+    Pool<int> pool;
+    pool.resize(capacity);
+    pool.enableThreadCache(4);
+    std::thread([&pool] {
+        std::vector<Pool<int>::Object> held;
+        for (size_t i = 0; i < capacity; ++i) {
+            held.push_back(pool.acquire(0));
+        }
+    }).join();
+    pool.blockWhenEmpty(std::chrono::seconds(10));
+    std::vector<Pool<int>::Object> held;
+    for (size_t i = 0; i < capacity; ++i) {
+        held.push_back(pool.acquire(1));
+    }
+    std::atomic<size_t> obtained{0};
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < 4; ++i) {
+        threads.emplace_back([&] {
+            for (int round = 0; round < 100; ++round) {
+                auto object = pool.acquire(2);
+                ++obtained;
+            }
+        });
+    }
+    auto start = std::chrono::steady_clock::now();
+    held.clear();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    CHECK(obtained == 400);
+    CHECK(std::chrono::steady_clock::now() - start < std::chrono::seconds(5));
+}
+
+TEST(poolTryAcquireReturnsEmptyObject) {
+    Pool<int> pool;
+    pool.resize(1);
+    auto first = pool.try_acquire(1);
+    CHECK(first);
+    auto second = pool.try_acquire(2);
+    CHECK(!second);
+}
+
+TEST(poolGrowWhenEmpty) {
+    Pool<int> pool;
+    CHECK_THROWS(pool.growWhenEmpty(0), "Invalid growth size");
+    pool.resize(2);
+    pool.growWhenEmpty(3);
+    std::vector<Pool<int>::Object> held;
+    held.push_back(pool.acquire(0));
+    held.push_back(pool.acquire(1));
+    int* address = &*held[0];
+    for (int i = 2; i < 100; ++i) {
+        held.push_back(pool.acquire(i));
+    }
+    held.push_back(pool.try_acquire(100));
+    CHECK(held.back());
+    // Les objets déjà prêtés ne sont pas déplacés par la croissance.
+    CHECK(&*held[0] == address);
+    for (int i = 0; i <= 100; ++i) {
+        CHECK(*held[static_cast<size_t>(i)] == i);
+    }
+    pool.throwWhenEmpty();
+    for (auto object = pool.try_acquire(0); object;
+            object = pool.try_acquire(0)) {
+        held.push_back(std::move(object));
+    }
+    CHECK_THROWS(pool.acquire(0), "Pool is empty");
+}
+
+TEST(poolBlockWhenEmptyTimesOut) {
+    Pool<int> pool;
+    pool.resize(1);
+    pool.blockWhenEmpty(std::chrono::milliseconds(20));
+    auto held = pool.acquire(1);
+    auto start = std::chrono::steady_clock::now();
+    CHECK_THROWS(pool.acquire(2), "Pool is empty");
+    CHECK(std::chrono::steady_clock::now() - start
+            >= std::chrono::milliseconds(20));
+    // try_acquire() n'attend jamais.
+    CHECK(!pool.try_acquire(3));
+}
+
+TEST(poolBlockWhenEmptyWakesOnRelease) {
+    Pool<int> pool;
+    pool.resize(2);
+    pool.blockWhenEmpty(std::chrono::seconds(10));
+    std::vector<Pool<int>::Object> held;
+    held.push_back(pool.acquire(1));
+    held.push_back(pool.acquire(2));
+    std::atomic<int> obtained{0};
+    std::vector<std::thread> waiters;
+    for (int i = 0; i < 2; ++i) {
+        waiters.emplace_back([&] {
+            auto object = pool.acquire(3);
+            ++obtained;
+        });
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    CHECK(obtained == 0);
+    held.clear();
+    for (std::thread& waiter : waiters) {
+        waiter.join();
+    }
+    CHECK(obtained == 2);
+}
+
+// Le comportement peut changer pendant que d'autres threads utilisent le
+// pool (vérifié par TSan).
+TEST(poolPolicyChangesWhileShared) {
+    Pool<int> pool;
+    pool.resize(4);
+    pool.enableThreadCache(2);
+    std::atomic<bool> done{false};
+    std::atomic<uint64_t> acquired{0};
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i) {
+        threads.emplace_back([&] {
+            std::vector<Pool<int>::Object> held;
+            while (!done) {
+                try {
+                    held.push_back(pool.acquire(1));
+                    ++acquired;
+                } catch (const std::runtime_error&) {
+                }
+                if (held.size() > 3) {
+                    held.clear();
+                }
+            }
+            held.clear();
+            pool.flushThreadCache();
+        });
+    }
+    for (int round = 0; round < 300; ++round) {
+        switch (round % 3) {
+            case 0:
+                pool.growWhenEmpty(1 + static_cast<size_t>(round % 5));
+                break;
+            case 1:
+                pool.blockWhenEmpty(std::chrono::microseconds(100));
+                break;
+            default:
+                pool.throwWhenEmpty();
+        }
+        std::this_thread::yield();
+    }
+    done = true;
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    CHECK(acquired > 0);
+}
+
+TEST(poolStatisticsCountAcrossThreads) {
+    Pool<int> pool;
+    pool.resize(64);
+    CHECK_THROWS(pool.statistics(), "Statistics not enabled");
+    pool.enableStatistics();
+    std::vector<std::thread> threads;
+    for (size_t thread = 0; thread < 4; ++thread) {
+        threads.emplace_back([&] {
+            for (int i = 0; i < 1000; ++i) {
+                auto object = pool.acquire(i);
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    std::vector<Pool<int>::Object> held;
+    for (int i = 0; i < 64; ++i) {
+        held.push_back(pool.acquire(i));
+    }
+    CHECK(!pool.try_acquire(0));
+    pool.growWhenEmpty(16);
+    held.push_back(pool.acquire(0));
+    Pool<int>::Statistics statistics = pool.statistics();
+    CHECK(statistics.acquires == 4000 + 65);
+    CHECK(statistics.releases == 4000);
+    CHECK(statistics.inUse == 65);
+    CHECK(statistics.highWaterMark >= 65);
+    CHECK(statistics.exhaustions >= 1);
+    CHECK(statistics.growths == 1);
+    CHECK(statistics.capacity == 80);
+}
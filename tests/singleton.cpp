@@ -0,0 +1,129 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   singleton.cpp                                      :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sdestann <sdestann@student.42perpignan.    +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/11/18 15:12:12 by sdestann          #+#    #+#             */
+/*   Updated: 2024/11/18 16:56:02 by sdestann         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "test.hpp"
+#include "libftpp.hpp"
+
+namespace {
+
+// Ordre des destructions des singletons de ce fichier.
+std::vector<std::string> destroyed;
+
+class Config : public Singleton<Config> {
+    friend class Singleton<Config>;
+private:
+    explicit Config(int p_value = 0) : value(p_value) {}
+public:
+    int value;
+
+    ~Config() {
+        destroyed.push_back("config");
+    }
+};
+
+class Logger : public Singleton<Logger> {
+    friend class Singleton<Logger>;
+private:
+    Logger() = default;
+public:
+    ~Logger() {
+        destroyed.push_back("logger");
+    }
+};
+
+class Counter : public Singleton<Counter> {
+    friend class Singleton<Counter>;
+private:
+    Counter() {
+        ++alive;
+    }
+public:
+    static inline std::atomic<int> alive{0};
+
+    ~Counter() {
+        --alive;
+    }
+};
+
+}
+
+TEST(singletonInstanciatesOnce) {
+    CHECK(Config::instance() == nullptr);
+    Config::instanciate(4);
+    CHECK(Config::instance() != nullptr);
+    CHECK(Config::instance()->value == 4);
+    CHECK_THROWS(Config::instanciate(5), "Instance already exists");
+    Config::destroy();
+    CHECK(Config::instance() == nullptr);
+    Config::destroy();
+    Config::instanciate(6);
+    CHECK(Config::instance()->value == 6);
+    Config::destroy();
+    destroyed.clear();
+}
+
+TEST(singletonRegistryDestroysInReverseOrder) {
+    Config::instanciate();
+    Logger::instanciate();
+    SingletonRegistry::destroyAll();
+    CHECK(destroyed == (std::vector<std::string>{"logger", "config"}));
+    CHECK(Config::instance() == nullptr);
+    CHECK(Logger::instance() == nullptr);
+    destroyed.clear();
+}
+
+TEST(singletonConcurrentInstanciate) {
+    std::atomic<int> created{0};
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 8; ++i) {
+        threads.emplace_back([&created] {
+            try {
+                Counter::instanciate();
+                ++created;
+            } catch (const std::runtime_error&) {
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    CHECK(created == 1);
+    CHECK(Counter::alive == 1);
+    Counter::destroy();
+    CHECK(Counter::alive == 0);
+}
+
+// destroy() et instanciate() en même temps : l'instance qui reste est
+// toujours inscrite, et détruite une seule fois par destroyAll().
+TEST(singletonDestroyRacingInstanciate) {
+    for (int round = 0; round < 500; ++round) {
+        Counter::instanciate();
+        std::thread destroyer([] {
+            Counter::destroy();
+        });
+        std::thread creator([] {
+            try {
+                Counter::instanciate();
+            } catch (const std::runtime_error&) {
+            }
+        });
+        destroyer.join();
+        creator.join();
+        SingletonRegistry::destroyAll();
+        if (Counter::alive != 0 || Counter::instance() != nullptr) {
+            CHECK(Counter::alive == 0);
+            CHECK(Counter::instance() == nullptr);
+            Counter::destroy();
+            break;
+        }
+    }
+}
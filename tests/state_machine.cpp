@@ -0,0 +1,167 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   state_machine.cpp                                  :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sdestann <sdestann@student.42perpignan.    +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/11/18 15:12:12 by sdestann          #+#    #+#             */
+/*   Updated: 2024/11/18 16:56:02 by sdestann         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "test.hpp"
+#include "libftpp.hpp"
+
+namespace {
+
+// Sans COUNT : StateMachine générique, à base de tables associatives.
+enum class Sparse { Idle, Walking, Running };
+// Avec COUNT : StateMachine dense, à base de tableaux.
+enum class Dense { Idle, Walking, Running, COUNT };
+
+// Mêmes vérifications pour les deux versions.
+template<typename TState>
+void checkMachine() {
+    StateMachine<TState> machine;
+    std::vector<std::string> calls;
+    // L'état actuel reste TState{} : addState() ne le change pas.
+    machine.addState(TState::Walking);
+    machine.addState(TState::Idle);
+    CHECK(machine.getCurrentState() == TState::Idle);
+    CHECK(machine.hasState(TState::Walking));
+    CHECK(!machine.hasState(TState::Running));
+    CHECK_THROWS(machine.addAction(TState::Running, [] {}),
+            "State not registered");
+    CHECK_THROWS(machine.addTransition(TState::Idle, TState::Running, [] {}),
+            "State not registered");
+    CHECK(!machine.hasState(TState::Running));
+    machine.addState(TState::Running);
+    machine.addTransition(TState::Idle, TState::Walking, [&] {
+        calls.push_back("start");
+    });
+    machine.addTransition(TState::Walking, TState::Running, [&] {
+        calls.push_back("run");
+    });
+    // Une transition redéfinie remplace l'ancienne.
+    machine.addTransition(TState::Walking, TState::Running, [&] {
+        calls.push_back("sprint");
+    });
+    machine.addAction(TState::Walking, [&] { calls.push_back("walking"); });
+    CHECK(machine.hasTransition(TState::Idle, TState::Walking));
+    CHECK(!machine.hasTransition(TState::Walking, TState::Idle));
+    CHECK(machine.hasAction(TState::Walking));
+    CHECK(!machine.hasAction(TState::Idle));
+    CHECK_THROWS(machine.update(), "No action for current state");
+    CHECK_THROWS(machine.transitionTo(TState::Running), "Invalid transition");
+    machine.transitionTo(TState::Walking);
+    machine.update();
+    machine.transitionTo(TState::Running);
+    CHECK(machine.getCurrentState() == TState::Running);
+    CHECK(calls == (std::vector<std::string>{"start", "walking", "sprint"}));
+    CHECK_THROWS(machine.transitionTo(TState::Idle), "Invalid transition");
+    CHECK(machine.getCurrentState() == TState::Running);
+    // Une transition qui lève une exception ne change pas l'état.
+    machine.addTransition(TState::Running, TState::Idle, [] {
+        throw std::runtime_error("Blocked");
+    });
+    CHECK_THROWS(machine.transitionTo(TState::Idle), "Blocked");
+    CHECK(machine.getCurrentState() == TState::Running);
+}
+
+}
+
+TEST(stateMachineGeneric) {
+    checkMachine<Sparse>();
+    StateMachine<std::string> named;
+    CHECK(named.getCurrentState().empty());
+    named.addState("");
+    named.addState("open");
+    named.addTransition("", "open", [] {});
+    named.transitionTo("open");
+    CHECK(named.getCurrentState() == "open");
+}
+
+TEST(stateMachineDense) {
+    checkMachine<Dense>();
+    StateMachine<Dense> machine;
+    CHECK_THROWS(machine.addState(Dense::COUNT), "Invalid state");
+    machine.addState(Dense::Idle);
+    CHECK(!machine.hasState(static_cast<Dense>(9)));
+    CHECK_THROWS(machine.transitionTo(static_cast<Dense>(9)),
+            "Invalid transition");
+}
+
+namespace {
+
+std::shared_ptr<StateMachineBatch<Dense>::Graph> makeGraph(
+        std::vector<std::atomic<int>>& seen) {
+    auto graph = std::make_shared<StateMachineBatch<Dense>::Graph>();
+    graph->addState(Dense::Idle);
+    graph->addState(Dense::Walking);
+    graph->addTransition(Dense::Idle, Dense::Walking, [](uint32_t) {});
+    for (Dense state : {Dense::Idle, Dense::Walking}) {
+        graph->addAction(state, [&seen, state](std::span<const uint32_t> batch) {
+            for (uint32_t entity : batch) {
+                seen[entity] += state == Dense::Walking ? 10 : 1;
+            }
+        });
+    }
+    return graph;
+}
+
+}
+
+TEST(stateMachineBatchTransitions) {
+    std::vector<std::atomic<int>> seen(10);
+    auto graph = makeGraph(seen);
+    CHECK_THROWS((StateMachineBatch<Dense>(graph, 1, Dense::Running)),
+            "State not registered");
+    StateMachineBatch<Dense> batch(graph, 3, Dense::Idle);
+    batch.transitionTo(1, Dense::Walking);
+    CHECK(batch.getState(1) == Dense::Walking);
+    CHECK_THROWS(batch.transitionTo(1, Dense::Idle), "Invalid transition");
+    CHECK_THROWS(batch.transitionTo(3, Dense::Walking), "Invalid entity");
+    CHECK(batch.add(Dense::Walking) == 3);
+    CHECK(batch.size() == 4);
+    batch.updateAll();
+    CHECK(seen[0] == 1 && seen[1] == 10 && seen[2] == 1 && seen[3] == 10);
+}
+
+// Sur plusieurs threads, chaque entité est traitée une fois par updateAll(),
+// et le même batch peut être mis à jour de nouveau.
+TEST(stateMachineBatchUpdatesOnSeveralThreads) {
+    constexpr size_t entities = 50000;
+    std::vector<std::atomic<int>> seen(entities);
+    StateMachineBatch<Dense> batch(makeGraph(seen), entities, Dense::Idle);
+    for (size_t entity = 0; entity < entities; entity += 3) {
+        batch.transitionTo(entity, Dense::Walking);
+    }
+    for (size_t threads : {2, 4, 8}) {
+        batch.updateAll(threads);
+    }
+    bool exact = true;
+    for (size_t entity = 0; entity < entities; ++entity) {
+        exact = exact && seen[entity] == (entity % 3 == 0 ? 30 : 3);
+    }
+    CHECK(exact);
+    StateMachineBatch<Dense> empty(makeGraph(seen), 0, Dense::Idle);
+    empty.updateAll(4);
+}
+
+TEST(stateMachineBatchForwardsActionErrors) {
+    auto graph = std::make_shared<StateMachineBatch<Dense>::Graph>();
+    graph->addState(Dense::Idle);
+    graph->addState(Dense::Walking);
+    graph->addTransition(Dense::Idle, Dense::Walking, [](uint32_t) {});
+    graph->addAction(Dense::Idle, [](std::span<const uint32_t> batch) {
+        if (batch.back() == 19999) {
+            throw std::runtime_error("Action failed");
+        }
+    });
+    StateMachineBatch<Dense> batch(graph, 20000, Dense::Idle);
+    CHECK_THROWS(batch.updateAll(4), "Action failed");
+    CHECK_THROWS(batch.updateAll(), "Action failed");
+    batch.transitionTo(0, Dense::Walking);
+    CHECK_THROWS(batch.updateAll(4), "No action for current state");
+}
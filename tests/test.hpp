@@ -0,0 +1,120 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   test.hpp                                           :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sdestann <sdestann@student.42perpignan.    +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/11/18 15:12:12 by sdestann          #+#    #+#             */
+/*   Updated: 2024/11/18 16:56:02 by sdestann         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef TEST_HPP
+# define TEST_HPP
+
+#include <cstdio>
+#include <exception>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+class Tests {
+    /** @brief Tests enregistrés par TEST(nom) et lancés par main.cpp.
+     *
+     * exemple :
+     *
+     * TEST(poolReusesReleasedObjects) {
+     *     Pool<int> pool;
+     *     pool.resize(1);
+     *     { auto object = pool.acquire(1); }
+     *     auto object = pool.acquire(2);
+     *     CHECK(*object == 2);
+     *     CHECK_THROWS(pool.acquire(), "Pool is empty");
+     * }
+     *
+     * Un CHECK qui échoue affiche la condition et continue le test ; une
+     * exception non attendue arrête le test et le fait échouer.
+     */
+public:
+    using Function = void (*)();
+
+    struct Test {
+        const char* name;
+        const char* file;
+        Function function;
+    };
+
+    static std::vector<Test>& all() {
+        static std::vector<Test> tests;
+        return tests;
+    }
+
+    static bool add(const char* name, const char* file, Function function) {
+        all().push_back(Test{name, file, function});
+        return true;
+    }
+
+    // Nombre de CHECK échoués dans le test en cours.
+    static size_t& failures() {
+        static size_t count = 0;
+        return count;
+    }
+
+    static void check(bool condition, const char* expression,
+            const char* file, int line) {
+        if (!condition) {
+            std::printf("    %s:%d: CHECK(%s) failed\n", file, line,
+                    expression);
+            ++failures();
+        }
+    }
+
+    // Vérifie que function lève std::exception avec le message attendu.
+    template<typename TFunction>
+    static void checkThrows(TFunction&& function, const std::string& message,
+            const char* expression, const char* file, int line) {
+        try {
+            function();
+        } catch (const std::exception& exception) {
+            if (message == exception.what()) {
+                return;
+            }
+            std::printf("    %s:%d: %s threw \"%s\" instead of \"%s\"\n",
+                    file, line, expression, exception.what(),
+                    message.c_str());
+            ++failures();
+            return;
+        }
+        std::printf("    %s:%d: %s did not throw \"%s\"\n", file, line,
+                expression, message.c_str());
+        ++failures();
+    }
+};
+
+// Chemin d'un fichier temporaire propre au processus, supprimé à la
+// destruction.
+struct TemporaryFile {
+    std::string path;
+
+    explicit TemporaryFile(const std::string& name) : path("/tmp/libftpp_"
+            + std::to_string(::getpid()) + "_" + name) {
+    }
+    ~TemporaryFile() {
+        std::remove(path.c_str());
+    }
+};
+
+#define TEST(name) \
+    static void name(); \
+    static const bool name##Registered = Tests::add(#name, __FILE__, name); \
+    static void name()
+
+#define CHECK(condition) \
+    Tests::check(static_cast<bool>(condition), #condition, __FILE__, __LINE__)
+
+#define CHECK_THROWS(expression, message) \
+    Tests::checkThrows([&] { (void)(expression); }, message, #expression, \
+            __FILE__, __LINE__)
+
+#endif
@@ -0,0 +1,209 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   threading.cpp                                      :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sdestann <sdestann@student.42perpignan.    +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/11/18 15:12:12 by sdestann          #+#    #+#             */
+/*   Updated: 2024/11/18 16:56:02 by sdestann         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "test.hpp"
+#include "libftpp.hpp"
+#include <optional>
+
+TEST(threadSafeQueueIsBoundedFifo) {
+    CHECK_THROWS(ThreadSafeQueue<int>(0), "Invalid queue size");
+    ThreadSafeQueue<std::unique_ptr<int>> queue(3);
+    CHECK(queue.capacity() == 4);
+    CHECK(queue.empty());
+    for (int i = 0; i < 4; ++i) {
+        CHECK(queue.tryPush(std::make_unique<int>(i)));
+    }
+    // Une file pleine ne prend pas la valeur.
+    auto extra = std::make_unique<int>(4);
+    CHECK(!queue.tryPush(std::move(extra)));
+    CHECK(extra != nullptr);
+    for (int i = 0; i < 4; ++i) {
+        CHECK(*queue.pop() == i);
+    }
+    CHECK_THROWS(queue.pop(), "Queue is empty");
+    // Les cases sont réutilisées au tour suivant.
+    queue.push(std::move(extra));
+    std::unique_ptr<int> value;
+    CHECK(queue.tryPop(value) && *value == 4);
+    CHECK(!queue.tryPop(value));
+}
+
+TEST(threadSafeQueueDestroysRemainingValues) {
+    auto token = std::make_shared<int>(0);
+    {
+        ThreadSafeQueue<std::shared_ptr<int>> queue(8);
+        queue.push(token);
+        queue.push(token);
+        CHECK(token.use_count() == 3);
+    }
+    CHECK(token.use_count() == 1);
+}
+
+// Sans constructeur par défaut, et avec des éléments restants de part et
+// d'autre de la fin de l'anneau.
+TEST(threadSafeQueueDestroysValuesWithoutDefaultConstructor) {
+    struct Held {
+        std::shared_ptr<int> token;
+
+        explicit Held(std::shared_ptr<int> p_token) : token(p_token) {
+        }
+    };
+    auto token = std::make_shared<int>(0);
+    {
+        ThreadSafeQueue<Held> queue(4);
+        for (int i = 0; i < 3; ++i) {
+            queue.push(Held(token));
+        }
+        std::optional<Held> value;
+        for (int i = 0; i < 3; ++i) {
+            CHECK(queue.tryPop(value.emplace(nullptr)));
+        }
+        value.reset();
+        for (int i = 0; i < 3; ++i) {
+            queue.push(Held(token));
+        }
+        CHECK(token.use_count() == 4);
+    }
+    CHECK(token.use_count() == 1);
+}
+
+// Plusieurs producteurs et consommateurs sur une petite file : chaque
+// valeur est retirée une seule fois, et celles d'un même producteur dans
+// l'ordre où il les a ajoutées.
+TEST(threadSafeQueueMultiProducerMultiConsumerStress) {
+    constexpr int producers = 4;
+    constexpr int consumers = 4;
+    constexpr int perProducer = 50000;
+    ThreadSafeQueue<std::pair<int, int>> queue(64);
+    std::vector<std::atomic<int>> seen(producers * perProducer);
+    std::atomic<int> consumed{0};
+    std::atomic<bool> unordered{false};
+    std::vector<std::thread> threads;
+    for (int producer = 0; producer < producers; ++producer) {
+        threads.emplace_back([&queue, producer] {
+            for (int i = 0; i < perProducer; ++i) {
+                queue.push(std::make_pair(producer, i));
+            }
+        });
+    }
+    for (int consumer = 0; consumer < consumers; ++consumer) {
+        threads.emplace_back([&] {
+            std::vector<int> last(producers, -1);
+            std::pair<int, int> value;
+            while (consumed.load() < producers * perProducer) {
+                if (!queue.tryPop(value)) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                ++consumed;
+                ++seen[static_cast<size_t>(value.first * perProducer
+                        + value.second)];
+                if (value.second <= last[static_cast<size_t>(value.first)]) {
+                    unordered = true;
+                }
+                last[static_cast<size_t>(value.first)] = value.second;
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    bool once = true;
+    for (std::atomic<int>& count : seen) {
+        once = once && count == 1;
+    }
+    CHECK(once);
+    CHECK(!unordered);
+    CHECK(queue.empty());
+}
+
+TEST(workerPoolRunsJobsAndScratchJobs) {
+    CHECK_THROWS(WorkerPool(0), "Invalid worker count");
+    WorkerPool workers(2);
+    CHECK(workers.size() == 2);
+    std::atomic<int> done{0};
+    std::atomic<bool> shared{false};
+    for (int i = 0; i < 100; ++i) {
+        workers.addJob([&done] { ++done; });
+        workers.addJob([&done, &shared](DataBuffer& scratch) {
+            // Le buffer de travail n'est partagé avec aucun autre worker.
+            scratch.clear();
+            scratch << 42;
+            std::this_thread::yield();
+            int value = 0;
+            scratch >> value;
+            if (value != 42) {
+                shared = true;
+            }
+            ++done;
+        });
+    }
+    workers.wait();
+    CHECK(done == 200);
+    CHECK(!shared);
+}
+
+// Des jobs ajoutent des jobs depuis les workers : ils passent par la deque
+// du worker, où les autres les volent. Un seul job en ajoute plus que la
+// deque n'en contient.
+TEST(workerPoolRunsNestedJobs) {
+    WorkerPool workers(4);
+    std::atomic<int> done{0};
+    std::function<void(int)> spawn = [&](int depth) {
+        ++done;
+        if (depth > 0) {
+            for (int i = 0; i < 4; ++i) {
+                workers.addJob([&spawn, depth] { spawn(depth - 1); });
+            }
+        }
+    };
+    workers.addJob([&spawn] { spawn(6); });
+    workers.wait();
+    // 1 + 4 + ... + 4^6 jobs.
+    CHECK(done == (16384 - 1) / 3);
+    done = 0;
+    workers.addJob([&] {
+        for (int i = 0; i < 5000; ++i) {
+            workers.addJob([&done] { ++done; });
+        }
+    });
+    workers.wait();
+    CHECK(done == 5000);
+}
+
+TEST(workerPoolWaitRethrowsFirstException) {
+    WorkerPool workers(2);
+    std::atomic<int> done{0};
+    for (int i = 0; i < 20; ++i) {
+        workers.addJob([&done] {
+            ++done;
+            throw std::runtime_error("Job failed");
+        });
+    }
+    CHECK_THROWS(workers.wait(), "Job failed");
+    CHECK(done == 20);
+    // L'exception est consommée par le wait() qui la relance.
+    workers.addJob([&done] { ++done; });
+    workers.wait();
+    CHECK(done == 21);
+}
+
+TEST(workerPoolDestructorRunsRemainingJobs) {
+    std::atomic<int> done{0};
+    {
+        WorkerPool workers(1);
+        for (int i = 0; i < 500; ++i) {
+            workers.addJob([&done] { ++done; });
+        }
+    }
+    CHECK(done == 500);
+}